@@ -6,6 +6,7 @@
  **********************************************************************/
 #include "ui_dlgadcindatatype.h"
 #include <dlgadcindatatype.h>
+#include <mbdevicelogic.h>
 
 DlgAdcInDataType::DlgAdcInDataType(WSAnalogInMbRtu* rtu, QWidget* parent)
     : QDialog(parent)
@@ -16,11 +17,19 @@ DlgAdcInDataType::DlgAdcInDataType(WSAnalogInMbRtu* rtu, QWidget* parent)
 {
     ui->setupUi(this);
 
+    /* driver state lives in the logic thread */
+    m_channelTypes = MBDeviceLogic::call(m_rtu, [rtu]() {
+        QMap<quint8, WSAnalogInMbRtu::TChannelType> types;
+        for (quint8 i = 0; i < rtu->maxInputs(); i++) {
+            types[i] = rtu->channelType(i);
+        }
+        return types;
+    });
+
     ui->cbChannel->clear();
     for (quint8 i = 0; i < m_rtu->maxInputs(); i++) {
         QString name = tr("Channel %1").arg(i + 1);
         ui->cbChannel->addItem(name, QVariant());
-        m_channelTypes[i] = rtu->channelType(i);
     }
 
     m_btnSave = ui->buttonBox->button(QDialogButtonBox::Save);
@@ -150,5 +159,7 @@ void DlgAdcInDataType::on_rbMode4_clicked(bool checked)
 
 void DlgAdcInDataType::on_buttonBox_accepted()
 {
-    m_rtu->setChannelTypes(m_channelTypes, true);
+    MBDeviceLogic::post(m_rtu, [rtu = m_rtu, types = m_channelTypes]() {
+        rtu->setChannelTypes(types, true);
+    });
 }
@@ -6,6 +6,7 @@
  **********************************************************************/
 #include "ui_dlgrelaylinkcontrol.h"
 #include <dlgrelaylinkcontrol.h>
+#include <mbdevicelogic.h>
 
 DlgRelayLinkControl::DlgRelayLinkControl(WSRelayDigInMbRtu* rtu, QWidget* parent)
     : QDialog(parent)
@@ -17,11 +18,19 @@ DlgRelayLinkControl::DlgRelayLinkControl(WSRelayDigInMbRtu* rtu, QWidget* parent
 {
     ui->setupUi(this);
 
+    /* driver state lives in the logic thread */
+    m_control = MBDeviceLogic::call(m_rtu, [rtu]() {
+        QMap<quint8, WSRelayDigInMbRtu::TControlMode> modes;
+        for (quint8 i = 0; i < rtu->maxInputs(); i++) {
+            modes[i] = rtu->controlMode(i);
+        }
+        return modes;
+    });
+
     ui->cbChannel->clear();
     for (quint8 i = 0; i < m_rtu->maxInputs(); i++) {
         QString name = tr("Channel %1").arg(i + 1);
         ui->cbChannel->addItem(name, QVariant());
-        m_control[i] = rtu->controlMode(i);
     }
 
     m_btnSave = ui->buttonBox->button(QDialogButtonBox::Save);
@@ -113,5 +122,7 @@ void DlgRelayLinkControl::on_rbMode2_clicked(bool checked)
 
 void DlgRelayLinkControl::on_buttonBox_accepted()
 {
-    m_rtu->setControlModes(m_control, true);
+    MBDeviceLogic::post(m_rtu, [rtu = m_rtu, modes = m_control]() {
+        rtu->setControlModes(modes, true);
+    });
 }
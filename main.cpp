@@ -5,12 +5,67 @@
  * SPDX-License-Identifier: GPL v3
  **********************************************************************/
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
 #include <QLocale>
+#include <QTextStream>
 #include <QTranslator>
 #include <mainwindow.h>
+#include <mbhistorian.h>
+
+/* read only query of a history directory, no GUI, the
+ * recording application may keep running meanwhile. */
+static int exportHistory(int argc, char* argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("History export, CSV on stdout");
+    parser.addHelpOption();
+    const QCommandLineOption history("history", "Historian directory.", "path");
+    const QCommandLineOption series("series", "Series name, lists the series if omitted.", "name");
+    const QCommandLineOption from("from", "Start in ms since epoch, default 24 hours ago.", "ms");
+    const QCommandLineOption to("to", "End in ms since epoch, default now.", "ms");
+    const QCommandLineOption step("step", "Bucket width in ms, 0 = raw samples.", "ms", "0");
+    parser.addOptions({history, series, from, to, step});
+    parser.process(a);
+
+    MBHistorian historian;
+    if (!historian.open(parser.value(history), true)) {
+        qCritical() << "MBHIST: Can't open history" << parser.value(history);
+        return 1;
+    }
+
+    QTextStream out(stdout);
+    if (!parser.isSet(series)) {
+        QStringList names = historian.seriesNames().values();
+        names.sort();
+        foreach (const QString& name, names) {
+            out << name << '\n';
+        }
+        historian.close();
+        return 0;
+    }
+
+    const qint64 end = (parser.isSet(to) ? parser.value(to).toLongLong() : QDateTime::currentMSecsSinceEpoch());
+    const qint64 start = (parser.isSet(from) ? parser.value(from).toLongLong() : end - 24 * 3600 * 1000LL);
+    const bool result = historian.exportCsv(parser.value(series), start, end, parser.value(step).toLongLong(), out);
+    out.flush();
+    historian.close();
+    return (result ? 0 : 1);
+}
 
 int main(int argc, char* argv[])
 {
+    /* --history selects the export tool */
+    for (int i = 1; i < argc; i++) {
+        if (qstrncmp(argv[i], "--history", 9) == 0) {
+            return exportHistory(argc, argv);
+        }
+    }
+
     QApplication a(argc, argv);
 
     MainWindow w;
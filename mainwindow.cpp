@@ -6,8 +6,14 @@
  **********************************************************************/
 #include "ui_mainwindow.h"
 #include <QApplication>
+#include <QDateTime>
 #include <QDebug>
 #include <QDir>
+#include <QFileInfo>
+#include <QHeaderView>
+#include <QFutureWatcher>
+#include <QMessageBox>
+#include <QMetaEnum>
 #include <QModbusDataUnit>
 #include <QSerialPortInfo>
 #include <QSettings>
@@ -15,9 +21,13 @@
 #include <dlgadcindatatype.h>
 #include <dlgrelaylinkcontrol.h>
 #include <mainwindow.h>
+#include <mbdevicelogic.h>
+#include <mbhistorian.h>
+#include <mbportresolver.h>
+#include <mbprocessimage.h>
+#include <mbstatestore.h>
 
 Q_DECLARE_METATYPE(QSerialPortInfo)
-Q_DECLARE_METATYPE(QSerialPort::BaudRate)
 Q_DECLARE_METATYPE(QSerialPort::DataBits)
 Q_DECLARE_METATYPE(QSerialPort::StopBits)
 Q_DECLARE_METATYPE(QSerialPort::Parity)
@@ -37,23 +47,88 @@ MainWindow::MainWindow(QWidget* parent)
     , ui(new Ui::MainWindow)
     , m_settings(configFile(), QSettings::IniFormat, this)
     , m_config()
-    , m_modbus(this)
+    , m_modbus()
+    , m_gateway(&m_modbus)
+    , m_discovery()
+    , m_upgrade(&m_modbus)
+    , m_dashboard(MBStateStore::instance(), this)
+    , m_dashFilter(this)
+    , m_history(MBHistorian::instance(), this)
     , m_rly(nullptr)
     , m_adc(nullptr)
     , m_chg(nullptr)
+    , m_profiles()
+    , m_configWatcher(this)
+    , m_reloadTimer(this)
+    , m_relayButtons()
+    , m_inputBoxes()
+    , m_analogDisplays()
+    , m_rlyKey()
+    , m_adcKey()
+    , m_reopenAfterScan(false)
 {
     qDebug() << "APPWND: Config file:" << m_settings.fileName();
 
     ui->setupUi(this);
 
     connect(qApp, &QApplication::aboutToQuit, this, &MainWindow::onAppQuit);
+    connect(&m_discovery, &MBDiscovery::finished, this, &MainWindow::onDiscoveryFinished);
+    connect(&m_upgrade, &MBSpeedUpgrade::finished, this, &MainWindow::onUpgradeFinished);
+    connect(MBStateStore::instance(), &MBStateStore::frame, this, &MainWindow::onStateFrame);
+
+    /* no widget lookups per update */
+    for (int i = 1; i <= 8; i++) {
+        m_relayButtons.append(ui->pnlRelay->findChild<QPushButton*>(QStringLiteral("pbR%1").arg(i)));
+        m_inputBoxes.append(ui->pnlDigitalIn->findChild<QCheckBox*>(QStringLiteral("cbxChannel%1").arg(i)));
+        m_analogDisplays.append(ui->pnlAnalogIn->findChild<QLCDNumber*>(QStringLiteral("lcdChannel%1").arg(i)));
+    }
 
     m_config.mbconf = m_modbus.config();
     m_config.rlyAddr = 1;
     m_config.adcAddr = 1;
+    m_config.chgAddr = 1;
+    m_config.rlyInterval = 0;
+    m_config.adcInterval = 0;
+    m_config.chgInterval = 0;
+    m_config.gwEnabled = false;
+    m_config.gwconf = m_gateway.config();
+    m_config.histEnabled = false;
+    m_config.histPath = QStringLiteral("%1%2history") //
+                           .arg(
+                              QStandardPaths::writableLocation( //
+                                 QStandardPaths::AppDataLocation),
+                              QDir::separator());
     loadConfig();
 
-    const QList<QSerialPortInfo> ports = QSerialPortInfo::availablePorts();
+    /* shared stores belong to the main thread */
+    MBProcessImage::instance();
+    MBHistorian::instance();
+
+    /* record polled channels */
+    if (m_config.histEnabled) {
+        MBHistorian::instance()->open(m_config.histPath);
+    }
+
+    /* bus clients run in the device logic thread */
+    MBDeviceLogic* logic = MBDeviceLogic::instance();
+    logic->adopt(&m_modbus);
+    logic->adopt(&m_gateway);
+    logic->adopt(&m_discovery);
+    logic->adopt(&m_upgrade);
+    logic->start();
+
+    /* Modbus TCP access to the bus devices */
+    if (m_config.gwEnabled) {
+        MBDeviceLogic::post(&m_gateway, [this, config = m_config.gwconf]() {
+            m_gateway.setConfig(config);
+            m_gateway.listen();
+        });
+    }
+
+    /* profile devices of the config */
+    applyProfiles({});
+
+    const QList<QSerialPortInfo> ports = MBPortResolver::instance()->availablePorts();
     int selected = -1;
 
     /* Global MODBUS */
@@ -70,7 +145,7 @@ MainWindow::MainWindow(QWidget* parent)
 
     typedef struct {
         QString name;
-        QSerialPort::BaudRate baud;
+        qint32 baud;
     } TBaudRates;
 
     TBaudRates baudRates[8] = {
@@ -82,6 +157,8 @@ MainWindow::MainWindow(QWidget* parent)
        {tr("38400"), QSerialPort::Baud38400},
        {tr("57600"), QSerialPort::Baud57600},
        {tr("115200"), QSerialPort::Baud115200},
+       {tr("128000"), 128000},
+       {tr("256000"), 256000},
     };
 
     selected = -1;
@@ -208,6 +285,42 @@ MainWindow::MainWindow(QWidget* parent)
     ui->pgAnalogInRtu->setEnabled(false);
     ui->pgRenogyRtu->setEnabled(false);
 
+    /* one row per charger metric */
+    const QMetaEnum metrics = QMetaEnum::fromType<WSRenogyMpptMbRtu::TMetric>();
+    ui->twChgMetrics->setRowCount(WSRenogyMpptMbRtu::MetricCount);
+    for (int i = 0; i < WSRenogyMpptMbRtu::MetricCount; i++) {
+        ui->twChgMetrics->setItem(i, 0, new QTableWidgetItem(metrics.valueToKey(i)));
+        ui->twChgMetrics->setItem(i, 1, new QTableWidgetItem());
+    }
+
+    /* all channels of all ports, fixed row height keeps the view virtual */
+    m_dashFilter.setSourceModel(&m_dashboard);
+    m_dashFilter.setFilterKeyColumn(-1);
+    m_dashFilter.setFilterCaseSensitivity(Qt::CaseInsensitive);
+    ui->tvDashboard->setModel(&m_dashFilter);
+    ui->tvDashboard->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    ui->tvDashboard->verticalHeader()->setDefaultSectionSize(ui->tvDashboard->fontMetrics().height() + 4);
+    ui->tvDashboard->horizontalHeader()->setSectionResizeMode(QHeaderView::Interactive);
+
+    /* downsampled buckets of a recorded series */
+    ui->cbHistRange->addItem(tr("1 hour"), 3600 * 1000LL);
+    ui->cbHistRange->addItem(tr("1 day"), 24 * 3600 * 1000LL);
+    ui->cbHistRange->addItem(tr("7 days"), 7 * 24 * 3600 * 1000LL);
+    ui->tvHistory->setModel(&m_history);
+    ui->tvHistory->horizontalHeader()->setSectionResizeMode(QHeaderView::Interactive);
+
+    /* edits of the config file apply while running, editors
+       replace the file, the directory sees the new one */
+    m_reloadTimer.setSingleShot(true);
+    m_reloadTimer.setInterval(250);
+    connect(&m_reloadTimer, &QTimer::timeout, this, &MainWindow::onConfigReload);
+    connect(&m_configWatcher, &QFileSystemWatcher::fileChanged, this, &MainWindow::onConfigFileChanged);
+    connect(&m_configWatcher, &QFileSystemWatcher::directoryChanged, this, &MainWindow::onConfigFileChanged);
+    m_configWatcher.addPath(QFileInfo(m_settings.fileName()).absolutePath());
+    if (QFileInfo::exists(m_settings.fileName())) {
+        m_configWatcher.addPath(m_settings.fileName());
+    }
+
     ui->toolBox->setCurrentIndex(0);
 }
 
@@ -219,20 +332,31 @@ MainWindow::~MainWindow()
 
 void MainWindow::onAppQuit()
 {
-    m_modbus.close();
-
-    if (m_rly) {
-        m_rly->close();
-        m_rly->deleteLater();
+    MBDeviceLogic* logic = MBDeviceLogic::instance();
+    if (logic->isRunning()) {
+        MBDeviceLogic::call(&m_modbus, [this]() {
+            m_modbus.close();
+            foreach (WSModbusRtu* driver, drivers()) {
+                driver->close();
+                driver->deleteLater();
+            }
+        });
         m_rly = nullptr;
-    }
-
-    if (m_adc) {
-        m_adc->close();
-        m_adc->deleteLater();
         m_adc = nullptr;
+        m_chg = nullptr;
+        m_profiles.clear();
+
+        /* value members are destroyed in this thread */
+        logic->release(&m_upgrade);
+        logic->release(&m_discovery);
+        logic->release(&m_gateway);
+        logic->release(&m_modbus);
+        logic->stop();
     }
 
+    /* write open history blocks */
+    MBHistorian::instance()->close();
+
     saveConfig();
 }
 
@@ -246,8 +370,7 @@ inline void MainWindow::loadConfig()
     value = m_config.mbconf.m_baudRate;
     value = m_settings.value("baudRate", value).toUInt(&numOk);
     if (numOk) {
-        m_config.mbconf.m_baudRate = //
-           static_cast<QSerialPort::BaudRate>(value);
+        m_config.mbconf.m_baudRate = static_cast<qint32>(value);
     }
 
     value = m_config.mbconf.m_dataBits;
@@ -289,12 +412,73 @@ inline void MainWindow::loadConfig()
     if (numOk) {
         m_config.adcAddr = value;
     }
+    value = m_config.chgAddr;
+    value = m_settings.value("chgAddr", value).toUInt(&numOk);
+    if (numOk) {
+        m_config.chgAddr = value;
+    }
+    value = m_config.rlyInterval;
+    value = m_settings.value("rlyInterval", value).toUInt(&numOk);
+    if (numOk) {
+        m_config.rlyInterval = value;
+    }
+    value = m_config.adcInterval;
+    value = m_settings.value("adcInterval", value).toUInt(&numOk);
+    if (numOk) {
+        m_config.adcInterval = value;
+    }
+    value = m_config.chgInterval;
+    value = m_settings.value("chgInterval", value).toUInt(&numOk);
+    if (numOk) {
+        m_config.chgInterval = value;
+    }
     value = m_config.selDev;
     value = m_settings.value("selDev", value).toUInt(&numOk);
     if (numOk) {
         m_config.selDev = value;
     }
     m_settings.endGroup();
+
+    m_config.profiles.clear();
+    const int count = m_settings.beginReadArray("profiles");
+    for (int i = 0; i < count; i++) {
+        m_settings.setArrayIndex(i);
+        TProfileDevice device;
+        device.path = m_settings.value("path").toString();
+        device.address = m_settings.value("address", 1).toUInt();
+        device.interval = m_settings.value("interval", 0).toUInt();
+        if (!device.path.isEmpty()) {
+            m_config.profiles.append(device);
+        }
+    }
+    m_settings.endArray();
+
+    m_settings.beginGroup("gateway");
+    m_config.gwEnabled = m_settings.value("enabled", m_config.gwEnabled).toBool();
+    str = m_settings.value("address", m_config.gwconf.m_address.toString()).toString();
+    if (!str.isEmpty()) {
+        m_config.gwconf.m_address = QHostAddress(str);
+    }
+    value = m_config.gwconf.m_port;
+    value = m_settings.value("port", value).toUInt(&numOk);
+    if (numOk) {
+        m_config.gwconf.m_port = value;
+    }
+    value = m_config.gwconf.m_maxAge;
+    value = m_settings.value("maxAge", value).toUInt(&numOk);
+    if (numOk) {
+        m_config.gwconf.m_maxAge = value;
+    }
+    m_config.gwconf.m_readThrough = m_settings.value("readThrough", m_config.gwconf.m_readThrough).toBool();
+    m_settings.endGroup();
+
+    m_settings.beginGroup("historian");
+    m_config.histEnabled = m_settings.value("enabled", m_config.histEnabled).toBool();
+    str = m_settings.value("path", m_config.histPath).toString();
+    if (!str.isEmpty()) {
+        m_config.histPath = str;
+    }
+    m_settings.endGroup();
 }
 
 inline void MainWindow::saveConfig()
@@ -310,20 +494,80 @@ inline void MainWindow::saveConfig()
     m_settings.beginGroup("devices");
     m_settings.setValue("rlyAddr", m_config.rlyAddr);
     m_settings.setValue("adcAddr", m_config.adcAddr);
+    m_settings.setValue("chgAddr", m_config.chgAddr);
+    m_settings.setValue("rlyInterval", m_config.rlyInterval);
+    m_settings.setValue("adcInterval", m_config.adcInterval);
+    m_settings.setValue("chgInterval", m_config.chgInterval);
     m_settings.setValue("selDev", m_config.selDev);
     m_settings.endGroup();
+
+    m_settings.beginWriteArray("profiles", m_config.profiles.count());
+    for (int i = 0; i < m_config.profiles.count(); i++) {
+        m_settings.setArrayIndex(i);
+        m_settings.setValue("path", m_config.profiles[i].path);
+        m_settings.setValue("address", m_config.profiles[i].address);
+        m_settings.setValue("interval", m_config.profiles[i].interval);
+    }
+    m_settings.endArray();
+
+    m_settings.beginGroup("gateway");
+    m_settings.setValue("enabled", m_config.gwEnabled);
+    m_settings.setValue("address", m_config.gwconf.m_address.toString());
+    m_settings.setValue("port", m_config.gwconf.m_port);
+    m_settings.setValue("maxAge", m_config.gwconf.m_maxAge);
+    m_settings.setValue("readThrough", m_config.gwconf.m_readThrough);
+    m_settings.endGroup();
+
+    m_settings.beginGroup("historian");
+    m_settings.setValue("enabled", m_config.histEnabled);
+    m_settings.setValue("path", m_config.histPath);
+    m_settings.endGroup();
     m_settings.sync();
 }
 
 // Relay Driver ---------------------------------------------------
 
+inline QList<WSModbusRtu*> MainWindow::drivers() const
+{
+    QList<WSModbusRtu*> list;
+    foreach (WSModbusRtu* driver, QList<WSModbusRtu*>({m_rly, m_adc, m_chg})) {
+        if (driver) {
+            list.append(driver);
+        }
+    }
+    foreach (WSProfileMbRtu* driver, m_profiles) {
+        list.append(driver);
+    }
+    return list;
+}
+
+inline bool MainWindow::isBusOpen()
+{
+    return MBDeviceLogic::call(&m_modbus, [this]() {
+        return m_modbus.isOpen();
+    });
+}
+
+/* drivers restart with the line */
+inline void MainWindow::reopenAfterScan()
+{
+    if (m_reopenAfterScan) {
+        m_reopenAfterScan = false;
+        MBDeviceLogic::post(&m_modbus, [this]() {
+            m_modbus.open();
+        });
+    }
+}
+
 inline void MainWindow::setRelay(quint8 relay)
 {
     if (m_rly) {
-        /* toggle on / off */
-        bool state = !m_rly->relayStatus(relay);
-        /* update */
-        m_rly->setRelayStatus(relay, state);
+        MBDeviceLogic::post(m_rly, [rly = m_rly, relay]() {
+            /* toggle on / off */
+            bool state = !rly->relayStatus(relay);
+            /* update */
+            rly->setRelayStatus(relay, state);
+        });
     }
 }
 
@@ -334,6 +578,7 @@ void MainWindow::onRelayDriverOpend(quint8)
     ui->pbSetLinkControl->setEnabled(true);
     ui->cbxUpdateDevice->setEnabled(true);
     ui->pnlRelay->setEnabled(true);
+    refreshDeviceKeys();
     on_cbDeviceList_activated(0);
 }
 
@@ -349,38 +594,30 @@ void MainWindow::onRelayDriverClosed(quint8)
 
 void MainWindow::onRelayFunctionDone(quint8, uint function)
 {
-    // qDebug() << "APPWND:onFunctionDone():" << function;
-    if (function == WSModbusRtu::RtuReadVersion)
-        ui->lbFwVersion->setText(tr("FW Version: %1").arg(m_rly->firmwareVersion()));
-    if (function == WSModbusRtu::RtuReadDeviceAddr) {
-        ui->lbDevAddress->setText(tr("Dev.Address: %1").arg(m_rly->deviceAddress()));
-        ui->edDevAddr->setValue(m_rly->deviceAddress());
+    /* queued, the driver may be gone */
+    if (!m_rly) {
+        return;
     }
-}
-
-void MainWindow::onRelayChanged(quint8 relay, bool state)
-{
-    qDebug() << "APPWND:onRelayChanged(): relay:" << relay << state;
 
-    QPushButton* btn;
-    QString key = tr("pbR%1").arg(relay + 1);
-    if ((btn = ui->pnlRelay->findChild<QPushButton*>(key))) {
-        if (state) {
-            btn->setDefault(true);
-        }
-        else {
-            btn->setDefault(false);
-        }
+    // qDebug() << "APPWND:onFunctionDone():" << function;
+    if (function == WSModbusRtu::RtuReadVersion) {
+        const quint16 version = MBDeviceLogic::call(m_rly, [rly = m_rly]() {
+            return rly->firmwareVersion();
+        });
+        ui->lbFwVersion->setText(tr("FW Version: %1").arg(version));
+    }
+    if (function == WSModbusRtu::RtuReadDeviceAddr) {
+        const quint8 address = MBDeviceLogic::call(m_rly, [rly = m_rly]() {
+            return rly->deviceAddress();
+        });
+        ui->lbDevAddress->setText(tr("Dev.Address: %1").arg(address));
+        ui->edDevAddr->setValue(address);
     }
 }
 
 void MainWindow::onRelayModeChanged(quint8 relay, WSRelayDigInMbRtu::TControlMode mode)
 {
-    qDebug() << "APPWND:onRelayModeChanged(): relay:" << relay << mode;
-
-    QPushButton* btn;
-    QString key = tr("pbR%1").arg(relay + 1);
-    if ((btn = ui->pnlRelay->findChild<QPushButton*>(key))) {
+    if (QPushButton* btn = m_relayButtons.value(relay)) {
         btn->setEnabled(mode == WSRelayDigInMbRtu::NormalMode);
         if (mode != WSRelayDigInMbRtu::NormalMode) {
             btn->setStyleSheet(QString());
@@ -388,17 +625,6 @@ void MainWindow::onRelayModeChanged(quint8 relay, WSRelayDigInMbRtu::TControlMod
     }
 }
 
-void MainWindow::onDigInChanged(quint8 channel, bool state)
-{
-    qDebug() << "APPWND:onDigInChanged(): channel:" << channel << state;
-
-    QCheckBox* cbx;
-    QString key = tr("cbxChannel%1").arg(channel + 1);
-    if ((cbx = ui->pnlDigitalIn->findChild<QCheckBox*>(key))) {
-        cbx->setChecked(state);
-    }
-}
-
 // ADC Driver ---------------------------------------------------------------------
 
 void MainWindow::onAdcDriverOpend(quint8)
@@ -407,6 +633,7 @@ void MainWindow::onAdcDriverOpend(quint8)
     ui->pbClosePort->setEnabled(true);
     ui->pbSetChannelType->setEnabled(true);
     ui->cbxUpdateDevice->setEnabled(true);
+    refreshDeviceKeys();
     on_cbDeviceList_activated(1);
 }
 
@@ -421,12 +648,24 @@ void MainWindow::onAdcDriverClosed(quint8)
 
 void MainWindow::onAdcFunctionDone(quint8, uint function)
 {
+    /* queued, the driver may be gone */
+    if (!m_adc) {
+        return;
+    }
+
     // qDebug() << "APPWND:onFunctionDone():" << function;
-    if (function == WSModbusRtu::RtuReadVersion)
-        ui->txAFwVersion->setText(tr("FW Version: %1").arg(m_adc->firmwareVersion()));
+    if (function == WSModbusRtu::RtuReadVersion) {
+        const quint16 version = MBDeviceLogic::call(m_adc, [adc = m_adc]() {
+            return adc->firmwareVersion();
+        });
+        ui->txAFwVersion->setText(tr("FW Version: %1").arg(version));
+    }
     if (function == WSModbusRtu::RtuReadDeviceAddr) {
-        ui->txADeviceAddr->setText(tr("Dev.Address: %1").arg(m_adc->deviceAddress()));
-        ui->edDevAddr->setValue(m_adc->deviceAddress());
+        const quint8 address = MBDeviceLogic::call(m_adc, [adc = m_adc]() {
+            return adc->deviceAddress();
+        });
+        ui->txADeviceAddr->setText(tr("Dev.Address: %1").arg(address));
+        ui->edDevAddr->setValue(address);
     }
 }
 
@@ -435,18 +674,336 @@ void MainWindow::onAInTypeChanged(quint8 channel, WSAnalogInMbRtu::TChannelType
     qDebug() << "APPWND:onAInTypeChanged(): channel:" << channel << type;
 }
 
-void MainWindow::onAInValueChanged(quint8 channel, float value)
+// Charger Driver -----------------------------------------------------------------
+
+void MainWindow::onChargerDriverOpend(quint8)
+{
+    ui->pbOpenPort->setEnabled(false);
+    ui->pbClosePort->setEnabled(true);
+    ui->pbToggleLoad->setEnabled(true);
+    on_cbDeviceList_activated(2);
+}
+
+void MainWindow::onChargerDriverClosed(quint8)
+{
+    ui->pbOpenPort->setEnabled(true);
+    ui->pbClosePort->setEnabled(false);
+    ui->pbToggleLoad->setEnabled(false);
+    on_cbDeviceList_activated(2);
+}
+
+void MainWindow::onChargerFunctionDone(quint8, uint function)
+{
+    if (m_chg && function == WSModbusRtu::RtuReadDeviceAddr) {
+        ui->edDevAddr->setValue(MBDeviceLogic::call(m_chg, [chg = m_chg]() {
+            return chg->deviceAddress();
+        }));
+    }
+}
+
+void MainWindow::onChargerMetricChanged(WSRenogyMpptMbRtu::TMetric metric, double value)
+{
+    QTableWidgetItem* item;
+    if ((item = ui->twChgMetrics->item(metric, 1))) {
+        item->setText(QString::number(value, 'g', 8));
+    }
+}
+
+void MainWindow::onChargerModelChanged(const QString& model)
+{
+    ui->lbChgModel->setText(tr("Model: %1").arg(model));
+}
+
+void MainWindow::on_pbToggleLoad_clicked()
+{
+    if (m_chg) {
+        MBDeviceLogic::post(m_chg, [chg = m_chg]() {
+            chg->setLoadState(chg->metric(WSRenogyMpptMbRtu::LoadState) == 0);
+        });
+    }
+}
+
+void MainWindow::onDiscoveryFinished(const QList<MBDiscovery::TDevice>& devices)
+{
+    ui->pbScanBus->setText(tr("Scan Bus"));
+    reopenAfterScan();
+
+    QStringList lines;
+    foreach (const MBDiscovery::TDevice& device, devices) {
+        const char* model = (device.m_model == MBDiscovery::ModelRelay       ? "Relay"
+                             : device.m_model == MBDiscovery::ModelAnalogIn ? "Analog In"
+                                                                            : "Unknown");
+        lines.append(tr("%1 %2 baud, parity %3: address %4, %5, firmware %6%7")
+                        .arg(device.m_port)
+                        .arg(device.m_baudRate)
+                        .arg(device.m_parity)
+                        .arg(device.m_server)
+                        .arg(model)
+                        .arg(device.m_firmware, 4, 16, QChar('0'))
+                        .arg(device.m_confirmed ? "" : tr(" (unconfirmed)")));
+    }
+    QMessageBox::information(this, tr("Bus Scan"), lines.isEmpty() ? tr("No devices found.") : lines.join('\n'));
+}
+
+void MainWindow::onUpgradeFinished(bool upgraded, qint32 baudRate, const QList<uint>& lost)
+{
+    ui->pbUpgradeSpeed->setEnabled(true);
+
+    m_config.mbconf.m_baudRate = baudRate;
+    saveConfig();
+
+    for (int i = 0; i < ui->cbBaudRate->count(); i++) {
+        if (ui->cbBaudRate->itemData(i).value<qint32>() == baudRate) {
+            ui->cbBaudRate->setCurrentIndex(i);
+        }
+    }
+
+    QStringList servers;
+    foreach (uint server, lost) {
+        servers.append(QString::number(server));
+    }
+    QMessageBox::information(
+       this,
+       tr("Speed Upgrade"),
+       !lost.isEmpty() ? tr("Line at %1 baud, devices not answering: %2").arg(baudRate).arg(servers.join(", "))
+       : upgraded      ? tr("Line upgraded to %1 baud.").arg(baudRate)
+                       : tr("Line stays at %1 baud.").arg(baudRate));
+}
+
+// Config Reload -----------------------------------------------------------------
+
+void MainWindow::onConfigFileChanged(const QString&)
+{
+    /* editors write in several steps */
+    m_reloadTimer.start();
+}
+
+void MainWindow::onConfigReload()
+{
+    const QString file = m_settings.fileName();
+    if (!m_configWatcher.files().contains(file) && QFileInfo::exists(file)) {
+        m_configWatcher.addPath(file);
+    }
+
+    const TConfig prev = m_config;
+    m_settings.sync();
+    loadConfig();
+    applyConfig(prev);
+}
+
+/* only what differs, unaffected devices keep polling */
+inline void MainWindow::applyConfig(const TConfig& prev)
 {
-    qDebug() << "APPWND:onAInValueChanged(): channel:" << channel << value;
-    QLCDNumber* lcd;
-    QString key = tr("lcdChannel%1").arg(channel + 1);
-    if ((lcd = ui->pnlAnalogIn->findChild<QLCDNumber*>(key))) {
-        lcd->display(value);
+    const MBRtuClient::TConfig& line = m_config.mbconf;
+    bool changed = false;
+
+    if (line.m_portName != prev.mbconf.m_portName) {
+        qInfo() << "APPWND: Port" << line.m_portName << "applies on next open";
+        MBDeviceLogic::post(&m_modbus, [this, name = line.m_portName]() {
+            m_modbus.setPortName(name);
+        });
+        changed = true;
+    }
+    if (line.m_baudRate != prev.mbconf.m_baudRate || //
+        line.m_parity != prev.mbconf.m_parity ||     //
+        line.m_dataBits != prev.mbconf.m_dataBits || //
+        line.m_stopBits != prev.mbconf.m_stopBits) {
+        /* open port is retuned in place */
+        MBDeviceLogic::post(&m_modbus, [this, line]() {
+            m_modbus.retuneLine(line);
+        });
+        changed = true;
+    }
+
+    if (m_rly && (m_config.rlyAddr != prev.rlyAddr || m_config.rlyInterval != prev.rlyInterval)) {
+        retuneDevice(m_rly, m_config.rlyAddr, m_config.rlyInterval);
+        changed = true;
+    }
+    if (m_adc && (m_config.adcAddr != prev.adcAddr || m_config.adcInterval != prev.adcInterval)) {
+        retuneDevice(m_adc, m_config.adcAddr, m_config.adcInterval);
+        changed = true;
+    }
+    if (m_chg && (m_config.chgAddr != prev.chgAddr || m_config.chgInterval != prev.chgInterval)) {
+        retuneDevice(m_chg, m_config.chgAddr, m_config.chgInterval);
+        changed = true;
+    }
+
+    applyProfiles(prev.profiles);
+
+    /* own writes reload without a difference */
+    if (changed) {
+        qInfo() << "APPWND: Config reloaded";
+        for (int i = 0; i < ui->cbBaudRate->count(); i++) {
+            if (ui->cbBaudRate->itemData(i).value<qint32>() == line.m_baudRate) {
+                ui->cbBaudRate->setCurrentIndex(i);
+            }
+        }
+        on_cbDeviceList_activated(ui->cbDeviceList->currentIndex());
+    }
+}
+
+/* profile devices by path and address, others stay untouched */
+inline void MainWindow::applyProfiles(const QList<TProfileDevice>& prev)
+{
+    QMap<QString, TProfileDevice> before;
+    foreach (const TProfileDevice& device, prev) {
+        before.insert(profileKey(device), device);
+    }
+    QMap<QString, TProfileDevice> after;
+    foreach (const TProfileDevice& device, m_config.profiles) {
+        after.insert(profileKey(device), device);
+    }
+
+    foreach (const QString& key, m_profiles.keys()) {
+        if (!after.contains(key)) {
+            qInfo() << "APPWND: Remove profile device" << key;
+            WSProfileMbRtu* driver = m_profiles.take(key);
+            /* destructor stops the device task, the shared line stays open */
+            MBDeviceLogic::post(driver, [driver]() {
+                driver->deleteLater();
+            });
+        }
+    }
+
+    bool isOpen = false;
+    if (m_profiles.count() < after.count()) {
+        isOpen = isBusOpen();
+    }
+
+    for (auto it = after.constBegin(); it != after.constEnd(); it++) {
+        WSProfileMbRtu* driver = m_profiles.value(it.key());
+        if (!driver) {
+            if (!(driver = createProfile(it.value()))) {
+                continue;
+            }
+            qInfo() << "APPWND: Add profile device" << it.key();
+            m_profiles.insert(it.key(), driver);
+            if (isOpen) {
+                MBDeviceLogic::post(driver, [driver]() {
+                    driver->open();
+                });
+            }
+            continue;
+        }
+        if (it.value().interval && it.value().interval != before.value(it.key()).interval) {
+            retuneDevice(driver, it.value().address, it.value().interval);
+        }
+    }
+}
+
+inline void MainWindow::retuneDevice(WSModbusRtu* driver, quint8 address, uint interval)
+{
+    /* next poll cycle uses the new values */
+    MBDeviceLogic::post(driver, [driver, address, interval]() {
+        driver->setDeviceAddress(address, false);
+        if (interval) {
+            driver->setQueryInterval(interval);
+        }
+    });
+}
+
+inline WSProfileMbRtu* MainWindow::createProfile(const TProfileDevice& device)
+{
+    MBDeviceProfile profile;
+    if (!profile.load(device.path)) {
+        return nullptr;
+    }
+
+    WSProfileMbRtu* driver = new WSProfileMbRtu(profile, &m_modbus);
+    driver->setDeviceAddress(device.address, false);
+    if (device.interval) {
+        driver->setQueryInterval(device.interval);
+    }
+    MBDeviceLogic::instance()->adopt(driver);
+    return driver;
+}
+
+inline QString MainWindow::profileKey(const TProfileDevice& device)
+{
+    return QStringLiteral("%1@%2").arg(device.path).arg(device.address);
+}
+
+// State Frame -------------------------------------------------------------------
+
+inline void MainWindow::refreshDeviceKeys()
+{
+    m_rlyKey = deviceKey(m_rly);
+    m_adcKey = deviceKey(m_adc);
+}
+
+inline MainWindow::TDeviceKey MainWindow::deviceKey(WSModbusRtu* driver)
+{
+    if (!driver) {
+        return TDeviceKey();
+    }
+    return MBDeviceLogic::call(driver, [driver]() {
+        return TDeviceKey(driver->portName(), driver->deviceAddress());
+    });
+}
+
+/* one repaint per frame, whatever the poll rate */
+void MainWindow::onStateFrame(const QVector<int>& changed)
+{
+    /* driver identity cached on the UI side */
+    const TDeviceKey& rly = m_rlyKey;
+    const TDeviceKey& adc = m_adcKey;
+
+    foreach (const MBStateStore::TChannel& c, MBStateStore::instance()->channels(changed)) {
+        if (m_rly && c.m_port == rly.first && c.m_server == rly.second) {
+            if (c.m_table == MBStateStore::Coils) {
+                if (QPushButton* btn = m_relayButtons.value(c.m_index)) {
+                    btn->setDefault(c.m_value != 0);
+                }
+            }
+            else if (c.m_table == MBStateStore::DiscreteInputs) {
+                if (QCheckBox* cbx = m_inputBoxes.value(c.m_index)) {
+                    cbx->setChecked(c.m_value != 0);
+                }
+            }
+        }
+        if (m_adc && c.m_port == adc.first && c.m_server == adc.second) {
+            if (c.m_table == MBStateStore::Analog) {
+                if (QLCDNumber* lcd = m_analogDisplays.value(c.m_index)) {
+                    lcd->display(c.m_value);
+                }
+            }
+        }
     }
 }
 
 // UI ----------------------------------------------------------------------------
 
+void MainWindow::on_edDashFilter_textChanged(const QString& text)
+{
+    m_dashFilter.setFilterFixedString(text);
+}
+
+void MainWindow::on_toolBox_currentChanged(int index)
+{
+    if (ui->toolBox->widget(index) != ui->pgHistory) {
+        return;
+    }
+
+    /* series appear while recording */
+    QStringList names = MBHistorian::instance()->seriesNames().values();
+    names.sort();
+
+    const QString current = ui->cbHistSeries->currentText();
+    ui->cbHistSeries->clear();
+    ui->cbHistSeries->addItems(names);
+    ui->cbHistSeries->setCurrentText(current);
+    ui->pbHistQuery->setEnabled(!names.isEmpty());
+}
+
+void MainWindow::on_pbHistQuery_clicked()
+{
+    const qint64 range = ui->cbHistRange->currentData().toLongLong();
+    const qint64 to = QDateTime::currentMSecsSinceEpoch();
+
+    /* about 200 buckets, one second at least */
+    m_history.query(ui->cbHistSeries->currentText(), to - range, to, qMax<qint64>(1000, range / 200));
+}
+
 void MainWindow::on_pbEnableDevice_clicked()
 {
     QVariant vd = ui->cbDeviceList->currentData();
@@ -457,26 +1014,35 @@ void MainWindow::on_pbEnableDevice_clicked()
         /* Relay driver */
         case 1: {
             if (m_rly) {
-                m_rly->close();
-                m_rly->deleteLater();
+                MBDeviceLogic::post(m_rly, [rly = m_rly]() {
+                    rly->close();
+                    rly->deleteLater();
+                });
                 m_rly = nullptr;
                 on_cbDeviceList_activated(ui->cbDeviceList->currentIndex());
                 return;
             }
-            m_rly = new WSRelayDigInMbRtu(&m_modbus, this);
+            m_rly = new WSRelayDigInMbRtu(&m_modbus);
             m_rly->setDeviceAddress(m_config.rlyAddr, false);
+            if (m_config.rlyInterval) {
+                m_rly->setQueryInterval(m_config.rlyInterval);
+            }
+            MBDeviceLogic::instance()->adopt(m_rly);
             connect(m_rly, &WSRelayDigInMbRtu::opened, this, &MainWindow::onRelayDriverOpend);
             connect(m_rly, &WSRelayDigInMbRtu::closed, this, &MainWindow::onRelayDriverClosed);
             connect(m_rly, &WSRelayDigInMbRtu::complete, this, &MainWindow::onRelayFunctionDone);
-            connect(m_rly, &WSRelayDigInMbRtu::relayChanged, this, &MainWindow::onRelayChanged);
             connect(m_rly, &WSRelayDigInMbRtu::modeChanged, this, &MainWindow::onRelayModeChanged);
-            connect(m_rly, &WSRelayDigInMbRtu::inputChanged, this, &MainWindow::onDigInChanged);
-            onRelayFunctionDone(m_rly->deviceAddress(), WSRelayDigInMbRtu::RtuReadDeviceAddr);
-            onRelayFunctionDone(m_rly->deviceAddress(), WSRelayDigInMbRtu::RtuReadVersion);
+            connect(m_rly, &WSRelayDigInMbRtu::addressChanged, this, &MainWindow::refreshDeviceKeys);
+            refreshDeviceKeys();
+            onRelayFunctionDone(m_config.rlyAddr, WSRelayDigInMbRtu::RtuReadDeviceAddr);
+            onRelayFunctionDone(m_config.rlyAddr, WSRelayDigInMbRtu::RtuReadVersion);
             on_cbDeviceList_activated(ui->cbDeviceList->currentIndex());
-            ui->pbOpenPort->setEnabled(!m_modbus.isOpen());
-            if (m_modbus.isOpen()) {
-                m_rly->open();
+            const bool isOpen = isBusOpen();
+            ui->pbOpenPort->setEnabled(!isOpen);
+            if (isOpen) {
+                MBDeviceLogic::post(m_rly, [rly = m_rly]() {
+                    rly->open();
+                });
             }
             else {
                 on_pbSetBaudRate_clicked();
@@ -485,26 +1051,36 @@ void MainWindow::on_pbEnableDevice_clicked()
         }
         case 2: {
             if (m_adc) {
-                m_adc->close();
-                m_adc->deleteLater();
+                MBDeviceLogic::post(m_adc, [adc = m_adc]() {
+                    adc->close();
+                    adc->deleteLater();
+                });
                 m_adc = nullptr;
                 on_cbDeviceList_activated(ui->cbDeviceList->currentIndex());
                 return;
             }
             /* AnalogIn driver */
-            m_adc = new WSAnalogInMbRtu(&m_modbus, this);
+            m_adc = new WSAnalogInMbRtu(&m_modbus);
             m_adc->setDeviceAddress(m_config.adcAddr, false);
+            if (m_config.adcInterval) {
+                m_adc->setQueryInterval(m_config.adcInterval);
+            }
+            MBDeviceLogic::instance()->adopt(m_adc);
             connect(m_adc, &WSAnalogInMbRtu::opened, this, &MainWindow::onAdcDriverOpend);
             connect(m_adc, &WSAnalogInMbRtu::closed, this, &MainWindow::onAdcDriverClosed);
             connect(m_adc, &WSAnalogInMbRtu::complete, this, &MainWindow::onAdcFunctionDone);
-            connect(m_adc, &WSAnalogInMbRtu::valueChanged, this, &MainWindow::onAInValueChanged);
             connect(m_adc, &WSAnalogInMbRtu::channelChanged, this, &MainWindow::onAInTypeChanged);
-            onAdcFunctionDone(m_adc->deviceAddress(), WSRelayDigInMbRtu::RtuReadDeviceAddr);
-            onAdcFunctionDone(m_adc->deviceAddress(), WSRelayDigInMbRtu::RtuReadVersion);
+            connect(m_adc, &WSAnalogInMbRtu::addressChanged, this, &MainWindow::refreshDeviceKeys);
+            refreshDeviceKeys();
+            onAdcFunctionDone(m_config.adcAddr, WSRelayDigInMbRtu::RtuReadDeviceAddr);
+            onAdcFunctionDone(m_config.adcAddr, WSRelayDigInMbRtu::RtuReadVersion);
             on_cbDeviceList_activated(ui->cbDeviceList->currentIndex());
-            ui->pbOpenPort->setEnabled(!m_modbus.isOpen());
-            if (m_modbus.isOpen()) {
-                m_adc->open();
+            const bool isOpen = isBusOpen();
+            ui->pbOpenPort->setEnabled(!isOpen);
+            if (isOpen) {
+                MBDeviceLogic::post(m_adc, [adc = m_adc]() {
+                    adc->open();
+                });
             }
             else {
                 on_pbSetBaudRate_clicked();
@@ -512,7 +1088,38 @@ void MainWindow::on_pbEnableDevice_clicked()
             break;
         }
         case 3: {
+            if (m_chg) {
+                MBDeviceLogic::post(m_chg, [chg = m_chg]() {
+                    chg->close();
+                    chg->deleteLater();
+                });
+                m_chg = nullptr;
+                on_cbDeviceList_activated(ui->cbDeviceList->currentIndex());
+                return;
+            }
+            /* Renogy MPPT driver */
+            m_chg = new WSRenogyMpptMbRtu(&m_modbus);
+            m_chg->setDeviceAddress(m_config.chgAddr, false);
+            if (m_config.chgInterval) {
+                m_chg->setQueryInterval(m_config.chgInterval);
+            }
+            MBDeviceLogic::instance()->adopt(m_chg);
+            connect(m_chg, &WSRenogyMpptMbRtu::opened, this, &MainWindow::onChargerDriverOpend);
+            connect(m_chg, &WSRenogyMpptMbRtu::closed, this, &MainWindow::onChargerDriverClosed);
+            connect(m_chg, &WSRenogyMpptMbRtu::complete, this, &MainWindow::onChargerFunctionDone);
+            connect(m_chg, &WSRenogyMpptMbRtu::metricChanged, this, &MainWindow::onChargerMetricChanged);
+            connect(m_chg, &WSRenogyMpptMbRtu::modelChanged, this, &MainWindow::onChargerModelChanged);
             on_cbDeviceList_activated(ui->cbDeviceList->currentIndex());
+            const bool isOpen = isBusOpen();
+            ui->pbOpenPort->setEnabled(!isOpen);
+            if (isOpen) {
+                MBDeviceLogic::post(m_chg, [chg = m_chg]() {
+                    chg->open();
+                });
+            }
+            else {
+                on_pbSetBaudRate_clicked();
+            }
             break;
         }
     }
@@ -535,35 +1142,40 @@ void MainWindow::on_cbDeviceList_activated(int index)
             ui->pgRelayAndDigIn->setEnabled(m_rly != nullptr);
             ui->gbxDevUpdate->setEnabled(m_rly != nullptr);
             if (m_rly) {
-                ui->cbxUpdateDevice->setEnabled( //
-                   m_rly != nullptr && m_rly->isValidModbus());
-                onRelayFunctionDone(m_rly->deviceAddress(), WSRelayDigInMbRtu::RtuReadDeviceAddr);
-                onRelayFunctionDone(m_rly->deviceAddress(), WSRelayDigInMbRtu::RtuReadVersion);
+                ui->cbxUpdateDevice->setEnabled(MBDeviceLogic::call(m_rly, [rly = m_rly]() {
+                    return rly->isValidModbus();
+                }));
+                onRelayFunctionDone(m_config.rlyAddr, WSRelayDigInMbRtu::RtuReadDeviceAddr);
+                onRelayFunctionDone(m_config.rlyAddr, WSRelayDigInMbRtu::RtuReadVersion);
             }
             break;
         }
         case 2: {
             pfx = (m_adc ? "Disable" : "Enable");
-            ui->pbOpenPort->setEnabled(!m_modbus.isOpen());
             ui->pgAnalogInRtu->setEnabled(m_adc != nullptr);
             ui->gbxDevUpdate->setEnabled(m_adc != nullptr);
             if (m_adc) {
-                ui->cbxUpdateDevice->setEnabled( //
-                   m_adc != nullptr && m_adc->isValidModbus());
-                onAdcFunctionDone(m_adc->deviceAddress(), WSRelayDigInMbRtu::RtuReadDeviceAddr);
-                onAdcFunctionDone(m_adc->deviceAddress(), WSRelayDigInMbRtu::RtuReadVersion);
+                ui->cbxUpdateDevice->setEnabled(MBDeviceLogic::call(m_adc, [adc = m_adc]() {
+                    return adc->isValidModbus();
+                }));
+                onAdcFunctionDone(m_config.adcAddr, WSRelayDigInMbRtu::RtuReadDeviceAddr);
+                onAdcFunctionDone(m_config.adcAddr, WSRelayDigInMbRtu::RtuReadVersion);
             }
             break;
         }
         case 3: {
             pfx = (m_chg ? "Disable" : "Enable");
             ui->pgRenogyRtu->setEnabled(m_chg != nullptr);
+            /* no Waveshare command registers to update */
             ui->gbxDevUpdate->setEnabled(m_chg != nullptr);
-            ui->cbxUpdateDevice->setEnabled(m_chg != nullptr);
+            ui->cbxUpdateDevice->setEnabled(false);
+            if (m_chg) {
+                onChargerFunctionDone(m_config.chgAddr, WSModbusRtu::RtuReadDeviceAddr);
+            }
             break;
         }
     }
-    ui->pbOpenPort->setEnabled(!m_modbus.isOpen() && (m_rly || m_adc || m_chg));
+    ui->pbOpenPort->setEnabled((m_rly || m_adc || m_chg) && !isBusOpen());
     ui->pbEnableDevice->setText(pfx + " Device");
 }
 
@@ -584,20 +1196,28 @@ void MainWindow::on_pbSetDevAddr_clicked()
         case 1: {
             m_config.rlyAddr = m_devAddress;
             if (m_rly) {
-                m_rly->setDeviceAddress(m_config.rlyAddr, update);
+                MBDeviceLogic::post(m_rly, [rly = m_rly, address = m_config.rlyAddr, update]() {
+                    rly->setDeviceAddress(address, update);
+                });
             }
             break;
         }
         case 2: {
             m_config.adcAddr = m_devAddress;
             if (m_adc) {
-                m_adc->setDeviceAddress(m_config.adcAddr, update);
+                MBDeviceLogic::post(m_adc, [adc = m_adc, address = m_config.adcAddr, update]() {
+                    adc->setDeviceAddress(address, update);
+                });
             }
             break;
         }
         case 3: {
-            // if (m_chg && (update = ui->cbxUpdateDevice->isChecked())) {
-            // }
+            m_config.chgAddr = m_devAddress;
+            if (m_chg) {
+                MBDeviceLogic::post(m_chg, [chg = m_chg, address = m_config.chgAddr]() {
+                    chg->setDeviceAddress(address, false);
+                });
+            }
             break;
         }
     }
@@ -638,30 +1258,38 @@ void MainWindow::on_pbSetBaudRate_clicked()
     }
 
     m_config.mbconf.m_portName = vcp.value<QSerialPortInfo>().portName();
-    m_config.mbconf.m_baudRate = vb.value<QSerialPort::BaudRate>();
+    m_config.mbconf.m_baudRate = vb.value<qint32>();
     m_config.mbconf.m_dataBits = vdb.value<QSerialPort::DataBits>();
     m_config.mbconf.m_stopBits = vsb.value<QSerialPort::StopBits>();
     m_config.mbconf.m_parity = vp.value<QSerialPort::Parity>();
     saveConfig();
 
-    m_modbus.setPortName(m_config.mbconf.m_portName);
-    m_modbus.setDataBits(m_config.mbconf.m_dataBits);
-    m_modbus.setStopBits(m_config.mbconf.m_stopBits);
-    m_modbus.setBaudRate(m_config.mbconf.m_baudRate);
-    m_modbus.setParity(m_config.mbconf.m_parity);
+    MBDeviceLogic::post(&m_modbus, [this, config = m_config.mbconf, update]() {
+        m_modbus.setPortName(config.m_portName);
+        m_modbus.setDataBits(config.m_dataBits);
+        m_modbus.setStopBits(config.m_stopBits);
+
+        /* the line follows the device after its reply */
+        if (!update) {
+            m_modbus.setBaudRate(config.m_baudRate);
+            m_modbus.setParity(config.m_parity);
+        }
+    });
 
     switch (vd.value<int>()) {
         case 1: {
             if (m_rly && update) {
-                m_rly->setBaudRate(m_config.mbconf.m_baudRate, update);
-                m_rly->setParity(m_config.mbconf.m_parity, update);
+                MBDeviceLogic::post(m_rly, [rly = m_rly, config = m_config.mbconf]() {
+                    rly->setUartParams(config.m_baudRate, config.m_parity);
+                });
             }
             break;
         }
         case 2: {
             if (m_adc && update) {
-                m_adc->setBaudRate(m_config.mbconf.m_baudRate, update);
-                m_adc->setParity(m_config.mbconf.m_parity, update);
+                MBDeviceLogic::post(m_adc, [adc = m_adc, config = m_config.mbconf]() {
+                    adc->setUartParams(config.m_baudRate, config.m_parity);
+                });
             }
             break;
         }
@@ -735,19 +1363,21 @@ void MainWindow::on_pbSetLinkControl_clicked()
 
 void MainWindow::on_pbToggleRelays_clicked()
 {
-    quint8 mask = 0xff;
     if (m_rly) {
-        // TEST: invert current relay state
-        for (quint8 b = 0; b < 8; b++) {
-            if (m_rly->relayStatus(b)) {
-                mask &= ~(1 << b);
-            }
-            else {
-                mask |= (1 << b);
+        MBDeviceLogic::post(m_rly, [rly = m_rly]() {
+            quint8 mask = 0xff;
+            // TEST: invert current relay state
+            for (quint8 b = 0; b < 8; b++) {
+                if (rly->relayStatus(b)) {
+                    mask &= ~(1 << b);
+                }
+                else {
+                    mask |= (1 << b);
+                }
             }
-        }
 
-        m_rly->setAllRelays(mask);
+            rly->setAllRelays(mask);
+        });
     }
 }
 
@@ -767,28 +1397,91 @@ void MainWindow::on_pbSetChannelType_clicked()
 
 void MainWindow::on_pbOpenPort_clicked()
 {
-    if (m_rly) {
-        if (!m_rly->isValidModbus()) {
-            m_rly->open();
-        }
-    }
-    if (m_adc) {
-        if (!m_adc->isValidModbus()) {
-            m_adc->open();
-        }
+    foreach (WSModbusRtu* driver, drivers()) {
+        MBDeviceLogic::post(driver, [driver]() {
+            if (!driver->isValidModbus()) {
+                driver->open();
+            }
+        });
     }
 }
 
 void MainWindow::on_pbClosePort_clicked()
 {
-    if (m_rly) {
-        if (m_rly->isValidModbus()) {
-            m_rly->close();
+    foreach (WSModbusRtu* driver, drivers()) {
+        MBDeviceLogic::post(driver, [driver]() {
+            if (driver->isValidModbus()) {
+                driver->close();
+            }
+        });
+    }
+}
+
+void MainWindow::on_pbUpgradeSpeed_clicked()
+{
+    /* only Waveshare boards take the rate from register 0x2000 */
+    if (m_chg || !m_profiles.isEmpty()) {
+        qWarning() << "APPWND: Speed upgrade refused, other devices on the line.";
+        QMessageBox::information(
+           this,
+           tr("Speed Upgrade"),
+           tr("The charger and profile devices can't follow a new line rate. Disable them first."));
+        return;
+    }
+
+    const bool started = MBDeviceLogic::call(&m_upgrade, [this]() {
+        QList<uint> servers;
+        if (m_rly) {
+            servers.append(m_rly->deviceAddress());
+        }
+        if (m_adc && !servers.contains(m_adc->deviceAddress())) {
+            servers.append(m_adc->deviceAddress());
         }
+        return m_upgrade.start(servers);
+    });
+
+    if (started) {
+        ui->pbUpgradeSpeed->setEnabled(false);
     }
-    if (m_adc) {
-        if (m_adc->isValidModbus()) {
-            m_adc->close();
+}
+
+void MainWindow::on_pbScanBus_clicked()
+{
+    const bool running = MBDeviceLogic::call(&m_discovery, [this]() {
+        if (m_discovery.isRunning()) {
+            m_discovery.cancel();
+            return true;
         }
+        return false;
+    });
+    if (running) {
+        return;
     }
+
+    /* configured RS485 line only, no probes to other ttys */
+    const QStringList ports = {m_config.mbconf.m_portName};
+    MBDeviceLogic::post(&m_discovery, [this, ports]() {
+        MBDiscovery::TConfig config = m_discovery.config();
+        config.m_ports = ports;
+        m_discovery.setConfig(config);
+    });
+
+    /* scanner needs the port exclusively */
+    m_reopenAfterScan = isBusOpen();
+    QFutureWatcher<bool>* watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcher<bool>::finished, this, [this, watcher]() {
+        watcher->deleteLater();
+        const bool started = MBDeviceLogic::call(&m_discovery, [this]() {
+            return m_discovery.start();
+        });
+        if (started) {
+            ui->pbScanBus->setText(tr("Cancel Scan"));
+        }
+        else {
+            reopenAfterScan();
+        }
+    });
+    watcher->setFuture(MBDeviceLogic::call(&m_modbus, [this]() {
+        return m_modbus.close();
+    }));
 }
@@ -5,11 +5,28 @@
  * SPDX-License-Identifier: GPL v3
  **********************************************************************/
 #pragma once
+#include <QCheckBox>
+#include <QFileSystemWatcher>
+#include <QLCDNumber>
+#include <QList>
 #include <QMainWindow>
+#include <QMap>
+#include <QPair>
+#include <QPushButton>
 #include <QSettings>
+#include <QSortFilterProxyModel>
+#include <QTimer>
+#include <QVector>
+#include <mbdashboardmodel.h>
+#include <mbdiscovery.h>
+#include <mbhistorymodel.h>
 #include <mbrtuclient.h>
+#include <mbspeedupgrade.h>
+#include <mbtcpgateway.h>
 #include <wsanaloginmbrtu.h>
+#include <wsprofilembrtu.h>
 #include <wsrelaydiginmbrtu.h>
+#include <wsrenogympptmbrtu.h>
 
 namespace Ui {
 class MainWindow;
@@ -47,15 +64,26 @@ private slots:
     void onRelayDriverOpend(quint8 address);
     void onRelayDriverClosed(quint8 address);
     void onRelayFunctionDone(quint8 address, uint function);
-    void onRelayChanged(quint8 relay, bool state);
     void onRelayModeChanged(quint8 relay, WSRelayDigInMbRtu::TControlMode mode);
-    void onDigInChanged(quint8 channel, bool state);
     /* -- */
     void onAdcDriverOpend(quint8 address);
     void onAdcDriverClosed(quint8 address);
     void onAdcFunctionDone(quint8 address, uint function);
     void onAInTypeChanged(quint8 channel, WSAnalogInMbRtu::TChannelType type);
-    void onAInValueChanged(quint8 channel, float value);
+    /* -- */
+    void onChargerDriverOpend(quint8 address);
+    void onChargerDriverClosed(quint8 address);
+    void onChargerFunctionDone(quint8 address, uint function);
+    void onChargerMetricChanged(WSRenogyMpptMbRtu::TMetric metric, double value);
+    void onChargerModelChanged(const QString& model);
+    void on_pbToggleLoad_clicked();
+    /* -- */
+    void onStateFrame(const QVector<int>& changed);
+    /* -- */
+    void onConfigFileChanged(const QString& path);
+    void onConfigReload();
+    void onDiscoveryFinished(const QList<MBDiscovery::TDevice>& devices);
+    void onUpgradeFinished(bool upgraded, qint32 baudRate, const QList<uint>& lost);
 
 private slots:
     void on_edDevAddr_valueChanged(int arg1);
@@ -77,25 +105,80 @@ private slots:
     void on_cbDeviceList_activated(int index);
     void on_pbOpenPort_clicked();
     void on_pbClosePort_clicked();
+    void on_pbScanBus_clicked();
+    void on_pbUpgradeSpeed_clicked();
+    void on_edDashFilter_textChanged(const QString& text);
+    void on_toolBox_currentChanged(int index);
+    void on_pbHistQuery_clicked();
 
 private:
+    typedef struct {
+        /* file or resource path of the JSON profile */
+        QString path;
+        quint8 address;
+        /* poll interval in ms, 0 profile default */
+        uint interval;
+    } TProfileDevice;
+
     typedef struct {
         MBRtuClient::TConfig mbconf;
         quint8 rlyAddr;
         quint8 adcAddr;
+        quint8 chgAddr;
+        /* poll intervals in ms, 0 keeps the driver interval */
+        uint rlyInterval;
+        uint adcInterval;
+        uint chgInterval;
+        QList<TProfileDevice> profiles;
         quint8 selDev;
+        bool gwEnabled;
+        MBTcpGateway::TConfig gwconf;
+        bool histEnabled;
+        QString histPath;
     } TConfig;
 
     Ui::MainWindow* ui;
     QSettings m_settings;
     TConfig m_config;
     MBRtuClient m_modbus;
+    MBTcpGateway m_gateway;
+    MBDiscovery m_discovery;
+    MBSpeedUpgrade m_upgrade;
+    MBDashboardModel m_dashboard;
+    QSortFilterProxyModel m_dashFilter;
+    MBHistoryModel m_history;
     WSRelayDigInMbRtu* m_rly;
     WSAnalogInMbRtu* m_adc;
-    QObject* m_chg;
+    WSRenogyMpptMbRtu* m_chg;
+    /* profile drivers by path@address */
+    QMap<QString, WSProfileMbRtu*> m_profiles;
+    QFileSystemWatcher m_configWatcher;
+    QTimer m_reloadTimer;
     quint16 m_devAddress;
+    /* channel widgets, resolved once */
+    QVector<QPushButton*> m_relayButtons;
+    QVector<QCheckBox*> m_inputBoxes;
+    QVector<QLCDNumber*> m_analogDisplays;
+
+    /* port and address of a driver */
+    typedef QPair<QString, quint8> TDeviceKey;
+    /* state frame filter, no logic thread call per frame */
+    TDeviceKey m_rlyKey;
+    TDeviceKey m_adcKey;
+    /* bus was open when the scan took the port */
+    bool m_reopenAfterScan;
 
+    inline bool isBusOpen();
+    inline void reopenAfterScan();
+    inline TDeviceKey deviceKey(WSModbusRtu* driver);
+    inline void refreshDeviceKeys();
+    inline QList<WSModbusRtu*> drivers() const;
     inline void setRelay(quint8 relay);
+    inline void applyConfig(const TConfig& prev);
+    inline void applyProfiles(const QList<TProfileDevice>& prev);
+    inline void retuneDevice(WSModbusRtu* driver, quint8 address, uint interval);
+    inline WSProfileMbRtu* createProfile(const TProfileDevice& device);
+    static inline QString profileKey(const TProfileDevice& device);
     inline void loadConfig();
     inline void saveConfig();
 };
@@ -0,0 +1,154 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#include <QMetaEnum>
+#include <algorithm>
+#include <mbdashboardmodel.h>
+
+MBDashboardModel::MBDashboardModel(MBStateStore* store, QObject* parent)
+    : QAbstractTableModel {parent}
+    , m_store(store)
+    , m_rows()
+    , m_tables()
+{
+    Q_ASSERT_X(m_store != 0L, Q_FUNC_INFO, "Null pointer state store object!");
+
+    const QMetaEnum tables = QMetaEnum::fromType<MBStateStore::TTable>();
+    for (int i = 0; i <= MBStateStore::Analog; i++) {
+        m_tables[i] = tables.valueToKey(i);
+    }
+
+    /* channels known before the model */
+    const int count = m_store->count();
+    m_rows.reserve(count);
+    for (int i = 0; i < count; i++) {
+        m_rows.append(m_store->at(i));
+    }
+
+    connect(m_store, &MBStateStore::channelsAdded, this, &MBDashboardModel::onChannelsAdded);
+    connect(m_store, &MBStateStore::frame, this, &MBDashboardModel::onFrame);
+}
+
+/* -------------------------------------------------------
+ * Api Methods
+ * ------------------------------------------------------- */
+
+int MBDashboardModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : m_rows.count();
+}
+
+int MBDashboardModel::columnCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : ColumnValue + 1;
+}
+
+QVariant MBDashboardModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_rows.count()) {
+        return QVariant();
+    }
+
+    const MBStateStore::TChannel& c = m_rows[index.row()];
+    if (role == Qt::TextAlignmentRole) {
+        return (index.column() == ColumnPort || index.column() == ColumnTable //
+                   ? QVariant(Qt::AlignLeft | Qt::AlignVCenter)
+                   : QVariant(Qt::AlignRight | Qt::AlignVCenter));
+    }
+    if (role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    switch (index.column()) {
+        case ColumnPort: {
+            return c.m_port;
+        }
+        case ColumnServer: {
+            return c.m_server;
+        }
+        case ColumnTable: {
+            return m_tables[c.m_table];
+        }
+        case ColumnIndex: {
+            return c.m_index;
+        }
+        case ColumnValue: {
+            return c.m_value;
+        }
+    }
+    return QVariant();
+}
+
+QVariant MBDashboardModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+
+    switch (section) {
+        case ColumnPort: {
+            return tr("Port");
+        }
+        case ColumnServer: {
+            return tr("Server");
+        }
+        case ColumnTable: {
+            return tr("Table");
+        }
+        case ColumnIndex: {
+            return tr("Index");
+        }
+        case ColumnValue: {
+            return tr("Value");
+        }
+    }
+    return QVariant();
+}
+
+/* -------------------------------------------------------
+ * Event Methods
+ * ------------------------------------------------------- */
+
+void MBDashboardModel::onChannelsAdded(int, int last)
+{
+    /* rows may already be in the initial snapshot */
+    const int first = m_rows.count();
+    if (last < first) {
+        return;
+    }
+
+    beginInsertRows(QModelIndex(), first, last);
+    for (int i = first; i <= last; i++) {
+        m_rows.append(m_store->at(i));
+    }
+    endInsertRows();
+}
+
+void MBDashboardModel::onFrame(const QVector<int>& changed)
+{
+    QVector<int> rows = changed;
+    std::sort(rows.begin(), rows.end());
+    while (!rows.isEmpty() && rows.last() >= m_rows.count()) {
+        rows.removeLast();
+    }
+    if (rows.isEmpty()) {
+        return;
+    }
+
+    const QVector<MBStateStore::TChannel> channels = m_store->channels(rows);
+
+    /* one dataChanged per contiguous run of rows */
+    int first = rows[0];
+    for (int i = 0; i < rows.count(); i++) {
+        m_rows[rows[i]] = channels[i];
+        if (i + 1 == rows.count() || rows[i + 1] != rows[i] + 1) {
+            emit dataChanged(index(first, ColumnValue), index(rows[i], ColumnValue), {Qt::DisplayRole});
+            if (i + 1 < rows.count()) {
+                first = rows[i + 1];
+            }
+        }
+    }
+}
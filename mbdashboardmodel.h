@@ -0,0 +1,55 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <QAbstractTableModel>
+#include <QObject>
+#include <QVector>
+#include <mbstatestore.h>
+
+/**
+ * @brief The live channels of all ports and devices for views
+ * One row per state store channel, rows are appended as the
+ * store learns channels and never move. The model keeps its
+ * own snapshot so data() does not lock the store, a frame
+ * copies only the changed channels and signals them as few
+ * contiguous dataChanged ranges.
+ */
+class MBDashboardModel: public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum TColumn {
+        ColumnPort = 0,
+        ColumnServer,
+        ColumnTable,
+        ColumnIndex,
+        ColumnValue,
+    };
+    Q_ENUM(TColumn)
+
+    /**
+     * @brief Default constructor
+     * @param store
+     * @param parent
+     */
+    explicit MBDashboardModel(MBStateStore* store, QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private slots:
+    void onChannelsAdded(int first, int last);
+    void onFrame(const QVector<int>& changed);
+
+private:
+    MBStateStore* m_store;
+    QVector<MBStateStore::TChannel> m_rows;
+    const char* m_tables[MBStateStore::Analog + 1];
+};
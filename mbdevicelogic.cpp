@@ -0,0 +1,88 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#include <QCoreApplication>
+#include <QDebug>
+#include <mbdevicelogic.h>
+
+MBDeviceLogic* MBDeviceLogic::instance()
+{
+    static MBDeviceLogic* logic = nullptr;
+    if (!logic) {
+        logic = new MBDeviceLogic(qApp);
+    }
+    return logic;
+}
+
+MBDeviceLogic::MBDeviceLogic(QObject* parent)
+    : QObject {parent}
+    , m_thread()
+{
+    m_thread.setObjectName(QStringLiteral("mb-logic"));
+}
+
+MBDeviceLogic::~MBDeviceLogic()
+{
+    stop();
+}
+
+/* -------------------------------------------------------
+ * Api Methods
+ * ------------------------------------------------------- */
+
+void MBDeviceLogic::start()
+{
+    if (m_thread.isRunning()) {
+        return;
+    }
+
+    /* poll timers and reply handling before the GUI */
+    m_thread.start(QThread::HighPriority);
+}
+
+void MBDeviceLogic::stop()
+{
+    if (!m_thread.isRunning()) {
+        return;
+    }
+
+    /* deferred deletes run when the thread finishes */
+    m_thread.quit();
+    m_thread.wait();
+}
+
+bool MBDeviceLogic::isRunning() const
+{
+    return m_thread.isRunning();
+}
+
+void MBDeviceLogic::adopt(QObject* object)
+{
+    if (object->parent()) {
+        qWarning() << "MBLOGIC: Object with parent not adopted:" << object;
+        return;
+    }
+
+    object->moveToThread(&m_thread);
+}
+
+void MBDeviceLogic::release(QObject* object)
+{
+    QThread* owner = QThread::currentThread();
+    call(object, [object, owner]() {
+        object->moveToThread(owner);
+    });
+}
+
+/* -------------------------------------------------------
+ * Private Methods
+ * ------------------------------------------------------- */
+
+bool MBDeviceLogic::isQueued(QObject* target)
+{
+    QThread* thread = target->thread();
+    return thread != QThread::currentThread() && thread->isRunning();
+}
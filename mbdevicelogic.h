@@ -0,0 +1,116 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <QMetaObject>
+#include <QObject>
+#include <QThread>
+#include <type_traits>
+
+/**
+ * @brief The device logic thread of bus clients and drivers
+ * Serial I/O, reply decoding, driver state and poll timers
+ * run in one thread apart from the GUI, a slow repaint no
+ * longer delays the next bus transaction. The UI talks to
+ * adopted objects only through post() and call(), driver
+ * signals reach the UI as queued connections.
+ */
+class MBDeviceLogic: public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Shared logic thread of the application
+     * @return The instance
+     */
+    static MBDeviceLogic* instance();
+    /**
+     * @brief Default constructor
+     * @param parent
+     */
+    explicit MBDeviceLogic(QObject* parent = nullptr);
+    /**
+     * @brief Stops the thread
+     */
+    ~MBDeviceLogic();
+    /**
+     * @brief start
+     * Starts the thread, adopted objects begin to run
+     */
+    void start();
+    /**
+     * @brief stop
+     * Runs pending deferred deletes and stops the thread
+     */
+    void stop();
+    /**
+     * @brief isRunning
+     * @return True if the thread is running
+     */
+    bool isRunning() const;
+    /**
+     * @brief adopt
+     * Moves a parentless object and its children to the thread
+     * @param object
+     */
+    void adopt(QObject* object);
+    /**
+     * @brief release
+     * Moves an adopted object back to the calling thread,
+     * owners of value members release them before stop()
+     * @param object
+     */
+    void release(QObject* object);
+    /**
+     * @brief post
+     * Runs the functor in the thread of target, non blocking.
+     * Dropped if target is deleted before it runs.
+     * @param target Context object
+     * @param fn Functor
+     */
+    template<typename F>
+    static void post(QObject* target, F fn)
+    {
+        if (!isQueued(target)) {
+            fn();
+            return;
+        }
+        QMetaObject::invokeMethod(target, std::move(fn), Qt::QueuedConnection);
+    }
+    /**
+     * @brief call
+     * Runs the functor in the thread of target and waits.
+     * For short state reads and commands only, the logic
+     * thread never waits for the UI.
+     * @param target Context object
+     * @param fn Functor
+     * @return Result of the functor
+     */
+    template<typename F>
+    static auto call(QObject* target, F fn) -> decltype(fn())
+    {
+        typedef decltype(fn()) TResult;
+        if (!isQueued(target)) {
+            return fn();
+        }
+        if constexpr (std::is_void_v<TResult>) {
+            QMetaObject::invokeMethod(target, std::move(fn), Qt::BlockingQueuedConnection);
+        }
+        else {
+            TResult result {};
+            QMetaObject::invokeMethod(target, std::move(fn), Qt::BlockingQueuedConnection, &result);
+            return result;
+        }
+    }
+
+private:
+    QThread m_thread;
+
+private:
+    /* target lives in another running thread */
+    static bool isQueued(QObject* target);
+};
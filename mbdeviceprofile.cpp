@@ -0,0 +1,324 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonParseError>
+#include <algorithm>
+#include <cstring>
+#include <mbdeviceprofile.h>
+
+/* unused registers worth a read instead of a new frame */
+#define DEFAULT_MAX_GAP 10
+
+MBDeviceProfile::MBDeviceProfile()
+    : m_name()
+    , m_address(1)
+    , m_maxGap(DEFAULT_MAX_GAP)
+    , m_classes()
+    , m_points()
+    , m_blocks()
+    , m_index()
+{
+}
+
+/* -------------------------------------------------------
+ * Api Methods
+ * ------------------------------------------------------- */
+
+QStringList MBDeviceProfile::available()
+{
+    QStringList paths;
+    const QDir dir(QStringLiteral(":/profiles"));
+    foreach (const QString& file, dir.entryList({QStringLiteral("*.json")}, QDir::Files, QDir::Name)) {
+        paths.append(dir.filePath(file));
+    }
+    return paths;
+}
+
+bool MBDeviceProfile::load(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCritical() << "MBPROF: Can't read profile" << path << file.errorString();
+        return false;
+    }
+    if (!parse(file.readAll())) {
+        qCritical() << "MBPROF: Invalid profile" << path;
+        return false;
+    }
+    return true;
+}
+
+bool MBDeviceProfile::parse(const QByteArray& json)
+{
+    QJsonParseError error;
+    const QJsonDocument doc = QJsonDocument::fromJson(json, &error);
+    if (error.error != QJsonParseError::NoError || !doc.isObject()) {
+        qCritical() << "MBPROF: JSON error at" << error.offset << error.errorString();
+        return false;
+    }
+
+    const QJsonObject root = doc.object();
+    MBDeviceProfile profile;
+    profile.m_name = root.value("name").toString();
+    profile.m_address = (quint8) root.value("address").toInt(1);
+    profile.m_maxGap = (quint16) qMax(0, root.value("maxGap").toInt(DEFAULT_MAX_GAP));
+
+    foreach (const QJsonValue& value, root.value("pollClasses").toArray()) {
+        const QJsonObject object = value.toObject();
+        const int interval = object.value("interval").toInt();
+        if (interval <= 0) {
+            qCritical() << "MBPROF: Invalid poll interval of class" << object.value("name").toString();
+            return false;
+        }
+        profile.m_classes.append({object.value("name").toString(), (uint) interval});
+    }
+    if (profile.m_name.isEmpty() || profile.m_classes.isEmpty()) {
+        qCritical() << "MBPROF: Profile without name or poll classes";
+        return false;
+    }
+
+    foreach (const QJsonValue& value, root.value("points").toArray()) {
+        TPoint point;
+        if (!profile.parsePoint(value.toObject(), &point)) {
+            return false;
+        }
+        if (profile.m_index.contains(point.m_name)) {
+            qCritical() << "MBPROF: Duplicate point" << point.m_name;
+            return false;
+        }
+        profile.m_index.insert(point.m_name, profile.m_points.count());
+        profile.m_points.append(point);
+    }
+    if (profile.m_points.isEmpty()) {
+        qCritical() << "MBPROF: Profile without points" << profile.m_name;
+        return false;
+    }
+
+    profile.compile();
+    *this = profile;
+
+    qDebug() << "MBPROF: Compiled" << m_name << "points:" << m_points.count() << "blocks:" << m_blocks.count();
+    return true;
+}
+
+bool MBDeviceProfile::isValid() const
+{
+    return !m_blocks.isEmpty();
+}
+
+const QString& MBDeviceProfile::name() const
+{
+    return m_name;
+}
+
+quint8 MBDeviceProfile::defaultAddress() const
+{
+    return m_address;
+}
+
+const QList<MBDeviceProfile::TPollClass>& MBDeviceProfile::pollClasses() const
+{
+    return m_classes;
+}
+
+const QVector<MBDeviceProfile::TPoint>& MBDeviceProfile::points() const
+{
+    return m_points;
+}
+
+const QVector<MBDeviceProfile::TBlock>& MBDeviceProfile::blocks() const
+{
+    return m_blocks;
+}
+
+int MBDeviceProfile::pointIndex(const QString& name) const
+{
+    return m_index.value(name, -1);
+}
+
+double MBDeviceProfile::decode(const TDecoder& decoder, const QVector<quint16>& values)
+{
+    const quint16 hi = values.value(decoder.m_offset);
+    const quint16 lo = values.value(decoder.m_offset + 1);
+    const quint32 dword = (decoder.m_swapWords //
+                              ? ((quint32) lo << 16) | hi
+                              : ((quint32) hi << 16) | lo);
+
+    double raw;
+    switch (decoder.m_type) {
+        case TypeBit: {
+            raw = (hi != 0 ? 1 : 0);
+            break;
+        }
+        case TypeU16: {
+            raw = hi;
+            break;
+        }
+        case TypeS16: {
+            raw = (qint16) hi;
+            break;
+        }
+        case TypeU32: {
+            raw = dword;
+            break;
+        }
+        case TypeS32: {
+            raw = (qint32) dword;
+            break;
+        }
+        case TypeF32: {
+            float f;
+            std::memcpy(&f, &dword, sizeof(f));
+            raw = f;
+            break;
+        }
+        default: {
+            raw = 0;
+            break;
+        }
+    }
+
+    return raw * decoder.m_scale + decoder.m_bias;
+}
+
+/* -------------------------------------------------------
+ * Private Methods
+ * ------------------------------------------------------- */
+
+inline bool MBDeviceProfile::parsePoint(const QJsonObject& object, TPoint* point) const
+{
+    static const QHash<QString, QModbusDataUnit::RegisterType> tables = {
+       {"coil", QModbusDataUnit::Coils},
+       {"discrete", QModbusDataUnit::DiscreteInputs},
+       {"holding", QModbusDataUnit::HoldingRegisters},
+       {"input", QModbusDataUnit::InputRegisters},
+    };
+    static const QHash<QString, TDataType> types = {
+       {"bit", TypeBit},
+       {"u16", TypeU16},
+       {"s16", TypeS16},
+       {"u32", TypeU32},
+       {"s32", TypeS32},
+       {"f32", TypeF32},
+    };
+
+    point->m_name = object.value("name").toString();
+    point->m_unit = object.value("unit").toString();
+    point->m_table = tables.value(object.value("table").toString(), QModbusDataUnit::Invalid);
+    point->m_address = (quint16) object.value("address").toInt(-1);
+    point->m_swapWords = (object.value("order").toString("hilo") == "lohi");
+    point->m_scale = object.value("scale").toDouble(1.0);
+    point->m_bias = object.value("offset").toDouble(0.0);
+
+    const bool bits = (point->m_table == QModbusDataUnit::Coils || point->m_table == QModbusDataUnit::DiscreteInputs);
+    const QString type = object.value("type").toString(bits ? "bit" : "u16");
+    if (!types.contains(type)) {
+        qCritical() << "MBPROF: Unknown type" << type << "of point" << point->m_name;
+        return false;
+    }
+    point->m_type = types.value(type);
+
+    point->m_pollClass = -1;
+    const QString poll = object.value("poll").toString(m_classes.first().m_name);
+    for (int i = 0; i < m_classes.count(); i++) {
+        if (m_classes[i].m_name == poll) {
+            point->m_pollClass = i;
+        }
+    }
+
+    if (point->m_name.isEmpty() || point->m_table == QModbusDataUnit::Invalid || //
+        object.value("address").toInt(-1) < 0 || object.value("address").toInt() > 0xffff) {
+        qCritical() << "MBPROF: Invalid point" << object;
+        return false;
+    }
+    if (bits != (point->m_type == TypeBit)) {
+        qCritical() << "MBPROF: Type doesn't match table of point" << point->m_name;
+        return false;
+    }
+    if (point->m_pollClass < 0) {
+        qCritical() << "MBPROF: Unknown poll class" << poll << "of point" << point->m_name;
+        return false;
+    }
+    return true;
+}
+
+/* merge points of a table and class into block reads */
+inline void MBDeviceProfile::compile()
+{
+    static const QModbusDataUnit::RegisterType order[] = {
+       QModbusDataUnit::Coils,
+       QModbusDataUnit::DiscreteInputs,
+       QModbusDataUnit::HoldingRegisters,
+       QModbusDataUnit::InputRegisters,
+    };
+
+    m_blocks.clear();
+    for (int c = 0; c < m_classes.count(); c++) {
+        for (QModbusDataUnit::RegisterType table : order) {
+            QVector<int> members;
+            for (int i = 0; i < m_points.count(); i++) {
+                if (m_points[i].m_pollClass == c && m_points[i].m_table == table) {
+                    members.append(i);
+                }
+            }
+            std::sort(members.begin(), members.end(), [this](int a, int b) {
+                return m_points[a].m_address < m_points[b].m_address;
+            });
+
+            TBlock block = {table, 0, 0, c, {}};
+            foreach (int i, members) {
+                const TPoint& p = m_points[i];
+                const uint end = (uint) p.m_address + width(p.m_type);
+                const uint blockEnd = (uint) block.m_start + block.m_count;
+
+                /* gap too wide or frame limit, next block */
+                if (block.m_count > 0 && (p.m_address > blockEnd + m_maxGap || //
+                                          end - block.m_start > maxCount(table))) {
+                    m_blocks.append(block);
+                    block = {table, 0, 0, c, {}};
+                }
+                if (block.m_count == 0) {
+                    block.m_start = p.m_address;
+                }
+
+                block.m_count = (quint16) qMax<uint>(block.m_count, end - block.m_start);
+                block.m_decoders.append({i, (quint16) (p.m_address - block.m_start), p.m_type, p.m_swapWords, p.m_scale, p.m_bias});
+            }
+            if (block.m_count > 0) {
+                m_blocks.append(block);
+            }
+        }
+    }
+}
+
+/* registers or bits of a data type */
+inline quint16 MBDeviceProfile::width(TDataType type)
+{
+    switch (type) {
+        case TypeU32:
+        case TypeS32:
+        case TypeF32: {
+            return 2;
+        }
+        default: {
+            return 1;
+        }
+    }
+}
+
+/* read limit of one frame, FC01/02 and FC03/04 */
+inline quint16 MBDeviceProfile::maxCount(QModbusDataUnit::RegisterType table)
+{
+    if (table == QModbusDataUnit::Coils || table == QModbusDataUnit::DiscreteInputs) {
+        return 2000;
+    }
+    return 125;
+}
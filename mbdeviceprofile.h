@@ -0,0 +1,169 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <QByteArray>
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QModbusDataUnit>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/**
+ * @brief The compiled register map of a device profile
+ * A JSON profile lists the points of a device with register
+ * table, address, data type, scaling and poll class. Loading
+ * compiles it into a polling plan: points of one table and
+ * poll class are merged into as few block reads as the gap
+ * and frame size limits allow, each point gets a decode
+ * descriptor with its register offset in the block.
+ *
+ * Profile format:
+ *   {
+ *     "name": "Eastron SDM120", "address": 1, "maxGap": 10,
+ *     "pollClasses": [{"name": "fast", "interval": 1000}],
+ *     "points": [{"name": "voltage", "table": "input",
+ *                 "address": 0, "type": "f32", "order": "hilo",
+ *                 "scale": 1.0, "offset": 0.0, "unit": "V",
+ *                 "poll": "fast"}]
+ *   }
+ * Tables: coil, discrete, holding, input
+ * Types:  bit, u16, s16, u32, s32, f32
+ */
+class MBDeviceProfile
+{
+public:
+    enum TDataType {
+        TypeBit,
+        TypeU16,
+        TypeS16,
+        TypeU32,
+        TypeS32,
+        TypeF32,
+    };
+
+    typedef struct {
+        QString m_name;
+        QString m_unit;
+        QModbusDataUnit::RegisterType m_table;
+        quint16 m_address;
+        TDataType m_type;
+        /* low word first for 32 bit types */
+        bool m_swapWords;
+        /* value = raw * scale + bias */
+        double m_scale;
+        double m_bias;
+        int m_pollClass;
+    } TPoint;
+
+    typedef struct {
+        int m_point;
+        /* first register of the point in the block */
+        quint16 m_offset;
+        /* copied from the point, decode without lookup */
+        TDataType m_type;
+        bool m_swapWords;
+        double m_scale;
+        double m_bias;
+    } TDecoder;
+
+    typedef struct {
+        QModbusDataUnit::RegisterType m_table;
+        quint16 m_start;
+        quint16 m_count;
+        int m_pollClass;
+        QVector<TDecoder> m_decoders;
+    } TBlock;
+
+    typedef struct {
+        QString m_name;
+        /* poll interval in ms */
+        uint m_interval;
+    } TPollClass;
+
+    /**
+     * @brief Default constructor
+     */
+    MBDeviceProfile();
+    /**
+     * @brief available
+     * @return Paths of the built-in profiles
+     */
+    static QStringList available();
+    /**
+     * @brief load
+     * @param path File or resource path of the JSON profile
+     * @return false on read or profile errors
+     */
+    bool load(const QString& path);
+    /**
+     * @brief parse
+     * @param json Profile document
+     * @return false on profile errors
+     */
+    bool parse(const QByteArray& json);
+    /**
+     * @brief isValid
+     * @return true if a profile has been compiled
+     */
+    bool isValid() const;
+    /**
+     * @brief name
+     * @return
+     */
+    const QString& name() const;
+    /**
+     * @brief defaultAddress
+     * @return Factory server address of the device
+     */
+    quint8 defaultAddress() const;
+    /**
+     * @brief pollClasses
+     * @return
+     */
+    const QList<TPollClass>& pollClasses() const;
+    /**
+     * @brief points
+     * @return
+     */
+    const QVector<TPoint>& points() const;
+    /**
+     * @brief blocks
+     * @return Polling plan, one read per block
+     */
+    const QVector<TBlock>& blocks() const;
+    /**
+     * @brief pointIndex
+     * @param name
+     * @return Index of the point, -1 if unknown
+     */
+    int pointIndex(const QString& name) const;
+    /**
+     * @brief decode
+     * @param decoder Descriptor of a block point
+     * @param values Values of the block read
+     * @return Scaled engineering value
+     */
+    static double decode(const TDecoder& decoder, const QVector<quint16>& values);
+
+private:
+    QString m_name;
+    quint8 m_address;
+    /* unused registers read to merge two blocks */
+    quint16 m_maxGap;
+    QList<TPollClass> m_classes;
+    QVector<TPoint> m_points;
+    QVector<TBlock> m_blocks;
+    QHash<QString, int> m_index;
+
+private:
+    inline bool parsePoint(const QJsonObject& object, TPoint* point) const;
+    inline void compile();
+    static inline quint16 width(TDataType type);
+    static inline quint16 maxCount(QModbusDataUnit::RegisterType table);
+};
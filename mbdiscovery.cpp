@@ -0,0 +1,222 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#include <QDebug>
+#include <QModbusDataUnit>
+#include <QVector>
+#include <limits>
+#include <mbdiscovery.h>
+
+/* request and reply of a single register read, 11 bits per byte */
+#define PROBE_BITS ((8 + 7) * 11)
+
+MBDiscovery::MBDiscovery(QObject* parent)
+    : QObject {parent}
+    , m_config()
+    , m_devices()
+    , m_session(0)
+    , m_running(0)
+{
+    qRegisterMetaType<MBDiscovery::TDevice>();
+
+    /* factory default of the modules first */
+    m_config.m_baudRates = {
+       QSerialPort::Baud9600,
+       QSerialPort::Baud115200,
+       QSerialPort::Baud19200,
+       QSerialPort::Baud38400,
+       QSerialPort::Baud57600,
+       QSerialPort::Baud4800,
+       128000,
+       256000,
+    };
+    m_config.m_parities = {
+       QSerialPort::NoParity,
+       QSerialPort::EvenParity,
+       QSerialPort::OddParity,
+    };
+    m_config.m_firstServer = 1;
+    m_config.m_lastServer = 247;
+    m_config.m_timeout = 20;
+    m_config.m_firstMatch = true;
+}
+
+MBDiscovery::~MBDiscovery()
+{
+    m_session++;
+}
+
+/* -------------------------------------------------------
+ * Api Methods
+ * ------------------------------------------------------- */
+
+const MBDiscovery::TConfig& MBDiscovery::config() const
+{
+    return m_config;
+}
+
+void MBDiscovery::setConfig(const TConfig& config)
+{
+    m_config = config;
+}
+
+bool MBDiscovery::start()
+{
+    if (m_running > 0 || m_config.m_ports.isEmpty() || m_config.m_firstServer < 1 || //
+        m_config.m_lastServer > 247 || m_config.m_firstServer > m_config.m_lastServer) {
+        return false;
+    }
+
+    m_devices.clear();
+    m_session++;
+
+    foreach (const QString& port, m_config.m_ports) {
+        MBRtuClient* client = new MBRtuClient(this);
+        MBRtuClient::TConfig config = client->config();
+        config.m_portName = port;
+        config.m_traceFlags = 0;
+        /* no retries, silence is the common answer */
+        config.m_retries = 0;
+        config.m_quarantineAfter = std::numeric_limits<uint>::max();
+        client->setConfig(config);
+
+        m_running++;
+        scanPort(client, m_session).start();
+    }
+
+    qDebug() << "MBDISC: Scan started on" << m_config.m_ports;
+    return true;
+}
+
+void MBDiscovery::cancel()
+{
+    if (m_running > 0) {
+        qDebug() << "MBDISC: Scan canceled";
+        m_session++;
+    }
+}
+
+bool MBDiscovery::isRunning() const
+{
+    return m_running > 0;
+}
+
+const QList<MBDiscovery::TDevice>& MBDiscovery::devices() const
+{
+    return m_devices;
+}
+
+/* -------------------------------------------------------
+ * Private Methods
+ * ------------------------------------------------------- */
+
+MBTask<> MBDiscovery::scanPort(MBRtuClient* client, quint64 session)
+{
+    /* setConfig() while running applies to the next scan */
+    const TConfig scan = m_config;
+    const int servers = scan.m_lastServer - scan.m_firstServer + 1;
+    const int total = servers * scan.m_baudRates.count() * scan.m_parities.count();
+    bool found = false;
+    int done = 0;
+
+    for (qint32 baudRate : scan.m_baudRates) {
+        for (QSerialPort::Parity parity : scan.m_parities) {
+            if (session != m_session || (found && scan.m_firstMatch)) {
+                break;
+            }
+
+            MBRtuClient::TConfig line = client->config();
+            line.m_baudRate = baudRate;
+            line.m_parity = parity;
+            line.m_timeout = replyTimeout(baudRate);
+            client->setConfig(line);
+
+            /* custom rates may not be supported by the adapter */
+            if (!co_await client->open()) {
+                qWarning() << "MBDISC: Can't open" << client->portName() << "at" << baudRate;
+                done += servers;
+                continue;
+            }
+
+            /* whole range queued at once, the line serialises */
+            QVector<MBRtuRequest> probes;
+            for (uint server = scan.m_firstServer; server <= scan.m_lastServer; server++) {
+                probes.append(client->readHolding(server, 0x8000, 1));
+            }
+
+            for (int i = 0; i < probes.count() && session == m_session; i++) {
+                const MBRtuRequest::TResult result = co_await probes[i];
+                done++;
+
+                if (result.m_status == MBRtuRequest::StatusSuccess && result.m_isDataUnit) {
+                    const quint8 server = scan.m_firstServer + i;
+                    TDevice device = {client->portName(), baudRate, parity, server, result.m_unit.value(0), ModelUnknown, false};
+
+                    /* ahead of the remaining probes */
+                    const MBRtuRequest::TResult address = co_await client->read( //
+                       server,
+                       QModbusDataUnit(QModbusDataUnit::HoldingRegisters, 0x4000, 1),
+                       MBRtuClient::PriorityHigh);
+                    device.m_confirmed = (address.m_status == MBRtuRequest::StatusSuccess && //
+                                          address.m_isDataUnit && (address.m_unit.value(0) & 0xff) == server);
+                    device.m_model = co_await identify(client, server);
+
+                    qInfo() << "MBDISC: Found" << device.m_port << device.m_baudRate << device.m_parity //
+                            << "server:" << device.m_server << "model:" << device.m_model;
+                    m_devices.append(device);
+                    found = true;
+                    emit deviceFound(device);
+                }
+
+                if ((done % 16) == 0) {
+                    emit progress(client->portName(), done, total);
+                }
+            }
+
+            co_await client->close();
+        }
+    }
+
+    emit progress(client->portName(), total, total);
+    finishPort(client);
+}
+
+/* relay modules have coils, analog modules input registers */
+MBTask<MBDiscovery::TModel> MBDiscovery::identify(MBRtuClient* client, quint8 server)
+{
+    const MBRtuRequest::TResult coils = co_await client->read( //
+       server,
+       QModbusDataUnit(QModbusDataUnit::Coils, 0, 8),
+       MBRtuClient::PriorityHigh);
+    if (coils.m_status == MBRtuRequest::StatusSuccess) {
+        co_return ModelRelay;
+    }
+
+    const MBRtuRequest::TResult inputs = co_await client->read( //
+       server,
+       QModbusDataUnit(QModbusDataUnit::InputRegisters, 0, 8),
+       MBRtuClient::PriorityHigh);
+    if (inputs.m_status == MBRtuRequest::StatusSuccess) {
+        co_return ModelAnalogIn;
+    }
+
+    co_return ModelUnknown;
+}
+
+/* frame time of a probe at the rate plus turnaround */
+inline int MBDiscovery::replyTimeout(qint32 rate) const
+{
+    return m_config.m_timeout + (PROBE_BITS * 1000 + rate - 1) / rate;
+}
+
+inline void MBDiscovery::finishPort(MBRtuClient* client)
+{
+    client->deleteLater();
+    if (--m_running == 0) {
+        qDebug() << "MBDISC: Scan finished, devices:" << m_devices.count();
+        emit finished(m_devices);
+    }
+}
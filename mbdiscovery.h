@@ -0,0 +1,135 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <QList>
+#include <QObject>
+#include <QSerialPort>
+#include <QString>
+#include <QStringList>
+#include <mbrtuclient.h>
+#include <mbtask.h>
+
+/**
+ * @brief The bus discovery scanner
+ * Sweeps server address x baud rate x parity on all given
+ * ports in parallel, one RTU client per port. Responders
+ * of the version register 0x8000 are confirmed by their
+ * address register 0x4000 and identified by their tables.
+ * The serial ports must not be in use by other clients.
+ */
+class MBDiscovery: public QObject
+{
+    Q_OBJECT
+
+public:
+    enum TModel {
+        ModelUnknown,
+        /* Waveshare relay / digital input */
+        ModelRelay,
+        /* Waveshare analog input */
+        ModelAnalogIn,
+    };
+    Q_ENUM(TModel)
+
+    typedef struct {
+        QString m_port;
+        qint32 m_baudRate;
+        QSerialPort::Parity m_parity;
+        quint8 m_server;
+        quint16 m_firmware;
+        TModel m_model;
+        /* address register matches server */
+        bool m_confirmed;
+    } TDevice;
+
+    typedef struct Config {
+        QStringList m_ports;
+        /* tried in list order */
+        QList<qint32> m_baudRates;
+        QList<QSerialPort::Parity> m_parities;
+        quint8 m_firstServer;
+        quint8 m_lastServer;
+        /* reply timeout in ms on top of the frame time */
+        int m_timeout;
+        /* stop a port at the first line setting with devices */
+        bool m_firstMatch;
+    } TConfig;
+
+    /**
+     * @brief Default constructor
+     * @param parent
+     */
+    explicit MBDiscovery(QObject* parent = nullptr);
+    /**
+     * Destructor cancels a running scan
+     */
+    ~MBDiscovery();
+    /**
+     * @brief config
+     * @return
+     */
+    const TConfig& config() const;
+    /**
+     * @brief setConfig
+     * @param config Takes effect on next start
+     */
+    void setConfig(const TConfig& config);
+    /**
+     * @brief start
+     * @return false if running or nothing to scan
+     */
+    bool start();
+    /**
+     * @brief cancel
+     * Ports stop after the pending probe
+     */
+    void cancel();
+    /**
+     * @brief isRunning
+     * @return
+     */
+    bool isRunning() const;
+    /**
+     * @brief devices
+     * @return Inventory of the last scan
+     */
+    const QList<TDevice>& devices() const;
+
+signals:
+    /**
+     * @brief deviceFound
+     * @param device
+     */
+    void deviceFound(const MBDiscovery::TDevice& device);
+    /**
+     * @brief progress
+     * @param port
+     * @param done Probes answered or timed out
+     * @param total Probes of the port
+     */
+    void progress(const QString& port, int done, int total);
+    /**
+     * @brief finished
+     * @param devices Inventory of all ports
+     */
+    void finished(const QList<MBDiscovery::TDevice>& devices);
+
+private:
+    TConfig m_config;
+    QList<TDevice> m_devices;
+    /* scan generation, cancel bumps it */
+    quint64 m_session;
+    int m_running;
+
+private:
+    MBTask<> scanPort(MBRtuClient* client, quint64 session);
+    MBTask<TModel> identify(MBRtuClient* client, quint8 server);
+    inline int replyTimeout(qint32 rate) const;
+    inline void finishPort(MBRtuClient* client);
+};
+
+Q_DECLARE_METATYPE(MBDiscovery::TDevice)
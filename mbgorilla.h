@@ -0,0 +1,269 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * @brief The time series block codec of the historian
+ * Timestamps in ms are stored as delta-of-delta, values as
+ * XOR of consecutive doubles (Gorilla, VLDB 2015). A sample
+ * with unchanged period and value costs 2 bits. No Qt types,
+ * external tools decode history blocks with this header only.
+ */
+class MBGorillaEncoder
+{
+public:
+    MBGorillaEncoder()
+        : m_bits()
+        , m_bitCount(0)
+        , m_count(0)
+        , m_time(0)
+        , m_delta(0)
+        , m_value(0)
+        , m_leading(0xff)
+        , m_trailing(0)
+    {
+    }
+
+    void append(int64_t time, double value)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+
+        if (m_count == 0) {
+            writeBits((uint64_t) time, 64);
+            writeBits(bits, 64);
+        }
+        else {
+            int64_t delta = time - m_time;
+            encodeTime(delta - m_delta);
+            encodeValue(bits ^ m_value);
+            m_delta = delta;
+        }
+
+        m_time = time;
+        m_value = bits;
+        m_count++;
+    }
+
+    void clear()
+    {
+        *this = MBGorillaEncoder();
+    }
+
+    uint32_t count() const
+    {
+        return m_count;
+    }
+
+    /* encoded size in bytes */
+    size_t size() const
+    {
+        return m_bits.size();
+    }
+
+    const uint8_t* data() const
+    {
+        return m_bits.data();
+    }
+
+private:
+    std::vector<uint8_t> m_bits;
+    uint64_t m_bitCount;
+    uint32_t m_count;
+    int64_t m_time;
+    int64_t m_delta;
+    uint64_t m_value;
+    uint8_t m_leading;
+    uint8_t m_trailing;
+
+    void writeBit(bool bit)
+    {
+        if ((m_bitCount & 7) == 0) {
+            m_bits.push_back(0);
+        }
+        if (bit) {
+            m_bits.back() |= (uint8_t) (0x80 >> (m_bitCount & 7));
+        }
+        m_bitCount++;
+    }
+
+    void writeBits(uint64_t value, int count)
+    {
+        for (int i = count - 1; i >= 0; i--) {
+            writeBit((value >> i) & 1);
+        }
+    }
+
+    void encodeTime(int64_t dod)
+    {
+        if (dod == 0) {
+            writeBit(0);
+        }
+        else if (dod >= -63 && dod <= 64) {
+            writeBits(0x2, 2);
+            writeBits((uint64_t) (dod + 63), 7);
+        }
+        else if (dod >= -255 && dod <= 256) {
+            writeBits(0x6, 3);
+            writeBits((uint64_t) (dod + 255), 9);
+        }
+        else if (dod >= -2047 && dod <= 2048) {
+            writeBits(0xe, 4);
+            writeBits((uint64_t) (dod + 2047), 12);
+        }
+        else {
+            writeBits(0xf, 4);
+            writeBits((uint64_t) dod, 64);
+        }
+    }
+
+    void encodeValue(uint64_t xorValue)
+    {
+        if (xorValue == 0) {
+            writeBit(0);
+            return;
+        }
+        writeBit(1);
+
+        uint8_t leading = (uint8_t) __builtin_clzll(xorValue);
+        uint8_t trailing = (uint8_t) __builtin_ctzll(xorValue);
+        if (leading > 31) {
+            leading = 31;
+        }
+
+        /* fits into previous window */
+        if (m_leading != 0xff && leading >= m_leading && trailing >= m_trailing) {
+            writeBit(0);
+            writeBits(xorValue >> m_trailing, 64 - m_leading - m_trailing);
+            return;
+        }
+
+        uint8_t length = (uint8_t) (64 - leading - trailing);
+        writeBit(1);
+        writeBits(leading, 5);
+        /* 64 stored as 0 */
+        writeBits(length & 0x3f, 6);
+        writeBits(xorValue >> trailing, length);
+        m_leading = leading;
+        m_trailing = trailing;
+    }
+};
+
+class MBGorillaDecoder
+{
+public:
+    MBGorillaDecoder(const uint8_t* data, size_t size, uint32_t count)
+        : m_data(data)
+        , m_size(size * 8)
+        , m_pos(0)
+        , m_count(count)
+        , m_index(0)
+        , m_time(0)
+        , m_delta(0)
+        , m_value(0)
+        , m_leading(0)
+        , m_trailing(0)
+    {
+    }
+
+    /* false at end of block or on corrupt data */
+    bool next(int64_t* time, double* value)
+    {
+        if (m_index >= m_count) {
+            return false;
+        }
+
+        if (m_index == 0) {
+            m_time = (int64_t) readBits(64);
+            m_value = readBits(64);
+        }
+        else {
+            m_delta += decodeTime();
+            m_time += m_delta;
+            m_value ^= decodeValue();
+        }
+
+        if (m_pos > m_size) {
+            m_index = m_count;
+            return false;
+        }
+
+        m_index++;
+        *time = m_time;
+        std::memcpy(value, &m_value, sizeof(m_value));
+        return true;
+    }
+
+private:
+    const uint8_t* m_data;
+    uint64_t m_size;
+    uint64_t m_pos;
+    uint32_t m_count;
+    uint32_t m_index;
+    int64_t m_time;
+    int64_t m_delta;
+    uint64_t m_value;
+    uint8_t m_leading;
+    uint8_t m_trailing;
+
+    bool readBit()
+    {
+        if (m_pos >= m_size) {
+            m_pos++;
+            return false;
+        }
+        bool bit = (m_data[m_pos >> 3] & (0x80 >> (m_pos & 7))) != 0;
+        m_pos++;
+        return bit;
+    }
+
+    uint64_t readBits(int count)
+    {
+        uint64_t value = 0;
+        for (int i = 0; i < count; i++) {
+            value = (value << 1) | (readBit() ? 1 : 0);
+        }
+        return value;
+    }
+
+    int64_t decodeTime()
+    {
+        if (!readBit()) {
+            return 0;
+        }
+        if (!readBit()) {
+            return (int64_t) readBits(7) - 63;
+        }
+        if (!readBit()) {
+            return (int64_t) readBits(9) - 255;
+        }
+        if (!readBit()) {
+            return (int64_t) readBits(12) - 2047;
+        }
+        return (int64_t) readBits(64);
+    }
+
+    uint64_t decodeValue()
+    {
+        if (!readBit()) {
+            return 0;
+        }
+        if (readBit()) {
+            m_leading = (uint8_t) readBits(5);
+            uint8_t length = (uint8_t) readBits(6);
+            if (length == 0) {
+                length = 64;
+            }
+            m_trailing = (uint8_t) (64 - m_leading - length);
+        }
+        int length = 64 - m_leading - m_trailing;
+        return readBits(length) << m_trailing;
+    }
+};
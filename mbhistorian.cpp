@@ -0,0 +1,724 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QtConcurrent>
+#include <atomic>
+#include <limits>
+#include <mbhistorian.h>
+
+#define CATALOG_FILE   "series.lst"
+#define JOURNAL_FILE   "open.jnl"
+#define SEGMENT_FILTER "seg-*.mbh"
+#define MAX_BUCKETS    (1 << 20)
+
+static inline uint64_t padded(uint64_t size)
+{
+    return (size + 7) & ~((uint64_t) 7);
+}
+
+MBHistorian* MBHistorian::instance()
+{
+    static MBHistorian* historian = nullptr;
+    if (!historian) {
+        historian = new MBHistorian(qApp);
+    }
+    return historian;
+}
+
+QString MBHistorian::seriesName(const QString& port, quint8 server, const char* kind, uint index)
+{
+    return QStringLiteral("%1/%2/%3%4").arg(port).arg(server).arg(kind).arg(index);
+}
+
+MBHistorian::MBHistorian(QObject* parent)
+    : QObject {parent}
+    , m_config()
+    , m_dir()
+    , m_isOpen(false)
+    , m_readOnly(false)
+    , m_lock()
+    , m_segments()
+    , m_series()
+    , m_names()
+    , m_blocks()
+    , m_file(this)
+    , m_map(nullptr)
+    , m_segmentNo(0)
+    , m_flushTimer(this)
+{
+    /* 16 MB segments, ~1k samples per block */
+    m_config.m_segmentSize = 16 * 1024 * 1024;
+    m_config.m_blockSamples = 1024;
+    m_config.m_flushInterval = 60000;
+
+    m_flushTimer.setSingleShot(false);
+    connect(&m_flushTimer, &QTimer::timeout, this, &MBHistorian::onFlushTimer);
+}
+
+MBHistorian::~MBHistorian()
+{
+    close();
+}
+
+/* -------------------------------------------------------
+ * Api Methods
+ * ------------------------------------------------------- */
+
+const MBHistorian::TConfig& MBHistorian::config() const
+{
+    return m_config;
+}
+
+void MBHistorian::setConfig(const TConfig& config)
+{
+    m_config = config;
+}
+
+bool MBHistorian::open(const QString& path, bool readOnly)
+{
+    if (m_isOpen) {
+        close();
+    }
+
+    m_dir.setPath(path);
+    m_readOnly = readOnly;
+    if (readOnly ? !m_dir.exists() : !m_dir.mkpath(".")) {
+        qWarning() << "MBHIST: Can't open directory" << path;
+        return false;
+    }
+
+    if (!loadCatalog()) {
+        return false;
+    }
+
+    /* index old segments, never append to them */
+    QMutexLocker lock(&m_lock);
+    m_segmentNo = 0;
+    foreach (const QString& name, m_dir.entryList({SEGMENT_FILTER}, QDir::Files, QDir::Name)) {
+        bool ok;
+        uint no = name.mid(4, 8).toUInt(&ok);
+        if (ok && no > m_segmentNo) {
+            m_segmentNo = no;
+        }
+        loadSegment(name);
+    }
+
+    if (!readOnly && !openSegment()) {
+        lock.unlock();
+        releaseSegments();
+        return false;
+    }
+
+    /* blocks being filled at last flush */
+    loadJournal();
+
+    m_isOpen = true;
+    lock.unlock();
+
+    if (!readOnly) {
+        m_flushTimer.start(m_config.m_flushInterval);
+    }
+
+    qDebug() << "MBHIST: Historian open" << path << "series:" << m_names.count() //
+             << "segments:" << m_segments.count() << (readOnly ? "read only" : "");
+    return true;
+}
+
+void MBHistorian::close()
+{
+    if (!m_isOpen) {
+        return;
+    }
+    if (!m_readOnly) {
+        m_flushTimer.stop();
+        QMutexLocker lock(&m_lock);
+        for (auto it = m_blocks.begin(); it != m_blocks.end(); ++it) {
+            if (it->m_encoder.count() > 0) {
+                writeBlock(it.key(), it.value());
+            }
+        }
+        closeSegment();
+        /* all samples in segments */
+        QFile::remove(m_dir.filePath(JOURNAL_FILE));
+    }
+    releaseSegments();
+    m_isOpen = false;
+}
+
+bool MBHistorian::isOpen() const
+{
+    return m_isOpen;
+}
+
+uint MBHistorian::series(const QString& name)
+{
+    /* recorders and queries run in different threads */
+    QMutexLocker lock(&m_lock);
+    auto it = m_series.constFind(name);
+    if (it != m_series.constEnd()) {
+        return it.value();
+    }
+
+    if (!m_isOpen || m_readOnly) {
+        return 0;
+    }
+
+    /* append to catalog, rare */
+    uint id = m_names.count() + 1;
+    QFile file(m_dir.filePath(CATALOG_FILE));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        qWarning() << "MBHIST: Can't write catalog" << file.fileName();
+        return 0;
+    }
+    QTextStream(&file) << id << '\t' << name << '\n';
+
+    m_series.insert(name, id);
+    m_names.insert(id, name);
+    return id;
+}
+
+uint MBHistorian::findSeries(const QString& name) const
+{
+    QMutexLocker lock(&m_lock);
+    return m_series.value(name, 0);
+}
+
+QHash<uint, QString> MBHistorian::seriesNames() const
+{
+    QMutexLocker lock(&m_lock);
+    return m_names;
+}
+
+QVector<MBHistorian::TPoint> MBHistorian::range(uint series, qint64 from, qint64 to)
+{
+    QVector<TPoint> points;
+    const auto visit = [&points, from, to](qint64 time, double value) {
+        if (time >= from && time < to) {
+            points.append({time, value});
+        }
+    };
+    const auto overlaps = [from, to](const TSummary& summary) {
+        return summary.m_count > 0 && summary.m_last >= from && summary.m_first < to;
+    };
+
+    QMutexLocker lock(&m_lock);
+    for (const TSegment& segment : qAsConst(m_segments)) {
+        if (!segment.m_map || !overlaps(segment.m_summaries.value(series))) {
+            continue;
+        }
+        for (const TBlockRef& ref : segment.m_blocks.value(series)) {
+            if (overlaps(ref.m_summary)) {
+                decode(reinterpret_cast<const TMBHistoryBlock*>(segment.m_map + ref.m_offset), visit);
+            }
+        }
+    }
+
+    /* samples not yet written */
+    auto it = m_blocks.constFind(series);
+    if (it != m_blocks.constEnd() && it->m_encoder.count() > 0) {
+        decode(it->m_encoder.data(), it->m_encoder.size(), it->m_encoder.count(), visit);
+    }
+    return points;
+}
+
+QVector<MBHistorian::TBucket> MBHistorian::downsample(uint series, qint64 from, qint64 to, qint64 step)
+{
+    if (step <= 0 || to <= from) {
+        return {};
+    }
+    const qint64 count = (to - from + step - 1) / step;
+    if (count > MAX_BUCKETS) {
+        qWarning() << "MBHIST: Too many buckets, query rejected." << count;
+        return {};
+    }
+
+    QVector<TBucket> buckets(count);
+    for (int i = 0; i < buckets.count(); i++) {
+        buckets[i] = {from + i * step, 0, std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest(), 0};
+    }
+
+    const auto bucket = [from, step](qint64 time) {
+        return (int) ((time - from) / step);
+    };
+    const auto overlaps = [from, to](const TSummary& summary) {
+        return summary.m_count > 0 && summary.m_last >= from && summary.m_first < to;
+    };
+    /* summary usable as is, no decoding */
+    const auto within = [from, to, &bucket](const TSummary& summary) {
+        return summary.m_first >= from && summary.m_last < to && //
+               bucket(summary.m_first) == bucket(summary.m_last);
+    };
+    const auto visit = [&buckets, &bucket, from, to](qint64 time, double value) {
+        if (time >= from && time < to) {
+            TBucket& b = buckets[bucket(time)];
+            b.m_count++;
+            b.m_min = qMin(b.m_min, value);
+            b.m_max = qMax(b.m_max, value);
+            b.m_sum += value;
+        }
+    };
+
+    QMutexLocker lock(&m_lock);
+    for (const TSegment& segment : qAsConst(m_segments)) {
+        const TSummary summary = segment.m_summaries.value(series);
+        if (!segment.m_map || !overlaps(summary)) {
+            continue;
+        }
+        if (within(summary)) {
+            merge(buckets[bucket(summary.m_first)], summary);
+            continue;
+        }
+        for (const TBlockRef& ref : segment.m_blocks.value(series)) {
+            if (!overlaps(ref.m_summary)) {
+                continue;
+            }
+            if (within(ref.m_summary)) {
+                merge(buckets[bucket(ref.m_summary.m_first)], ref.m_summary);
+                continue;
+            }
+            decode(reinterpret_cast<const TMBHistoryBlock*>(segment.m_map + ref.m_offset), visit);
+        }
+    }
+
+    /* samples not yet written */
+    auto it = m_blocks.constFind(series);
+    if (it != m_blocks.constEnd() && it->m_encoder.count() > 0) {
+        const TSummary summary = {it->m_encoder.count(), it->m_first, it->m_last, it->m_min, it->m_max, it->m_sum};
+        if (overlaps(summary) && within(summary)) {
+            merge(buckets[bucket(summary.m_first)], summary);
+        }
+        else if (overlaps(summary)) {
+            decode(it->m_encoder.data(), it->m_encoder.size(), it->m_encoder.count(), visit);
+        }
+    }
+    lock.unlock();
+
+    /* drop empty buckets */
+    QVector<TBucket> result;
+    foreach (const TBucket& b, buckets) {
+        if (b.m_count > 0) {
+            result.append(b);
+        }
+    }
+    return result;
+}
+
+QFuture<QVector<MBHistorian::TBucket>> MBHistorian::downsampleAsync(uint series, qint64 from, qint64 to, qint64 step)
+{
+    return QtConcurrent::run([this, series, from, to, step]() {
+        return downsample(series, from, to, step);
+    });
+}
+
+bool MBHistorian::exportCsv(const QString& series, qint64 from, qint64 to, qint64 step, QTextStream& out)
+{
+    const uint id = findSeries(series);
+    if (!id) {
+        qWarning() << "MBHIST: Unknown series" << series;
+        return false;
+    }
+
+    if (step <= 0) {
+        out << "time,value\n";
+        foreach (const TPoint& point, range(id, from, to)) {
+            out << point.m_time << ',' << point.m_value << '\n';
+        }
+        return true;
+    }
+
+    out << "time,min,max,avg,count\n";
+    foreach (const TBucket& bucket, downsample(id, from, to, step)) {
+        out << bucket.m_time << ',' << bucket.m_min << ',' << bucket.m_max << ',' //
+            << (bucket.m_sum / bucket.m_count) << ',' << bucket.m_count << '\n';
+    }
+    return true;
+}
+
+void MBHistorian::append(const QVector<TSample>& samples)
+{
+    if (!m_isOpen || m_readOnly) {
+        return;
+    }
+
+    QMutexLocker lock(&m_lock);
+    foreach (const TSample& sample, samples) {
+        if (sample.m_series != 0) {
+            collect(sample);
+        }
+    }
+}
+
+void MBHistorian::append(uint series, qint64 time, double value)
+{
+    append(QVector<TSample>({{series, time, value}}));
+}
+
+void MBHistorian::flush()
+{
+    if (!m_isOpen || m_readOnly) {
+        return;
+    }
+
+    /* file written without blocking recorders */
+    QMutexLocker lock(&m_lock);
+    const QHash<uint, TOpenBlock> blocks = m_blocks;
+    lock.unlock();
+
+    saveJournal(blocks);
+}
+
+/* -------------------------------------------------------
+ * Private Methods
+ * ------------------------------------------------------- */
+
+inline bool MBHistorian::loadCatalog()
+{
+    QMutexLocker lock(&m_lock);
+    m_series.clear();
+    m_names.clear();
+
+    QFile file(m_dir.filePath(CATALOG_FILE));
+    if (!file.exists()) {
+        return true;
+    }
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qWarning() << "MBHIST: Can't read catalog" << file.fileName();
+        return false;
+    }
+
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        const QStringList fields = in.readLine().split('\t');
+        bool ok;
+        uint id;
+        if (fields.count() != 2 || !(id = fields[0].toUInt(&ok)) || !ok) {
+            continue;
+        }
+        m_series.insert(fields[1], id);
+        m_names.insert(id, fields[1]);
+    }
+    return true;
+}
+
+/* map read only and index block headers, callers hold m_lock */
+inline bool MBHistorian::loadSegment(const QString& fileName)
+{
+    QFile* file = new QFile(m_dir.filePath(fileName));
+    const uchar* map = nullptr;
+    if (!file->open(QIODevice::ReadOnly) || file->size() < (qint64) padded(sizeof(TMBHistorySegment)) || //
+        !(map = file->map(0, file->size()))) {
+        qWarning() << "MBHIST: Can't map segment" << file->fileName();
+        delete file;
+        return false;
+    }
+
+    const TMBHistorySegment* header = reinterpret_cast<const TMBHistorySegment*>(map);
+    if (header->m_magic != MB_HISTORY_MAGIC || header->m_version != MB_HISTORY_VERSION) {
+        qWarning() << "MBHIST: Invalid segment" << file->fileName();
+        file->unmap(const_cast<uchar*>(map));
+        delete file;
+        return false;
+    }
+
+    /* blocks up to m_used are complete, also of a live segment */
+    const uint64_t used = qMin<uint64_t>(header->m_used, file->size());
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    TSegment segment = {file, map, {}, {}};
+    uint64_t offset = padded(sizeof(TMBHistorySegment));
+    while (offset + sizeof(TMBHistoryBlock) <= used) {
+        const TMBHistoryBlock* block = reinterpret_cast<const TMBHistoryBlock*>(map + offset);
+        const uint64_t length = padded(sizeof(TMBHistoryBlock)) + padded(block->m_bytes);
+        if (block->m_magic != MB_HISTORY_BLOCK || offset + length > used) {
+            qWarning() << "MBHIST: Corrupt block in" << file->fileName() << "at" << offset;
+            break;
+        }
+        indexBlock(segment, offset, block);
+        offset += length;
+    }
+    m_segments.append(segment);
+    return true;
+}
+
+inline void MBHistorian::releaseSegments()
+{
+    QMutexLocker lock(&m_lock);
+    foreach (const TSegment& segment, m_segments) {
+        if (segment.m_file) {
+            segment.m_file->unmap(const_cast<uchar*>(segment.m_map));
+            delete segment.m_file;
+        }
+    }
+    m_segments.clear();
+    m_blocks.clear();
+}
+
+/* restore open blocks, samples already in a segment are
+ * skipped (block written, journal not yet saved) */
+inline void MBHistorian::loadJournal()
+{
+    QFile file(m_dir.filePath(JOURNAL_FILE));
+    if (!file.exists()) {
+        return;
+    }
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "MBHIST: Can't read journal" << file.fileName();
+        return;
+    }
+
+    TMBHistoryBlock bh;
+    while (file.read(reinterpret_cast<char*>(&bh), sizeof(bh)) == sizeof(bh)) {
+        const QByteArray data = file.read(bh.m_bytes);
+        if (bh.m_magic != MB_HISTORY_BLOCK || data.size() != (int) bh.m_bytes) {
+            qWarning() << "MBHIST: Corrupt journal" << file.fileName();
+            break;
+        }
+
+        qint64 written = std::numeric_limits<qint64>::min();
+        for (const TSegment& segment : qAsConst(m_segments)) {
+            const TSummary summary = segment.m_summaries.value(bh.m_series);
+            if (summary.m_count > 0) {
+                written = qMax(written, summary.m_last);
+            }
+        }
+
+        const uint series = bh.m_series;
+        decode(reinterpret_cast<const uint8_t*>(data.constData()), data.size(), bh.m_count, //
+               [this, series, written](qint64 time, double value) {
+                   if (time > written) {
+                       collect({series, time, value});
+                   }
+               });
+    }
+}
+
+/* one record per open block, replaced as a whole */
+inline void MBHistorian::saveJournal(const QHash<uint, TOpenBlock>& blocks)
+{
+    QSaveFile file(m_dir.filePath(JOURNAL_FILE));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "MBHIST: Can't write journal" << file.fileName();
+        return;
+    }
+
+    for (auto it = blocks.constBegin(); it != blocks.constEnd(); ++it) {
+        const TOpenBlock& block = it.value();
+        if (block.m_encoder.count() == 0) {
+            continue;
+        }
+        const TMBHistoryBlock bh = {
+           MB_HISTORY_BLOCK,
+           it.key(),
+           block.m_encoder.count(),
+           (uint32_t) block.m_encoder.size(),
+           block.m_first,
+           block.m_last,
+           block.m_min,
+           block.m_max,
+           block.m_sum,
+        };
+        file.write(reinterpret_cast<const char*>(&bh), sizeof(bh));
+        file.write(reinterpret_cast<const char*>(block.m_encoder.data()), block.m_encoder.size());
+    }
+
+    if (!file.commit()) {
+        qWarning() << "MBHIST: Can't write journal" << file.fileName() << file.errorString();
+    }
+}
+
+inline void MBHistorian::indexBlock(TSegment& segment, quint64 offset, const TMBHistoryBlock* block)
+{
+    TBlockRef ref = {offset, {}};
+    merge(ref.m_summary, block);
+    merge(segment.m_summaries[block->m_series], block);
+    segment.m_blocks[block->m_series].append(ref);
+}
+
+inline void MBHistorian::merge(TSummary& summary, const TMBHistoryBlock* block)
+{
+    if (summary.m_count == 0) {
+        summary.m_first = block->m_first;
+        summary.m_last = block->m_last;
+        summary.m_min = block->m_min;
+        summary.m_max = block->m_max;
+        summary.m_sum = 0;
+    }
+    summary.m_count += block->m_count;
+    summary.m_first = qMin<qint64>(summary.m_first, block->m_first);
+    summary.m_last = qMax<qint64>(summary.m_last, block->m_last);
+    summary.m_min = qMin(summary.m_min, block->m_min);
+    summary.m_max = qMax(summary.m_max, block->m_max);
+    summary.m_sum += block->m_sum;
+}
+
+inline void MBHistorian::merge(TBucket& bucket, const TSummary& summary)
+{
+    bucket.m_count += summary.m_count;
+    bucket.m_min = qMin(bucket.m_min, summary.m_min);
+    bucket.m_max = qMax(bucket.m_max, summary.m_max);
+    bucket.m_sum += summary.m_sum;
+}
+
+inline void MBHistorian::decode(const uint8_t* data, size_t size, uint32_t count, const std::function<void(qint64, double)>& visit)
+{
+    MBGorillaDecoder decoder(data, size, count);
+    int64_t time;
+    double value;
+    while (decoder.next(&time, &value)) {
+        visit(time, value);
+    }
+}
+
+inline void MBHistorian::decode(const TMBHistoryBlock* block, const std::function<void(qint64, double)>& visit)
+{
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(block) + padded(sizeof(TMBHistoryBlock));
+    decode(data, block->m_bytes, block->m_count, visit);
+}
+
+inline bool MBHistorian::openSegment()
+{
+    m_file.setFileName(m_dir.filePath(segmentFileName(++m_segmentNo)));
+    if (!m_file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+        qWarning() << "MBHIST: Can't create segment" << m_file.fileName();
+        return false;
+    }
+    if (!m_file.resize(m_config.m_segmentSize) || //
+        !(m_map = m_file.map(0, m_config.m_segmentSize))) {
+        qWarning() << "MBHIST: Can't map segment" << m_file.fileName() << m_file.errorString();
+        m_file.close();
+        m_file.remove();
+        return false;
+    }
+
+    TMBHistorySegment* header = reinterpret_cast<TMBHistorySegment*>(m_map);
+    header->m_magic = MB_HISTORY_MAGIC;
+    header->m_version = MB_HISTORY_VERSION;
+    header->m_created = QDateTime::currentMSecsSinceEpoch();
+    header->m_capacity = m_config.m_segmentSize;
+    header->m_used = padded(sizeof(TMBHistorySegment));
+    header->m_blocks = 0;
+    header->m_reserved = 0;
+
+    m_segments.append({nullptr, m_map, {}, {}});
+    return true;
+}
+
+/* unmap, cut file to the used size and map read only for queries */
+inline void MBHistorian::closeSegment()
+{
+    if (!m_map) {
+        return;
+    }
+    TMBHistorySegment* header = reinterpret_cast<TMBHistorySegment*>(m_map);
+    const qint64 used = header->m_used;
+    header->m_capacity = used;
+    m_file.unmap(m_map);
+    m_map = nullptr;
+    m_file.resize(used);
+    m_file.close();
+
+    QFile* file = new QFile(m_file.fileName());
+    const uchar* map = nullptr;
+    if (!file->open(QIODevice::ReadOnly) || !(map = file->map(0, used))) {
+        qWarning() << "MBHIST: Can't map closed segment" << file->fileName();
+        delete file;
+        file = nullptr;
+    }
+    m_segments.last().m_file = file;
+    m_segments.last().m_map = map;
+}
+
+inline void MBHistorian::writeBlock(uint series, TOpenBlock& block)
+{
+    const uint64_t needed = padded(sizeof(TMBHistoryBlock)) + padded(block.m_encoder.size());
+    TMBHistorySegment* header = reinterpret_cast<TMBHistorySegment*>(m_map);
+
+    /* rotate segment when full */
+    if (!header || header->m_used + needed > header->m_capacity) {
+        closeSegment();
+        if (!openSegment()) {
+            block.m_encoder.clear();
+            return;
+        }
+        header = reinterpret_cast<TMBHistorySegment*>(m_map);
+        /* queued, receivers may query */
+        const QString fileName = m_file.fileName();
+        QMetaObject::invokeMethod(
+           this,
+           [this, fileName]() {
+               emit segmentRotated(fileName);
+           },
+           Qt::QueuedConnection);
+        if (header->m_used + needed > header->m_capacity) {
+            qWarning() << "MBHIST: Block exceeds segment size, dropped." << series;
+            block.m_encoder.clear();
+            return;
+        }
+    }
+
+    uchar* dest = m_map + header->m_used;
+    TMBHistoryBlock* bh = reinterpret_cast<TMBHistoryBlock*>(dest);
+    bh->m_magic = MB_HISTORY_BLOCK;
+    bh->m_series = series;
+    bh->m_count = block.m_encoder.count();
+    bh->m_bytes = block.m_encoder.size();
+    bh->m_first = block.m_first;
+    bh->m_last = block.m_last;
+    bh->m_min = block.m_min;
+    bh->m_max = block.m_max;
+    bh->m_sum = block.m_sum;
+    std::memcpy(dest + padded(sizeof(TMBHistoryBlock)), block.m_encoder.data(), block.m_encoder.size());
+
+    /* publish block after its content */
+    std::atomic_thread_fence(std::memory_order_release);
+    const uint64_t offset = header->m_used;
+    header->m_used += needed;
+    header->m_blocks++;
+
+    indexBlock(m_segments.last(), offset, bh);
+
+    block.m_encoder.clear();
+}
+
+inline void MBHistorian::collect(const TSample& sample)
+{
+    TOpenBlock& block = m_blocks[sample.m_series];
+    if (block.m_encoder.count() == 0) {
+        block.m_first = sample.m_time;
+        block.m_min = std::numeric_limits<double>::max();
+        block.m_max = std::numeric_limits<double>::lowest();
+        block.m_sum = 0;
+    }
+
+    block.m_encoder.append(sample.m_time, sample.m_value);
+    block.m_last = sample.m_time;
+    block.m_min = qMin(block.m_min, sample.m_value);
+    block.m_max = qMax(block.m_max, sample.m_value);
+    block.m_sum += sample.m_value;
+
+    if (!m_readOnly && block.m_encoder.count() >= m_config.m_blockSamples) {
+        writeBlock(sample.m_series, block);
+    }
+}
+
+inline QString MBHistorian::segmentFileName(uint number)
+{
+    return QStringLiteral("seg-%1.mbh").arg(number, 8, 10, QChar('0'));
+}
+
+/* -------------------------------------------------------
+ * Event Methods
+ * ------------------------------------------------------- */
+
+void MBHistorian::onFlushTimer()
+{
+    flush();
+}
@@ -0,0 +1,298 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <QDir>
+#include <QFile>
+#include <QFuture>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QTextStream>
+#include <QTimer>
+#include <QVector>
+#include <functional>
+#include <mbgorilla.h>
+
+#define MB_HISTORY_MAGIC   0x5348424du // 'MBHS'
+#define MB_HISTORY_BLOCK   0x4b4c4242u // 'BBLK'
+#define MB_HISTORY_VERSION 1
+
+/**
+ * Segment file layout, a header followed by blocks. Each
+ * block holds compressed samples of one series and their
+ * summary. Blocks are appended in mapped memory, m_used is
+ * advanced after a block is complete.
+ */
+typedef struct {
+    uint32_t m_magic;
+    uint32_t m_version;
+    /* creation time in ms since epoch */
+    int64_t m_created;
+    /* file capacity and bytes in use */
+    uint64_t m_capacity;
+    uint64_t m_used;
+    uint32_t m_blocks;
+    uint32_t m_reserved;
+} TMBHistorySegment;
+
+typedef struct {
+    uint32_t m_magic;
+    uint32_t m_series;
+    uint32_t m_count;
+    /* payload size, block is padded to 8 bytes */
+    uint32_t m_bytes;
+    int64_t m_first;
+    int64_t m_last;
+    double m_min;
+    double m_max;
+    double m_sum;
+} TMBHistoryBlock;
+
+/**
+ * @brief The embedded historian
+ * Append-only store of timestamped samples per series in
+ * memory mapped, size rotated segment files. Samples are
+ * collected per series into Gorilla compressed blocks and
+ * copied into the mapped segment when a block is full or
+ * on close, no syscall per sample. Blocks being filled are
+ * saved to a small journal on flush and restored on open.
+ * Queries use the min/max/sum/count summaries of segments
+ * and blocks, only blocks spanning a bucket border are
+ * decoded. Opened read only by other processes, queries
+ * see blocks written until open.
+ */
+class MBHistorian: public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef struct {
+        uint m_series;
+        /* ms since epoch */
+        qint64 m_time;
+        double m_value;
+    } TSample;
+
+    typedef struct {
+        qint64 m_time;
+        double m_value;
+    } TPoint;
+
+    typedef struct {
+        /* bucket start time */
+        qint64 m_time;
+        uint m_count;
+        double m_min;
+        double m_max;
+        double m_sum;
+    } TBucket;
+
+    typedef struct Config {
+        /* segment file size in bytes */
+        qint64 m_segmentSize;
+        /* samples per block */
+        uint m_blockSamples;
+        /* open blocks journaled at least every ms */
+        int m_flushInterval;
+    } TConfig;
+
+    /**
+     * @brief Shared historian of the application
+     * @return The historian instance, closed until opened
+     */
+    static MBHistorian* instance();
+    /**
+     * @brief seriesName
+     * @return Canonical series name "port/server/kindN"
+     */
+    static QString seriesName(const QString& port, quint8 server, const char* kind, uint index);
+    /**
+     * @brief Default constructor
+     * @param parent
+     */
+    explicit MBHistorian(QObject* parent = nullptr);
+    /**
+     * Destructor flushes and closes
+     */
+    ~MBHistorian();
+    /**
+     * @brief config
+     * @return
+     */
+    const TConfig& config() const;
+    /**
+     * @brief setConfig
+     * @param config Takes effect on next open
+     */
+    void setConfig(const TConfig& config);
+    /**
+     * @brief open
+     * @param path Directory of the segment files
+     * @param readOnly Query only, no recording
+     * @return true if ready
+     */
+    bool open(const QString& path, bool readOnly = false);
+    /**
+     * @brief close
+     */
+    void close();
+    /**
+     * @brief isOpen
+     * @return
+     */
+    bool isOpen() const;
+    /**
+     * @brief series
+     * @param name
+     * @return Id of the series, created if not known
+     */
+    uint series(const QString& name);
+    /**
+     * @brief findSeries
+     * @param name
+     * @return Id of the series, 0 if not known
+     */
+    uint findSeries(const QString& name) const;
+    /**
+     * @brief seriesNames
+     * @return Known series by id
+     */
+    QHash<uint, QString> seriesNames() const;
+    /**
+     * @brief range
+     * @param series
+     * @param from Start time in ms, inclusive
+     * @param to End time in ms, exclusive
+     * @return Raw samples in time order
+     */
+    QVector<TPoint> range(uint series, qint64 from, qint64 to);
+    /**
+     * @brief downsample
+     * @param series
+     * @param from Start time in ms, inclusive
+     * @param to End time in ms, exclusive
+     * @param step Bucket width in ms
+     * @return Non empty buckets in time order
+     */
+    QVector<TBucket> downsample(uint series, qint64 from, qint64 to, qint64 step);
+    /**
+     * @brief downsampleAsync
+     * Runs the query in the global thread pool
+     */
+    QFuture<QVector<TBucket>> downsampleAsync(uint series, qint64 from, qint64 to, qint64 step);
+    /**
+     * @brief exportCsv
+     * Query entry point of external tools, CSV with header
+     * @param series Name of the series
+     * @param from Start time in ms, inclusive
+     * @param to End time in ms, exclusive
+     * @param step Bucket width in ms, 0 = raw samples
+     * @param out Receives the rows
+     * @return false if the series is unknown
+     */
+    bool exportCsv(const QString& series, qint64 from, qint64 to, qint64 step, QTextStream& out);
+    /**
+     * @brief append
+     * @param samples Batch of samples, any series
+     */
+    void append(const QVector<TSample>& samples);
+    /**
+     * @brief append
+     * @param series
+     * @param time
+     * @param value
+     */
+    void append(uint series, qint64 time, double value);
+    /**
+     * @brief flush
+     * Save open blocks to the journal, they go to the
+     * segment when full or on close
+     */
+    void flush();
+
+signals:
+    /**
+     * @brief segmentRotated
+     * @param fileName New segment file
+     */
+    void segmentRotated(const QString& fileName);
+
+private slots:
+    void onFlushTimer();
+
+private:
+    typedef struct {
+        MBGorillaEncoder m_encoder;
+        qint64 m_first;
+        qint64 m_last;
+        double m_min;
+        double m_max;
+        double m_sum;
+    } TOpenBlock;
+
+    typedef struct {
+        uint m_count;
+        qint64 m_first;
+        qint64 m_last;
+        double m_min;
+        double m_max;
+        double m_sum;
+    } TSummary;
+
+    typedef struct {
+        /* offset of block header in segment */
+        quint64 m_offset;
+        TSummary m_summary;
+    } TBlockRef;
+
+    typedef struct {
+        QFile* m_file;
+        const uchar* m_map;
+        /* per series summary and blocks */
+        QHash<uint, TSummary> m_summaries;
+        QHash<uint, QVector<TBlockRef>> m_blocks;
+    } TSegment;
+
+    TConfig m_config;
+    QDir m_dir;
+    bool m_isOpen;
+    bool m_readOnly;
+    /* guards index, open blocks and catalog against queries */
+    mutable QMutex m_lock;
+    /* block index, current segment last */
+    QVector<TSegment> m_segments;
+    /* series catalog */
+    QHash<QString, uint> m_series;
+    QHash<uint, QString> m_names;
+    /* blocks being filled */
+    QHash<uint, TOpenBlock> m_blocks;
+    /* current segment */
+    QFile m_file;
+    uchar* m_map;
+    uint m_segmentNo;
+    QTimer m_flushTimer;
+
+private:
+    inline bool loadCatalog();
+    inline bool loadSegment(const QString& fileName);
+    inline void releaseSegments();
+    inline void saveJournal(const QHash<uint, TOpenBlock>& blocks);
+    inline void indexBlock(TSegment& segment, quint64 offset, const TMBHistoryBlock* block);
+    static inline void merge(TSummary& summary, const TMBHistoryBlock* block);
+    static inline void merge(TBucket& bucket, const TSummary& summary);
+    static inline void decode(const uint8_t* data, size_t size, uint32_t count, const std::function<void(qint64, double)>& visit);
+    static inline void decode(const TMBHistoryBlock* block, const std::function<void(qint64, double)>& visit);
+    /* callers hold m_lock */
+    inline void loadJournal();
+    inline bool openSegment();
+    inline void closeSegment();
+    inline void collect(const TSample& sample);
+    inline void writeBlock(uint series, TOpenBlock& block);
+    static inline QString segmentFileName(uint number);
+};
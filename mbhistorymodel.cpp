@@ -0,0 +1,120 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#include <QDateTime>
+#include <QDebug>
+#include <mbhistorymodel.h>
+
+MBHistoryModel::MBHistoryModel(MBHistorian* historian, QObject* parent)
+    : QAbstractTableModel {parent}
+    , m_historian(historian)
+    , m_buckets()
+    , m_watcher(this)
+{
+    Q_ASSERT_X(m_historian != 0L, Q_FUNC_INFO, "Null pointer historian object!");
+
+    connect(&m_watcher, &QFutureWatcher<QVector<MBHistorian::TBucket>>::finished, this, &MBHistoryModel::onQueryFinished);
+}
+
+/* -------------------------------------------------------
+ * Api Methods
+ * ------------------------------------------------------- */
+
+void MBHistoryModel::query(const QString& series, qint64 from, qint64 to, qint64 step)
+{
+    const uint id = m_historian->findSeries(series);
+    if (!id) {
+        qWarning() << "MBHIST: Unknown series" << series;
+        beginResetModel();
+        m_buckets.clear();
+        endResetModel();
+        emit queryFinished(0);
+        return;
+    }
+
+    /* a newer query replaces a running one */
+    m_watcher.setFuture(m_historian->downsampleAsync(id, from, to, step));
+}
+
+const QVector<MBHistorian::TBucket>& MBHistoryModel::buckets() const
+{
+    return m_buckets;
+}
+
+int MBHistoryModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : m_buckets.count();
+}
+
+int MBHistoryModel::columnCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : ColumnSamples + 1;
+}
+
+QVariant MBHistoryModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_buckets.count() || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    const MBHistorian::TBucket& bucket = m_buckets[index.row()];
+    switch (index.column()) {
+        case ColumnTime: {
+            return QDateTime::fromMSecsSinceEpoch(bucket.m_time);
+        }
+        case ColumnMin: {
+            return bucket.m_min;
+        }
+        case ColumnMax: {
+            return bucket.m_max;
+        }
+        case ColumnAverage: {
+            return bucket.m_sum / bucket.m_count;
+        }
+        case ColumnSamples: {
+            return bucket.m_count;
+        }
+    }
+    return QVariant();
+}
+
+QVariant MBHistoryModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+
+    switch (section) {
+        case ColumnTime: {
+            return tr("Time");
+        }
+        case ColumnMin: {
+            return tr("Min");
+        }
+        case ColumnMax: {
+            return tr("Max");
+        }
+        case ColumnAverage: {
+            return tr("Average");
+        }
+        case ColumnSamples: {
+            return tr("Samples");
+        }
+    }
+    return QVariant();
+}
+
+/* -------------------------------------------------------
+ * Event Methods
+ * ------------------------------------------------------- */
+
+void MBHistoryModel::onQueryFinished()
+{
+    beginResetModel();
+    m_buckets = m_watcher.result();
+    endResetModel();
+    emit queryFinished(m_buckets.count());
+}
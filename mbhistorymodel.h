@@ -0,0 +1,72 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <QAbstractTableModel>
+#include <QFutureWatcher>
+#include <QObject>
+#include <QVector>
+#include <mbhistorian.h>
+
+/**
+ * @brief The downsampled history of one series for views
+ * Runs the historian query in the thread pool and resets
+ * the model when the buckets are ready.
+ */
+class MBHistoryModel: public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum TColumn {
+        ColumnTime = 0,
+        ColumnMin,
+        ColumnMax,
+        ColumnAverage,
+        ColumnSamples,
+    };
+    Q_ENUM(TColumn)
+
+    /**
+     * @brief Default constructor
+     * @param historian
+     * @param parent
+     */
+    explicit MBHistoryModel(MBHistorian* historian, QObject* parent = nullptr);
+    /**
+     * @brief query
+     * @param series Name of the series
+     * @param from Start time in ms
+     * @param to End time in ms
+     * @param step Bucket width in ms
+     */
+    void query(const QString& series, qint64 from, qint64 to, qint64 step);
+    /**
+     * @brief buckets
+     * @return Current result
+     */
+    const QVector<MBHistorian::TBucket>& buckets() const;
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+signals:
+    /**
+     * @brief queryFinished
+     * @param count Number of buckets
+     */
+    void queryFinished(int count);
+
+private slots:
+    void onQueryFinished();
+
+private:
+    MBHistorian* m_historian;
+    QVector<MBHistorian::TBucket> m_buckets;
+    QFutureWatcher<QVector<MBHistorian::TBucket>> m_watcher;
+};
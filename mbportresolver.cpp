@@ -0,0 +1,140 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <mbportresolver.h>
+
+#define DEVICE_PATH "/dev"
+
+MBPortResolver* MBPortResolver::instance()
+{
+    static MBPortResolver* resolver = nullptr;
+    if (!resolver) {
+        resolver = new MBPortResolver(qApp);
+    }
+    return resolver;
+}
+
+MBPortResolver::MBPortResolver(QObject* parent)
+    : QObject {parent}
+    , m_watcher(this)
+    , m_lock()
+    , m_isValid(false)
+    , m_links()
+    , m_ports()
+    , m_resolved()
+{
+    if (!m_watcher.addPath(DEVICE_PATH)) {
+        qWarning() << "MBPORT: Can't watch" << DEVICE_PATH << "- cache disabled.";
+    }
+    connect(&m_watcher, &QFileSystemWatcher::directoryChanged, this, &MBPortResolver::onDirectoryChanged);
+}
+
+MBPortResolver::~MBPortResolver()
+{
+}
+
+/* -------------------------------------------------------
+ * Api Methods
+ * ------------------------------------------------------- */
+
+QSerialPortInfo MBPortResolver::resolve(const QString& portName)
+{
+    QMutexLocker lock(&m_lock);
+
+    /* no watch, no cache */
+    if (m_watcher.directories().isEmpty()) {
+        m_isValid = false;
+    }
+
+    if (m_isValid) {
+        auto it = m_resolved.constFind(portName);
+        if (it != m_resolved.constEnd()) {
+            return it.value();
+        }
+    }
+    else {
+        scan();
+    }
+
+    /* find symbolic link to real port name */
+    QString name = portName;
+    for (auto it = m_links.constBegin(); it != m_links.constEnd(); it++) {
+        if (it.key().contains(portName)) {
+            qInfo() << "MBPORT: Using device:" << it.value() << "for" << portName;
+            name = it.value();
+            break;
+        }
+    }
+
+    /* lookup known serial ports */
+    QSerialPortInfo spi;
+    foreach (auto pi, m_ports) {
+        if (pi.portName().contains(name)) {
+            qInfo() << "MBPORT: Using device:" << pi.systemLocation();
+            spi = pi;
+            break;
+        }
+    }
+
+    m_resolved[portName] = spi;
+    return spi;
+}
+
+QList<QSerialPortInfo> MBPortResolver::availablePorts()
+{
+    QMutexLocker lock(&m_lock);
+    if (!m_isValid || m_watcher.directories().isEmpty()) {
+        scan();
+    }
+    return m_ports;
+}
+
+void MBPortResolver::invalidate()
+{
+    QMutexLocker lock(&m_lock);
+    m_isValid = false;
+}
+
+/* -------------------------------------------------------
+ * Private Methods
+ * ------------------------------------------------------- */
+
+inline void MBPortResolver::scan()
+{
+    QDir devPath(DEVICE_PATH);
+
+    m_links.clear();
+    m_resolved.clear();
+
+    QFileInfoList fil = devPath.entryInfoList(QStringList() << "ttyMB*");
+    foreach (auto fi, fil) {
+        if (fi.isSymLink()) {
+            QString sym = fi.absoluteFilePath();
+            QString tgt = fi.symLinkTarget();
+            qInfo() << "MBPORT: " << sym << " -> " << tgt;
+            QString dev = tgt.replace(devPath.absolutePath(), "");
+            m_links[sym] = dev.replace("/", "");
+        }
+    }
+
+    m_ports = QSerialPortInfo::availablePorts();
+    m_isValid = true;
+}
+
+/* -------------------------------------------------------
+ * Event Methods
+ * ------------------------------------------------------- */
+
+void MBPortResolver::onDirectoryChanged(const QString&)
+{
+    invalidate();
+    emit portsChanged();
+}
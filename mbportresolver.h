@@ -0,0 +1,81 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QSerialPortInfo>
+
+/**
+ * @brief The serial port resolution cache
+ * Resolves configured port names and ttyMB* symlinks to
+ * known serial ports. The scan of /dev and the serial port
+ * enumeration runs once and is repeated only after /dev
+ * changed (inotify via QFileSystemWatcher).
+ */
+class MBPortResolver: public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Shared resolver of the application
+     * @return The resolver instance
+     */
+    static MBPortResolver* instance();
+    /**
+     * @brief Default constructor
+     * @param parent
+     */
+    explicit MBPortResolver(QObject* parent = nullptr);
+    /**
+     * Destructor
+     */
+    ~MBPortResolver();
+    /**
+     * @brief resolve
+     * @param portName Configured port or ttyMB* symlink name
+     * @return Serial port info, null if port not present
+     */
+    QSerialPortInfo resolve(const QString& portName);
+    /**
+     * @brief availablePorts
+     * @return Cached list of serial ports
+     */
+    QList<QSerialPortInfo> availablePorts();
+    /**
+     * @brief invalidate
+     * Drop cached results, next resolve scans again
+     */
+    void invalidate();
+
+signals:
+    /**
+     * @brief portsChanged
+     * Device nodes in /dev were added or removed
+     */
+    void portsChanged();
+
+private slots:
+    void onDirectoryChanged(const QString& path);
+
+private:
+    QFileSystemWatcher m_watcher;
+    QMutex m_lock;
+    bool m_isValid;
+    /* ttyMB* symlink name -> device name */
+    QHash<QString, QString> m_links;
+    /* known serial ports */
+    QList<QSerialPortInfo> m_ports;
+    /* resolved configured names */
+    QHash<QString, QSerialPortInfo> m_resolved;
+
+private:
+    inline void scan();
+};
@@ -0,0 +1,251 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QMutexLocker>
+#include <cerrno>
+#include <cstddef>
+#include <fcntl.h>
+#include <mbprocessimage.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MBProcessImage* MBProcessImage::instance()
+{
+    static MBProcessImage* image = nullptr;
+    if (!image) {
+        image = new MBProcessImage(qApp);
+        image->attach();
+    }
+    return image;
+}
+
+MBProcessImage::MBProcessImage(QObject* parent)
+    : QObject {parent}
+    , m_name()
+    , m_fd(-1)
+    , m_image(nullptr)
+    , m_lock()
+{
+}
+
+MBProcessImage::~MBProcessImage()
+{
+    detach();
+}
+
+/* -------------------------------------------------------
+ * Api Methods
+ * ------------------------------------------------------- */
+
+bool MBProcessImage::attach(const QString& name)
+{
+    QMutexLocker lock(&m_lock);
+
+    if (m_image) {
+        return true;
+    }
+
+    const QByteArray path = name.toLocal8Bit();
+    if ((m_fd = shm_open(path.constData(), O_CREAT | O_RDWR, 0644)) < 0) {
+        qWarning() << "MBIMAGE: shm_open failed:" << name << strerror(errno);
+        return false;
+    }
+
+    if (ftruncate(m_fd, sizeof(TMBImage)) < 0) {
+        qWarning() << "MBIMAGE: ftruncate failed:" << name << strerror(errno);
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    void* addr = mmap(nullptr, sizeof(TMBImage), PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (addr == MAP_FAILED) {
+        qWarning() << "MBIMAGE: mmap failed:" << name << strerror(errno);
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    /* fresh image, stale blocks of a previous run dropped */
+    m_image = static_cast<TMBImage*>(addr);
+    std::memset(addr, 0, sizeof(TMBImage));
+    m_image->m_version = MB_IMAGE_VERSION;
+    m_image->m_blockCount = MB_IMAGE_DEVICES;
+    m_image->m_blockSize = sizeof(TMBImageBlock);
+    m_image->m_generation.store(0, std::memory_order_relaxed);
+    /* magic last, readers check it before use */
+    std::atomic_thread_fence(std::memory_order_release);
+    m_image->m_magic = MB_IMAGE_MAGIC;
+    m_name = name;
+
+    qDebug() << "MBIMAGE: Process image attached:" << name << sizeof(TMBImage) << "bytes";
+    return true;
+}
+
+void MBProcessImage::detach()
+{
+    QMutexLocker lock(&m_lock);
+
+    if (m_image) {
+        m_image->m_magic = 0;
+        munmap(m_image, sizeof(TMBImage));
+        m_image = nullptr;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        shm_unlink(m_name.toLocal8Bit().constData());
+        m_fd = -1;
+    }
+}
+
+bool MBProcessImage::isAttached() const
+{
+    return m_image != nullptr;
+}
+
+void MBProcessImage::publish(const QString& port, quint8 server, TTable table, quint16 index, const QVector<quint16>& values)
+{
+    QMutexLocker lock(&m_lock);
+
+    TMBImageBlock* b;
+    if (!(b = block(port, server))) {
+        return;
+    }
+
+    beginWrite(b);
+    for (int i = 0; i < values.count() && (index + i) < MB_IMAGE_POINTS; i++) {
+        switch (table) {
+            case Coils: {
+                b->m_coils[index + i] = (values[i] != 0);
+                break;
+            }
+            case DiscreteInputs: {
+                b->m_inputs[index + i] = (values[i] != 0);
+                break;
+            }
+            case HoldingRegisters: {
+                b->m_holding[index + i] = values[i];
+                break;
+            }
+            case InputRegisters: {
+                b->m_registers[index + i] = values[i];
+                break;
+            }
+        }
+    }
+    endWrite(b);
+}
+
+void MBProcessImage::publishAnalog(const QString& port, quint8 server, quint16 index, const QVector<float>& values)
+{
+    QMutexLocker lock(&m_lock);
+
+    TMBImageBlock* b;
+    if (!(b = block(port, server))) {
+        return;
+    }
+
+    beginWrite(b);
+    for (int i = 0; i < values.count() && (index + i) < MB_IMAGE_POINTS; i++) {
+        b->m_analog[index + i] = values[i];
+    }
+    endWrite(b);
+}
+
+void MBProcessImage::publishFirmware(const QString& port, quint8 server, quint16 version)
+{
+    QMutexLocker lock(&m_lock);
+
+    TMBImageBlock* b;
+    if (!(b = block(port, server))) {
+        return;
+    }
+
+    beginWrite(b);
+    b->m_firmware = version;
+    endWrite(b);
+}
+
+void MBProcessImage::release(const QString& port, quint8 server)
+{
+    QMutexLocker lock(&m_lock);
+
+    if (!m_image) {
+        return;
+    }
+
+    const QByteArray name = port.toLocal8Bit().left(MB_IMAGE_PORTLEN - 1);
+    for (int i = 0; i < MB_IMAGE_DEVICES; i++) {
+        TMBImageBlock* b = &m_image->m_blocks[i];
+        if (b->m_used && b->m_server == server && name == b->m_port) {
+            beginWrite(b);
+            b->m_used = 0;
+            endWrite(b);
+            return;
+        }
+    }
+}
+
+/* -------------------------------------------------------
+ * Private Methods
+ * ------------------------------------------------------- */
+
+/* find block of device or assign a free one */
+inline TMBImageBlock* MBProcessImage::block(const QString& port, quint8 server)
+{
+    if (!m_image) {
+        return nullptr;
+    }
+
+    const QByteArray name = port.toLocal8Bit().left(MB_IMAGE_PORTLEN - 1);
+    TMBImageBlock* unused = nullptr;
+    for (int i = 0; i < MB_IMAGE_DEVICES; i++) {
+        TMBImageBlock* b = &m_image->m_blocks[i];
+        if (!b->m_used) {
+            if (!unused) {
+                unused = b;
+            }
+            continue;
+        }
+        if (b->m_server == server && name == b->m_port) {
+            return b;
+        }
+    }
+
+    if (!unused) {
+        qWarning() << "MBIMAGE: No free device block for" << port << server;
+        return nullptr;
+    }
+
+    /* clear tables of previous owner */
+    beginWrite(unused);
+    std::memset(unused->m_port, 0, sizeof(TMBImageBlock) - offsetof(TMBImageBlock, m_port));
+    std::memcpy(unused->m_port, name.constData(), name.size());
+    unused->m_server = server;
+    unused->m_firmware = 0;
+    unused->m_used = 1;
+    endWrite(unused);
+    return unused;
+}
+
+inline void MBProcessImage::beginWrite(TMBImageBlock* block)
+{
+    uint32_t seq = block->m_sequence.load(std::memory_order_relaxed);
+    block->m_sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+inline void MBProcessImage::endWrite(TMBImageBlock* block)
+{
+    block->m_updated = QDateTime::currentMSecsSinceEpoch();
+    uint32_t seq = block->m_sequence.load(std::memory_order_relaxed);
+    block->m_sequence.store(seq + 1, std::memory_order_release);
+    m_image->m_generation.fetch_add(1, std::memory_order_relaxed);
+}
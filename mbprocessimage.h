@@ -0,0 +1,167 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#define MB_IMAGE_NAME    "/modbus-rs485-rtu-m"
+#define MB_IMAGE_MAGIC   0x4d42494du // 'MBIM'
+#define MB_IMAGE_VERSION 1
+#define MB_IMAGE_DEVICES 32
+#define MB_IMAGE_POINTS  64
+#define MB_IMAGE_PORTLEN 32
+
+/**
+ * Shared memory layout, plain data for use by readers in
+ * other processes. Table indices are relative to the data
+ * block the driver of the device polls (channel numbers).
+ */
+typedef struct {
+    /* seqlock, odd while the block is written */
+    std::atomic<uint32_t> m_sequence;
+    /* block assigned to a device */
+    uint8_t m_used;
+    uint8_t m_server;
+    uint16_t m_firmware;
+    char m_port[MB_IMAGE_PORTLEN];
+    /* CLOCK_REALTIME of last update in ms */
+    int64_t m_updated;
+    /* bit tables, one byte per point */
+    uint8_t m_coils[MB_IMAGE_POINTS];
+    uint8_t m_inputs[MB_IMAGE_POINTS];
+    /* register tables */
+    uint16_t m_holding[MB_IMAGE_POINTS];
+    uint16_t m_registers[MB_IMAGE_POINTS];
+    /* converted analog values */
+    float m_analog[MB_IMAGE_POINTS];
+} TMBImageBlock;
+
+typedef struct {
+    uint32_t m_magic;
+    uint32_t m_version;
+    uint32_t m_blockCount;
+    uint32_t m_blockSize;
+    /* bumped on every block update */
+    std::atomic<uint64_t> m_generation;
+    TMBImageBlock m_blocks[MB_IMAGE_DEVICES];
+} TMBImage;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "seqlock needs lock free atomics");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "generation needs lock free atomics");
+
+/**
+ * @brief Consistent copy of a block for readers
+ * Lock free, retries while the writer is active.
+ * @param block Block in the mapped image
+ * @param out Snapshot, sequence holds the version read
+ */
+inline void mbImageSnapshot(const TMBImageBlock* block, TMBImageBlock* out)
+{
+    uint32_t s1, s2;
+    do {
+        s1 = block->m_sequence.load(std::memory_order_acquire);
+        if (s1 & 1) {
+            continue;
+        }
+        std::memcpy((void*) out, (const void*) block, sizeof(TMBImageBlock));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        s2 = block->m_sequence.load(std::memory_order_relaxed);
+    } while ((s1 & 1) || s1 != s2);
+    out->m_sequence.store(s1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief The process image publisher
+ * Publishes device state in POSIX shared memory. Each device
+ * (port, server) gets a fixed block guarded by a seqlock, so
+ * readers in other processes take snapshots without locks,
+ * sockets or bus access. Single writer, this process.
+ */
+class MBProcessImage: public QObject
+{
+    Q_OBJECT
+
+public:
+    enum TTable {
+        Coils,
+        DiscreteInputs,
+        HoldingRegisters,
+        InputRegisters,
+    };
+    Q_ENUM(TTable)
+
+    /**
+     * @brief Shared image of the application
+     * @return The image instance, attached on first use
+     */
+    static MBProcessImage* instance();
+    /**
+     * @brief Default constructor
+     * @param parent
+     */
+    explicit MBProcessImage(QObject* parent = nullptr);
+    /**
+     * Destructor unmaps and unlinks the image
+     */
+    ~MBProcessImage();
+    /**
+     * @brief attach
+     * @param name POSIX shared memory object name
+     * @return true if image is mapped
+     */
+    bool attach(const QString& name = MB_IMAGE_NAME);
+    /**
+     * @brief detach
+     */
+    void detach();
+    /**
+     * @brief isAttached
+     * @return
+     */
+    bool isAttached() const;
+    /**
+     * @brief publish
+     * Write register or bit values of a device table
+     * @param port
+     * @param server
+     * @param table
+     * @param index First point of values
+     * @param values
+     */
+    void publish(const QString& port, quint8 server, TTable table, quint16 index, const QVector<quint16>& values);
+    /**
+     * @brief publishAnalog
+     * Write converted analog values of a device
+     */
+    void publishAnalog(const QString& port, quint8 server, quint16 index, const QVector<float>& values);
+    /**
+     * @brief publishFirmware
+     * Write firmware version of a device
+     */
+    void publishFirmware(const QString& port, quint8 server, quint16 version);
+    /**
+     * @brief release
+     * Free the block of a device no longer polled
+     */
+    void release(const QString& port, quint8 server);
+
+private:
+    QString m_name;
+    int m_fd;
+    TMBImage* m_image;
+    QMutex m_lock;
+
+private:
+    inline TMBImageBlock* block(const QString& port, quint8 server);
+    inline void beginWrite(TMBImageBlock* block);
+    inline void endWrite(TMBImageBlock* block);
+};
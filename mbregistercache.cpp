@@ -0,0 +1,96 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <mbregistercache.h>
+
+MBRegisterCache::MBRegisterCache()
+    : m_lock()
+    , m_clock()
+    , m_entries()
+{
+    m_clock.start();
+}
+
+/* -------------------------------------------------------
+ * Api Methods
+ * ------------------------------------------------------- */
+
+void MBRegisterCache::update(uint server, const QModbusDataUnit& unit)
+{
+    if (!unit.isValid()) {
+        return;
+    }
+
+    QWriteLocker lock(&m_lock);
+    const qint64 now = m_clock.elapsed();
+    for (uint i = 0; i < unit.valueCount(); i++) {
+        const quint16 address = static_cast<quint16>(unit.startAddress() + i);
+        m_entries.insert(key(server, unit.registerType(), address), {unit.value(i), now});
+    }
+}
+
+bool MBRegisterCache::lookup( //
+   uint server,
+   QModbusDataUnit::RegisterType type,
+   quint16 start,
+   quint16 count,
+   qint64 maxAge,
+   QVector<quint16>* values) const
+{
+    QReadLocker lock(&m_lock);
+    const qint64 now = m_clock.elapsed();
+
+    QVector<quint16> result;
+    result.reserve(count);
+    for (quint16 i = 0; i < count; i++) {
+        auto it = m_entries.constFind(key(server, type, start + i));
+        if (it == m_entries.constEnd() || (now - it->m_stamp) > maxAge) {
+            return false;
+        }
+        result.append(it->m_value);
+    }
+
+    if (values) {
+        values->swap(result);
+    }
+    return true;
+}
+
+void MBRegisterCache::invalidate(uint server)
+{
+    QWriteLocker lock(&m_lock);
+    if (server == 0) {
+        m_entries.clear();
+        return;
+    }
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if ((it.key() >> 24) == server) {
+            it = m_entries.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void MBRegisterCache::invalidate(uint server, QModbusDataUnit::RegisterType type, quint16 start, quint16 count)
+{
+    QWriteLocker lock(&m_lock);
+    for (uint i = 0; i < count; i++) {
+        m_entries.remove(key(server, type, static_cast<quint16>(start + i)));
+    }
+}
+
+/* -------------------------------------------------------
+ * Private Methods
+ * ------------------------------------------------------- */
+
+inline quint64 MBRegisterCache::key(uint server, QModbusDataUnit::RegisterType type, quint16 address)
+{
+    return (((quint64) server) << 24) | (((quint64) type & 0xff) << 16) | address;
+}
@@ -0,0 +1,73 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <QElapsedTimer>
+#include <QHash>
+#include <QModbusDataUnit>
+#include <QReadWriteLock>
+#include <QVector>
+
+/**
+ * @brief The register image of the polled devices
+ * Holds the last value of every coil, input and register
+ * read or written on the bus with its age. Filled by the
+ * RTU client, read by consumers that must not load the bus.
+ */
+class MBRegisterCache
+{
+public:
+    /**
+     * @brief Default constructor
+     */
+    MBRegisterCache();
+    /**
+     * @brief update
+     * @param server
+     * @param unit Values at their register addresses
+     */
+    void update(uint server, const QModbusDataUnit& unit);
+    /**
+     * @brief lookup
+     * @param server
+     * @param type
+     * @param start
+     * @param count
+     * @param maxAge Oldest acceptable value in ms
+     * @param values Receives the values on success
+     * @return true if all values known and not older than maxAge
+     */
+    bool lookup(uint server, QModbusDataUnit::RegisterType type, quint16 start, quint16 count, qint64 maxAge, QVector<quint16>* values) const;
+    /**
+     * @brief invalidate
+     * Forget values of a server, all if server is 0
+     */
+    void invalidate(uint server = 0);
+    /**
+     * @brief invalidate
+     * Forget a range of values of a server
+     * @param server
+     * @param type
+     * @param start
+     * @param count
+     */
+    void invalidate(uint server, QModbusDataUnit::RegisterType type, quint16 start, quint16 count);
+
+private:
+    typedef struct {
+        quint16 m_value;
+        /* monotonic time of update in ms */
+        qint64 m_stamp;
+    } TEntry;
+
+    mutable QReadWriteLock m_lock;
+    QElapsedTimer m_clock;
+    /* key: server, register type, address */
+    QHash<quint64, TEntry> m_entries;
+
+private:
+    static inline quint64 key(uint server, QModbusDataUnit::RegisterType type, quint16 address);
+};
@@ -6,23 +6,50 @@
  **********************************************************************/
 #include <QCoreApplication>
 #include <QDebug>
-#include <QDir>
-#include <QFileInfo>
 #include <QMutexLocker>
 #include <QSerialPortInfo>
 #include <QTimer>
+#include <mbportresolver.h>
 #include <mbrtuclient.h>
+#include <mbserialrate.h>
+
+static inline int eventPriority(MBRtuClient::TPriority priority)
+{
+    return (priority == MBRtuClient::PriorityHigh ? Qt::HighEventPriority : Qt::NormalEventPriority);
+}
 
 MBRtuClient::MBRtuClient(QObject* parent)
     : QObject {parent}
     , m_config()
     , m_modbus(this)
     , m_isOpen(false)
+    , m_active()
+    , m_pending()
+    , m_cache()
+    , m_inflight()
+    , m_inflightLock()
+    , m_health()
+    , m_healthLock()
+    , m_clock()
+    , m_openResult()
+    , m_closeResult()
+    , m_workers(0)
+    , m_recovery(RecoveryIdle)
+    , m_recoveryTimer(this)
+    , m_reopenTimer()
+    , m_recoveryCount(0)
+    , m_recoveryStart(0)
+    , m_resyncCount(0)
+    , m_lineActivity(false)
+    , m_resumeWorker(false)
+    , m_retunePending(false)
+    , m_txStamp(0)
     , m_worker(nullptr)
 {
     qRegisterMetaType<QSerialPort::SerialPortError>();
     qRegisterMetaType<QModbusDevice::Error>();
     qRegisterMetaType<QModbusDevice::State>();
+    qRegisterMetaType<MBRtuRequest>();
 
     /* default configuration (Firefly AIO-RK3568J IPC board) */
     m_config.m_portName = "ttysWK0"; // RS485_1 / ttysWK1 = RS485_2
@@ -37,6 +64,22 @@ MBRtuClient::MBRtuClient(QObject* parent)
         TRACE_RESPONSE | //
         TRACE_DATAUNIT);
 
+    /* request timing and offline server handling */
+    m_config.m_timeout = 1000;
+    m_config.m_retries = 3;
+    m_config.m_turnaroundDelay = 100;
+    m_config.m_quarantineAfter = 3;
+    m_config.m_backoffMin = 1000;
+    m_config.m_backoffMax = 60000;
+    m_config.m_recoverLimit = 3;
+    m_config.m_recoverWindow = 10000;
+
+    m_clock.start();
+
+    m_recoveryTimer.setSingleShot(true);
+    m_recoveryTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_recoveryTimer, &QTimer::timeout, this, &MBRtuClient::onRecoveryTimer);
+
     connect(&m_modbus, &QModbusRtuSerialMaster::errorOccurred, this, &MBRtuClient::onModbusError);
     connect(&m_modbus, &QModbusRtuSerialMaster::stateChanged, this, &MBRtuClient::onModbusState);
 }
@@ -45,6 +88,12 @@ MBRtuClient::~MBRtuClient()
 {
     qDebug() << Q_FUNC_INFO;
     removeWorker();
+    dropPending();
+    finishOpen(false);
+    if (m_closeResult.isRunning()) {
+        m_closeResult.reportResult(true);
+        m_closeResult.reportFinished();
+    }
 }
 
 void MBRtuClient::customEvent(QEvent* event)
@@ -55,11 +104,17 @@ void MBRtuClient::customEvent(QEvent* event)
 
     switch (CS_EVENT_ID(event->type())) {
         case CS_EVENT(ID_EVENT_OPEN): {
-            connectDevice();
+            if (!connectDevice()) {
+                finishOpen(false);
+            }
+            else if (m_isOpen) {
+                finishOpen(true);
+            }
             return;
         }
         case CS_EVENT(ID_EVENT_CLOSE): {
             disconnectDevice();
+            finishClose();
             return;
         }
         case CS_EVENT(ID_EVENT_READ):
@@ -71,6 +126,14 @@ void MBRtuClient::customEvent(QEvent* event)
             }
             return;
         }
+        case CS_EVENT(ID_EVENT_DROPPED): {
+            IOEvent* ev;
+            if ((ev = dynamic_cast<IOEvent*>(event))) {
+                ev->handle().complete({MBRtuRequest::StatusDropped, (uint) ev->server(), 0, tr("Server quarantined"), {}, {}, false});
+                emit dropped(ev->server());
+            }
+            return;
+        }
     }
 
     QObject::customEvent(event);
@@ -85,70 +148,174 @@ const MBRtuClient::TConfig& MBRtuClient::config() const
     return m_config;
 }
 
+void MBRtuClient::setConfig(const TConfig& config)
+{
+    m_config = config;
+}
+
 bool MBRtuClient::isOpen() const
 {
     return m_isOpen;
 }
 
-void MBRtuClient::open()
+QFuture<bool> MBRtuClient::readyFuture(bool result)
 {
-    qApp->postEvent(this, new QEvent(CS_EVENT(ID_EVENT_OPEN)));
+    QFutureInterface<bool> fi;
+    fi.reportStarted();
+    fi.reportResult(result);
+    fi.reportFinished();
+    return fi.future();
 }
 
-void MBRtuClient::close()
+QFuture<bool> MBRtuClient::open()
 {
-    qApp->postEvent(this, new QEvent(CS_EVENT(ID_EVENT_CLOSE)));
+    if (!m_openResult.isRunning()) {
+        m_openResult = QFutureInterface<bool>();
+        m_openResult.reportStarted();
+        qApp->postEvent(this, new QEvent(CS_EVENT(ID_EVENT_OPEN)));
+    }
+    return m_openResult.future();
 }
 
-void MBRtuClient::read(const uint server, const QModbusDataUnit& unit)
+QFuture<bool> MBRtuClient::close()
 {
+    if (!m_closeResult.isRunning()) {
+        m_closeResult = QFutureInterface<bool>();
+        m_closeResult.reportStarted();
+        qApp->postEvent(this, new QEvent(CS_EVENT(ID_EVENT_CLOSE)));
+    }
+    return m_closeResult.future();
+}
+
+MBRtuRequest MBRtuClient::read(const uint server, const QModbusDataUnit& unit, const TPriority priority)
+{
+    MBRtuRequest handle;
+
+    /* attach to identical pending read, the bus
+     * carries one transaction for all readers. */
+    if (priority == PriorityNormal) {
+        const quint64 key = readKey(server, unit);
+        QMutexLocker lock(&m_inflightLock);
+        auto it = m_inflight.constFind(key);
+        if (it != m_inflight.constEnd()) {
+            if (isTrace(TRACE_INTERNAL)) {
+                qDebug() << "MODBUS: Read joins request" << it.value().id();
+            }
+            return it.value();
+        }
+        handle = MBRtuRequest::create(server);
+        m_inflight.insert(key, handle);
+        handle.then(nullptr, [this, key, id = handle.id()](const MBRtuRequest::TResult&) {
+            QMutexLocker lock(&m_inflightLock);
+            auto it = m_inflight.find(key);
+            if (it != m_inflight.end() && it.value().id() == id) {
+                m_inflight.erase(it);
+            }
+        });
+    }
+    else {
+        handle = MBRtuRequest::create(server);
+    }
+
     if (!m_worker) {
-        qApp->postEvent(this, new IOEvent(CS_EVENT(ID_EVENT_READ), server, unit));
+        qApp->postEvent(this, new IOEvent(CS_EVENT(ID_EVENT_READ), server, unit, handle), eventPriority(priority));
     }
     else {
         m_worker->scheduleRequest({
            .type = MBQueueWorker::DataUnitRead,
            .server = server,
            .request = {},
-           // .unit = QModbusDataUnit(unit.registerType(), unit.startAddress(), unit.values()),
            .unit = unit,
+           .handle = handle,
+           .priority = (priority == PriorityHigh),
         });
         m_worker->notifyRequest();
     }
+    return handle;
 }
 
-void MBRtuClient::write(const uint server, const QModbusDataUnit& unit)
+MBRtuRequest MBRtuClient::write(const uint server, const QModbusDataUnit& unit, const TPriority priority)
 {
+    MBRtuRequest handle = MBRtuRequest::create(server);
     if (!m_worker) {
-        qApp->postEvent(this, new IOEvent(CS_EVENT(ID_EVENT_WRITE), server, unit));
+        qApp->postEvent(this, new IOEvent(CS_EVENT(ID_EVENT_WRITE), server, unit, handle), eventPriority(priority));
     }
     else {
         m_worker->scheduleRequest({
            .type = MBQueueWorker::DataUnitWrite,
            .server = server,
            .request = {},
-           //.unit = QModbusDataUnit(unit.registerType(), unit.startAddress(), unit.values()),
            .unit = unit,
+           .handle = handle,
+           .priority = (priority == PriorityHigh),
         });
         m_worker->notifyRequest();
     }
+    return handle;
 }
 
-void MBRtuClient::send(const uint server, const QModbusRequest& mr)
+MBRtuRequest MBRtuClient::send(const uint server, const QModbusRequest& mr, const TPriority priority)
 {
+    MBRtuRequest handle = MBRtuRequest::create(server);
     if (!m_worker) {
-        qApp->postEvent(this, new IOEvent(CS_EVENT(ID_EVENT_REQUEST), server, mr));
+        qApp->postEvent(this, new IOEvent(CS_EVENT(ID_EVENT_REQUEST), server, mr, handle), eventPriority(priority));
     }
     else {
         m_worker->scheduleRequest({
            .type = MBQueueWorker::RequestSend,
            .server = server,
-           //.request = QModbusRequest(mr),
            .request = mr,
            .unit = {},
+           .handle = handle,
+           .priority = (priority == PriorityHigh),
         });
         m_worker->notifyRequest();
     }
+    return handle;
+}
+
+MBRtuRequest MBRtuClient::readHolding(const uint server, quint16 start, quint16 count)
+{
+    return read(server, QModbusDataUnit(QModbusDataUnit::HoldingRegisters, start, count));
+}
+
+MBRtuRequest MBRtuClient::readInput(const uint server, quint16 start, quint16 count)
+{
+    return read(server, QModbusDataUnit(QModbusDataUnit::InputRegisters, start, count));
+}
+
+MBRtuRequest MBRtuClient::readCoils(const uint server, quint16 start, quint16 count)
+{
+    return read(server, QModbusDataUnit(QModbusDataUnit::Coils, start, count));
+}
+
+MBRtuRequest MBRtuClient::readDiscreteInputs(const uint server, quint16 start, quint16 count)
+{
+    return read(server, QModbusDataUnit(QModbusDataUnit::DiscreteInputs, start, count));
+}
+
+MBRtuRequest MBRtuClient::writeCoil(const uint server, quint16 address, bool state)
+{
+    return send(
+       server,
+       QModbusRequest( //
+          QModbusRequest::WriteSingleCoil,
+          address,                        // 16bit coil address
+          (quint8) (state ? 0xff : 0x00), // 16bit state - byte HI
+          (quint8) 0x00)                  // 16bit state - byte LO
+    );
+}
+
+MBRtuRequest MBRtuClient::writeRegister(const uint server, quint16 address, quint16 value)
+{
+    return send(
+       server,
+       QModbusRequest( //
+          QModbusRequest::WriteSingleRegister,
+          address,                        // 16bit register address
+          (quint8) ((value >> 8) & 0xff), // 16bit value - byte HI
+          (quint8) (value & 0xff))        // 16bit value - byte LO
+    );
 }
 
 const QString& MBRtuClient::portName() const
@@ -166,12 +333,12 @@ void MBRtuClient::setPortName(const QString& name)
     }
 }
 
-const QSerialPort::BaudRate& MBRtuClient::baudRate() const
+const qint32& MBRtuClient::baudRate() const
 {
     return m_config.m_baudRate;
 }
 
-void MBRtuClient::setBaudRate(const QSerialPort::BaudRate rate)
+void MBRtuClient::setBaudRate(const qint32 rate)
 {
     if (m_config.m_baudRate != rate) {
         m_config.m_baudRate = rate;
@@ -226,6 +393,23 @@ void MBRtuClient::setStopBits(const QSerialPort::StopBits bits)
     }
 }
 
+void MBRtuClient::retuneLine(const TConfig& config)
+{
+    /* connection parameters for later reopens */
+    setBaudRate(config.m_baudRate);
+    setParity(config.m_parity);
+    setDataBits(config.m_dataBits);
+    setStopBits(config.m_stopBits);
+
+    if (!m_isOpen) {
+        return;
+    }
+    m_retunePending = true;
+    if (m_active.isNull()) {
+        retuneDevice();
+    }
+}
+
 void MBRtuClient::setTraceFlags(const uint flags)
 {
     m_config.m_traceFlags = flags;
@@ -245,10 +429,160 @@ bool MBRtuClient::isTrace(uint mask) const
     return ((traceFlags() & mask) == mask);
 }
 
+MBRtuClient::TServerHealth MBRtuClient::serverHealth(uint server) const
+{
+    QMutexLocker lock(&m_healthLock);
+    return m_health.value(server, {});
+}
+
+bool MBRtuClient::isQuarantined(uint server) const
+{
+    QMutexLocker lock(&m_healthLock);
+    return m_health.value(server, {}).m_quarantined;
+}
+
+void MBRtuClient::resetServerHealth(uint server)
+{
+    QMutexLocker lock(&m_healthLock);
+    m_health.remove(server);
+}
+
+MBRtuClient::TRecoveryState MBRtuClient::recoveryState() const
+{
+    return m_recovery;
+}
+
+const MBRegisterCache& MBRtuClient::registerCache() const
+{
+    return m_cache;
+}
+
+void MBRtuClient::invalidateCache(uint server, QModbusDataUnit::RegisterType type, quint16 start, quint16 count)
+{
+    m_cache.invalidate(server, type, start, count);
+}
+
+/* called by worker thread before a request goes out */
+bool MBRtuClient::isServerAccessible(uint server, const MBRtuRequest& handle)
+{
+    {
+        QMutexLocker lock(&m_healthLock);
+
+        auto it = m_health.find(server);
+        if (it == m_health.end() || !it->m_quarantined) {
+            return true;
+        }
+
+        /* one probe at a time after backoff expired */
+        if (it->m_probing || m_clock.elapsed() < it->m_nextProbe) {
+            return false;
+        }
+
+        it->m_probing = true;
+    }
+
+    /* rejected, cancelled or unanswered, the probe ends */
+    handle.then(this, [this, server](const MBRtuRequest::TResult&) {
+        finishProbe(server);
+    });
+    return true;
+}
+
+/* client owns one port, server and range identify a read */
+inline quint64 MBRtuClient::readKey(uint server, const QModbusDataUnit& unit)
+{
+    return (((quint64) server & 0xff) << 48)                //
+           | (((quint64) unit.registerType() & 0xff) << 32) //
+           | (((quint64) unit.startAddress() & 0xffff) << 16)
+           | ((quint64) unit.valueCount() & 0xffff);
+}
+
+inline void MBRtuClient::prepareRequest(uint server)
+{
+    /* probe a quarantined server without retries */
+    int retries = m_config.m_retries;
+    {
+        QMutexLocker lock(&m_healthLock);
+        auto it = m_health.constFind(server);
+        if (it != m_health.constEnd() && it->m_probing) {
+            retries = 0;
+        }
+    }
+    if (m_modbus.numberOfRetries() != retries) {
+        m_modbus.setNumberOfRetries(retries);
+    }
+
+    m_txStamp = MBRtuRequest::stamp();
+}
+
+inline void MBRtuClient::updateHealth(uint server, QModbusDevice::Error code)
+{
+    bool isRecovered = false;
+    bool isQuarantined = false;
+    uint backoff = 0;
+
+    {
+        QMutexLocker lock(&m_healthLock);
+        TServerHealth& h = m_health[server];
+
+        /* only a valid reply or exception proves life */
+        if (code == QModbusDevice::NoError) {
+            isRecovered = h.m_quarantined;
+            h = {};
+        }
+        else {
+            h.m_timeouts++;
+            if (h.m_quarantined) {
+                /* probe failed, double the backoff */
+                h.m_backoff = qMin(h.m_backoff * 2, m_config.m_backoffMax);
+            }
+            else if (h.m_timeouts >= m_config.m_quarantineAfter) {
+                h.m_quarantined = true;
+                h.m_backoff = m_config.m_backoffMin;
+                isQuarantined = true;
+            }
+            h.m_probing = false;
+            h.m_nextProbe = m_clock.elapsed() + h.m_backoff;
+            backoff = h.m_backoff;
+        }
+    }
+
+    if (isQuarantined) {
+        qWarning() << "MODBUS: Server" << server << "quarantined. Probe in" << backoff << "ms";
+        /* queued polls will not be answered */
+        if (m_worker) {
+            foreach (auto r, m_worker->dropRequests(server)) {
+                r.handle.complete({MBRtuRequest::StatusDropped, server, 0, tr("Server quarantined"), {}, {}, false});
+                emit dropped(server);
+            }
+        }
+        emit quarantined(server, backoff);
+    }
+    else if (isRecovered) {
+        qInfo() << "MODBUS: Server" << server << "recovered from quarantine.";
+        emit recovered(server);
+    }
+}
+
+/* probe completed without a health update, next after backoff */
+inline void MBRtuClient::finishProbe(uint server)
+{
+    QMutexLocker lock(&m_healthLock);
+
+    auto it = m_health.find(server);
+    if (it == m_health.end() || !it->m_probing) {
+        return;
+    }
+    it->m_probing = false;
+    it->m_nextProbe = m_clock.elapsed() + it->m_backoff;
+}
+
 inline void MBRtuClient::createWorker()
 {
     if (!m_worker) {
         m_worker = new MBQueueWorker(this, this);
+        m_workers++;
+        connect(m_worker, &MBQueueWorker::finished, m_worker, &MBQueueWorker::deleteLater);
         connect(m_worker, &MBQueueWorker::started, this, &MBRtuClient::onWorkerStarted);
         connect(m_worker, &MBQueueWorker::finished, this, &MBRtuClient::onWorkerFinished);
         connect(m_worker, &MBQueueWorker::destroyed, this, &MBRtuClient::onWorkerDestroyed);
@@ -259,12 +593,22 @@ inline void MBRtuClient::createWorker()
 inline void MBRtuClient::removeWorker()
 {
     if (m_worker) {
-        m_worker->requestInterruption();
-        m_worker->notifyRequest();
-        m_worker->notifyResponse();
-        m_worker->wait(5000);
-        m_worker->deleteLater();
+        MBQueueWorker* worker = m_worker;
         m_worker = nullptr;
+
+        /* cancel queued requests, explicit completion */
+        foreach (auto r, worker->clearQueue()) {
+            r.handle.complete({MBRtuRequest::StatusDropped, r.server, 0, tr("Request cancelled"), {}, {}, false});
+            emit dropped(r.server);
+        }
+
+        /* thread drains in background and deletes itself
+         * when finished, no wait on the caller thread. */
+        worker->detach();
+        worker->setParent(nullptr);
+        worker->requestInterruption();
+        worker->notifyRequest();
+        worker->notifyResponse();
     }
 }
 
@@ -274,47 +618,22 @@ inline bool MBRtuClient::connectDevice()
         return true;
     }
 
-    /* find symbolic link to real port name */
-    QSerialPortInfo spi;
-    QDir devPath("/dev");
-    QString portName = m_config.m_portName;
-    QFileInfoList fil = devPath.entryInfoList(QStringList() << "ttyMB*");
-    if (!fil.isEmpty()) {
-        qInfo() << "MODBUS: Found ttyMBUS symlink to serial device.";
-        foreach (auto fi, fil) {
-            if (fi.isSymLink()) {
-                QString sym = fi.absoluteFilePath();
-                QString tgt = fi.symLinkTarget();
-                qInfo() << "MODBUS: " << sym << " -> " << tgt;
-                if (sym.contains(portName)) {
-                    QString dev;
-                    dev = tgt.replace(devPath.absolutePath(), "");
-                    dev = dev.replace("/", "");
-                    qInfo() << "MODBUS: Using device:" << dev << "for" << portName;
-                    portName = dev;
-                    break;
-                }
-            }
-        }
-    }
-
-    /* lookup known serial ports */
-    foreach (auto pi, spi.availablePorts()) {
-        if (pi.portName().contains(portName)) {
-            qInfo() << "MODBUS: Using device:" << pi.systemLocation();
-            spi = pi;
-            break;
-        }
-    }
+    /* cached symlink and serial port lookup */
+    const QSerialPortInfo spi = MBPortResolver::instance()->resolve(m_config.m_portName);
 
     if (spi.isNull()) {
-        qCritical() << "MODBUS: Can't find serial port:" << portName.toUtf8().constData();
+        qCritical() << "MODBUS: Can't find serial port:" << m_config.m_portName.toUtf8().constData();
         return false;
     }
 
     /* create worker thread */
     createWorker();
 
+    m_modbus.setTimeout(m_config.m_timeout);
+    m_modbus.setNumberOfRetries(m_config.m_retries);
+    /* held off by the master queue after a broadcast */
+    m_modbus.setTurnaroundDelay(m_config.m_turnaroundDelay);
+
     m_modbus.setConnectionParameter( //
        QModbusDevice::SerialPortNameParameter,
        QVariant::fromValue(m_config.m_portName));
@@ -336,7 +655,13 @@ inline bool MBRtuClient::connectDevice()
 
 inline void MBRtuClient::disconnectDevice()
 {
+    m_recoveryTimer.stop();
+    m_recovery = RecoveryIdle;
+    m_resumeWorker = false;
+    m_retunePending = false;
+
     removeWorker();
+    dropPending();
 
     if (m_isOpen) {
         m_isOpen = false;
@@ -346,6 +671,14 @@ inline void MBRtuClient::disconnectDevice()
 
 inline void MBRtuClient::request(IOEvent* event)
 {
+    /* one request on the line at a time, the worker waits
+     * for the response, posted requests wait here. */
+    if (!m_active.isNull()) {
+        m_pending.append(new IOEvent(*event));
+        return;
+    }
+    m_active = event->handle();
+
     switch (CS_EVENT_ID(event->type())) {
         case CS_EVENT(ID_EVENT_READ):
         case CS_EVENT(ID_EVENT_WRITE): {
@@ -358,9 +691,7 @@ inline void MBRtuClient::request(IOEvent* event)
         }
         default: {
             qCritical() << "MODBUS: Invalid event type:" << event->type();
-            if (m_worker) {
-                m_worker->notifyResponse(); // unlock waiting worker
-            }
+            rejectRequest(tr("Invalid event type"));
             break;
         }
     }
@@ -368,19 +699,21 @@ inline void MBRtuClient::request(IOEvent* event)
 
 inline void MBRtuClient::request(uint server, const QModbusRequest& mr)
 {
-    if (server > 248) {
+    if (server > 247) {
         qCritical() << "MODBUS: Invalid server address:" << server;
-        if (m_worker) {
-            m_worker->notifyResponse(); // unlock waiting worker
-        }
+        rejectRequest(tr("Invalid server address"));
         return;
     }
 
     if (!mr.isValid()) {
         qCritical() << "MODBUS: Invalid request object.";
-        if (m_worker) {
-            m_worker->notifyResponse(); // unlock waiting worker
-        }
+        rejectRequest(tr("Invalid request object"));
+        return;
+    }
+
+    if (server == BROADCAST && !isBroadcast(mr.functionCode())) {
+        qCritical() << "MODBUS: Function can't be broadcast:" << mr.functionCode();
+        rejectRequest(tr("Function can't be broadcast"));
         return;
     }
 
@@ -390,32 +723,36 @@ inline void MBRtuClient::request(uint server, const QModbusRequest& mr)
                  << "Data:" << Qt::hex << mr;
     }
 
+    prepareRequest(server);
+
     QModbusReply* reply;
     if ((reply = m_modbus.sendRawRequest(mr, server))) {
         connect(reply, &QModbusReply::finished, this, &MBRtuClient::onModbusReply);
         connect(reply, &QModbusReply::destroyed, this, &MBRtuClient::onReplyDestroyed);
         connect(reply, &QModbusReply::errorOccurred, this, &MBRtuClient::onModbusError);
     }
-    else if (m_worker) {
-        m_worker->notifyResponse(); // unlock waiting worker
+    else {
+        rejectRequest(m_modbus.errorString());
     }
 }
 
 inline void MBRtuClient::request(uint action, uint server, const QModbusDataUnit& unit)
 {
-    if (server > 248) {
+    if (server > 247) {
         qCritical() << "MODBUS: Invalid server address:" << server;
-        if (m_worker) {
-            m_worker->notifyResponse(); // unlock waiting worker
-        }
+        rejectRequest(tr("Invalid server address"));
         return;
     }
 
     if (!unit.isValid()) {
         qCritical() << "MODBUS: Invalid data unit.";
-        if (m_worker) {
-            m_worker->notifyResponse(); // unlock waiting worker
-        }
+        rejectRequest(tr("Invalid data unit"));
+        return;
+    }
+
+    if (server == BROADCAST && CS_EVENT_ID(action) != CS_EVENT(ID_EVENT_WRITE)) {
+        qCritical() << "MODBUS: Read can't be broadcast.";
+        rejectRequest(tr("Read can't be broadcast"));
         return;
     }
 
@@ -429,6 +766,8 @@ inline void MBRtuClient::request(uint action, uint server, const QModbusDataUnit
                  << "Value:" << Qt::hex << unit.values();
     }
 
+    prepareRequest(server);
+
     QModbusReply* reply = 0L;
     switch (CS_EVENT_ID(action)) {
         case CS_EVENT(ID_EVENT_READ): {
@@ -441,9 +780,7 @@ inline void MBRtuClient::request(uint action, uint server, const QModbusDataUnit
         }
         default: {
             qCritical() << "MODBUS: Invalid request type:" << action;
-            if (m_worker) {
-                m_worker->notifyResponse(); // unlock waiting worker
-            }
+            rejectRequest(tr("Invalid request type"));
             return;
         }
     }
@@ -452,11 +789,238 @@ inline void MBRtuClient::request(uint action, uint server, const QModbusDataUnit
         connect(reply, &QModbusReply::destroyed, this, &MBRtuClient::onReplyDestroyed);
         connect(reply, &QModbusReply::errorOccurred, this, &MBRtuClient::onModbusError);
     }
-    else if (m_worker) {
-        m_worker->notifyResponse(); // unlock waiting worker
+    else {
+        rejectRequest(m_modbus.errorString());
     }
 }
 
+/* write functions only, nobody answers a broadcast */
+inline bool MBRtuClient::isBroadcast(int function)
+{
+    switch (function) {
+        case QModbusPdu::WriteSingleCoil:
+        case QModbusPdu::WriteSingleRegister:
+        case QModbusPdu::WriteMultipleCoils:
+        case QModbusPdu::WriteMultipleRegisters:
+        case QModbusPdu::MaskWriteRegister: {
+            return true;
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+/* request not sent, complete and unlock waiting worker */
+inline void MBRtuClient::rejectRequest(const QString& message)
+{
+    completeRequest(MBRtuRequest::StatusFailed, QModbusDevice::UnknownError, message);
+    if (m_worker) {
+        m_worker->notifyResponse();
+    }
+    runPending();
+}
+
+/* next posted request ahead of newly posted ones */
+inline void MBRtuClient::runPending()
+{
+    if (m_pending.isEmpty() || !m_active.isNull() || m_recovery != RecoveryIdle) {
+        return;
+    }
+    qApp->postEvent(this, m_pending.takeFirst(), Qt::HighEventPriority);
+}
+
+inline void MBRtuClient::dropPending()
+{
+    while (!m_pending.isEmpty()) {
+        IOEvent* ev = m_pending.takeFirst();
+        ev->handle().complete({MBRtuRequest::StatusDropped, (uint) ev->server(), 0, tr("Request cancelled"), {}, {}, false});
+        delete ev;
+    }
+}
+
+inline void MBRtuClient::completeRequest(MBRtuRequest::TStatus status, int code, const QString& message)
+{
+    MBRtuRequest handle = m_active;
+    m_active = MBRtuRequest();
+    handle.complete({status, handle.server(), code, message, {}, {}, false});
+}
+
+/* serial port owned by the modbus device, valid while connected */
+inline QSerialPort* MBRtuClient::serialPort() const
+{
+    return m_modbus.findChild<QSerialPort*>();
+}
+
+/* t3.5 character time in ms, fixed 1.75ms above 19200 baud */
+inline int MBRtuClient::silenceInterval() const
+{
+    int usecs = 1750;
+    if (m_config.m_baudRate <= 19200) {
+        usecs = (35 * 11 * 100000) / m_config.m_baudRate;
+    }
+    return qMax(2, (usecs + 999) / 1000);
+}
+
+/* rates without Bxxx code are set exactly after connect */
+inline bool MBRtuClient::applyLineRate()
+{
+    QSerialPort* port = serialPort();
+    if (!port) {
+        return false;
+    }
+    if (MBSerialRate::isStandard(m_config.m_baudRate) && //
+        MBSerialRate::lineRate(port) == m_config.m_baudRate) {
+        return true;
+    }
+    if (isTrace(TRACE_INTERNAL)) {
+        qDebug() << "MODBUS: Custom line rate" << m_config.m_baudRate;
+    }
+    return MBSerialRate::apply(port, m_config.m_baudRate);
+}
+
+/* Qt takes frame timing from the connection parameters at
+ * connect, a reconnect of the master applies the new ones. */
+inline void MBRtuClient::retuneDevice()
+{
+    if (!m_retunePending || m_recovery != RecoveryIdle) {
+        return;
+    }
+    m_retunePending = false;
+
+    qInfo() << "MODBUS: Retune" << m_config.m_portName << m_config.m_baudRate //
+            << m_config.m_dataBits << m_config.m_parity << m_config.m_stopBits;
+    reopenDevice();
+}
+
+inline void MBRtuClient::startRecovery(QModbusDevice::Error code)
+{
+    /* already reopening, errors of aborted replies */
+    if (m_recovery == RecoveryReopen) {
+        return;
+    }
+
+    const qint64 now = m_clock.elapsed();
+    if (m_recovery == RecoveryIdle) {
+        if (now - m_recoveryStart > m_config.m_recoverWindow) {
+            m_recoveryStart = now;
+            m_recoveryCount = 0;
+        }
+        m_recoveryCount++;
+    }
+
+    emit recovering(code);
+
+    /* port lost or too many errors in window */
+    if (code == QModbusDevice::ConnectionError || m_recoveryCount > m_config.m_recoverLimit) {
+        reopenDevice();
+        return;
+    }
+
+    m_resyncCount = 0;
+    m_recovery = RecoveryResync;
+    resyncLine();
+}
+
+inline void MBRtuClient::resyncLine()
+{
+    QSerialPort* port;
+    if (!(port = serialPort())) {
+        reopenDevice();
+        return;
+    }
+
+    if (isTrace(TRACE_INTERNAL)) {
+        qDebug() << "MODBUS: Flush UART, resync on" << silenceInterval() << "ms silence.";
+    }
+
+    /* drop partial frames in both directions */
+    port->clear(QSerialPort::AllDirections);
+    port->clearError();
+
+    m_lineActivity = false;
+    m_recoveryTimer.start(silenceInterval());
+}
+
+inline void MBRtuClient::reopenDevice()
+{
+    qWarning() << "MODBUS: Reopen serial port" << m_config.m_portName;
+
+    m_recoveryTimer.stop();
+    m_recovery = RecoveryReopen;
+    m_reopenTimer.start();
+    /* connect applies pending line parameters */
+    m_retunePending = false;
+
+    /* connect again on unconnected state change */
+    if (m_modbus.state() == QModbusDevice::UnconnectedState) {
+        if (!m_modbus.connectDevice()) {
+            abortRecovery();
+        }
+        return;
+    }
+    m_modbus.disconnectDevice();
+}
+
+inline void MBRtuClient::abortRecovery()
+{
+    /* failed connect reports by error signal and result */
+    if (m_recovery != RecoveryReopen) {
+        return;
+    }
+
+    qCritical() << "MODBUS: Line recovery failed, closing port.";
+
+    m_recovery = RecoveryIdle;
+    m_resumeWorker = false;
+    removeWorker();
+
+    m_isOpen = false;
+    if (m_modbus.state() != QModbusDevice::UnconnectedState) {
+        m_modbus.disconnectDevice();
+    }
+    else {
+        finishOpen(false);
+        emit closed();
+        finishClose();
+    }
+}
+
+inline void MBRtuClient::finishOpen(bool result)
+{
+    if (m_openResult.isRunning()) {
+        m_openResult.reportResult(result);
+        m_openResult.reportFinished();
+    }
+}
+
+/* closed once port unconnected and all workers drained */
+inline void MBRtuClient::finishClose()
+{
+    if (m_workers > 0 || m_modbus.state() != QModbusDevice::UnconnectedState) {
+        return;
+    }
+    if (m_closeResult.isRunning()) {
+        m_closeResult.reportResult(true);
+        m_closeResult.reportFinished();
+    }
+}
+
+inline void MBRtuClient::finishRecovery()
+{
+    m_recoveryTimer.stop();
+    m_recovery = RecoveryIdle;
+
+    /* release worker held back during recovery */
+    if (m_resumeWorker) {
+        m_resumeWorker = false;
+        if (m_worker) {
+            m_worker->notifyResponse();
+        }
+    }
+    runPending();
+}
+
 /* --------------------------------------------------------------------
  * Event Methods
  * -------------------------------------------------------------------- */
@@ -503,19 +1067,63 @@ void MBRtuClient::onModbusError(QModbusDevice::Error code)
         }
     }
 
+    /* exception response, the server and line are fine */
+    QModbusReply* reply = qobject_cast<QModbusReply*>(sender());
+    if (reply && code == QModbusDevice::ProtocolError && reply->rawResult().isException()) {
+        if (isTrace(TRACE_RESPONSE | TRACE_INTERNAL)) {
+            qDebug() << "MODBUS: Exception response:" << Qt::hex << reply->rawResult().exceptionCode();
+        }
+        if (m_worker) {
+            updateHealth(m_worker->activeServer(), QModbusDevice::NoError);
+            emit error(m_worker->activeServer(), code, msg);
+        }
+        else {
+            emit error(0, code, msg);
+        }
+        return;
+    }
+
     qCritical() << "MODBUS:" << msg.toUtf8().constData();
 
     if (m_worker) {
+        /* server did not answer or answered garbage */
+        if (code == QModbusDevice::TimeoutError || code == QModbusDevice::ProtocolError) {
+            updateHealth(m_worker->activeServer(), code);
+        }
         emit error(m_worker->activeServer(), code, msg);
     }
     else {
         emit error(0, code, msg);
     }
 
-    /* force port close if open, but not on timeout. May
-     * be one of the devices in chain is offline. */
-    if (m_isOpen && code != QModbusDevice::TimeoutError) {
-        disconnectDevice();
+    if (m_recovery == RecoveryReopen && code == QModbusDevice::ConnectionError) {
+        abortRecovery();
+        return;
+    }
+
+    /* Not on timeout, may be one of the devices in chain is
+     * offline. Line errors are recovered with port kept open,
+     * close only if the configuration can't be applied. */
+    switch (code) {
+        case QModbusDevice::TimeoutError: {
+            break;
+        }
+        case QModbusDevice::ProtocolError:
+        case QModbusDevice::ReadError:
+        case QModbusDevice::WriteError:
+        case QModbusDevice::ReplyAbortedError:
+        case QModbusDevice::ConnectionError: {
+            if (m_isOpen) {
+                startRecovery(code);
+            }
+            break;
+        }
+        default: {
+            if (m_isOpen) {
+                disconnectDevice();
+            }
+            break;
+        }
     }
 }
 
@@ -527,15 +1135,47 @@ void MBRtuClient::onModbusState(QModbusDevice::State state)
 
     switch (state) {
         case QModbusDevice::UnconnectedState: {
+            if (m_recovery == RecoveryReopen) {
+                /* leave state handler before connect */
+                QTimer::singleShot(0, this, [this]() {
+                    if (m_recovery == RecoveryReopen && !m_modbus.connectDevice()) {
+                        abortRecovery();
+                    }
+                });
+                break;
+            }
             m_isOpen = false;
+            finishOpen(false);
             emit closed();
+            finishClose();
             break;
         }
         case QModbusDevice::ConnectingState: {
             break;
         }
         case QModbusDevice::ConnectedState: {
+            if (!applyLineRate()) {
+                qCritical() << "MODBUS: Can't set line rate" << m_config.m_baudRate << "on" << m_config.m_portName;
+                if (m_recovery == RecoveryReopen) {
+                    abortRecovery();
+                    break;
+                }
+                m_modbus.disconnectDevice();
+                break;
+            }
+            if (m_recovery == RecoveryReopen) {
+                const qint64 msecs = m_reopenTimer.elapsed();
+                qInfo() << "MODBUS: Port reopened in" << msecs << "ms";
+                m_isOpen = true;
+                finishRecovery();
+                emit reconnected(msecs);
+                break;
+            }
             m_isOpen = true;
+            if (QSerialPort* port = serialPort()) {
+                connect(port, &QSerialPort::readyRead, this, &MBRtuClient::onSerialReadyRead, Qt::UniqueConnection);
+            }
+            finishOpen(true);
             emit opened();
             break;
         }
@@ -553,8 +1193,22 @@ void MBRtuClient::onModbusReply()
         return;
     }
 
-    /* error event already emitted by modbus */
+    /* error event already emitted by modbus, an exception
+     * response goes to the consumer with the result. */
     if (reply->error() != QModbusDevice::NoError) {
+        MBRtuRequest handle = m_active;
+        m_active = MBRtuRequest();
+        handle.complete({MBRtuRequest::StatusFailed, handle.server(), reply->error(), reply->errorString(), reply->rawResult(), {}, false, m_txStamp, MBRtuRequest::stamp()});
+        reply->deleteLater();
+        return;
+    }
+
+    /* broadcast sent, the master holds the turnaround delay */
+    if (reply->serverAddress() == BROADCAST) {
+        if (isTrace(TRACE_RESPONSE | TRACE_INTERNAL)) {
+            qDebug() << "MODBUS: Broadcast sent, turnaround" << m_config.m_turnaroundDelay << "ms";
+        }
+        completeRequest(MBRtuRequest::StatusSuccess, QModbusDevice::NoError, {});
         reply->deleteLater();
         return;
     }
@@ -564,6 +1218,7 @@ void MBRtuClient::onModbusReply()
     if (!resp.isValid() || resp.isException()) {
         qCritical() << "MODBUS: Got invalid response. Exception:" //
                     << resp.exceptionCode();
+        completeRequest(MBRtuRequest::StatusFailed, QModbusDevice::ProtocolError, tr("Exception %1").arg(resp.exceptionCode()));
         reply->deleteLater();
         return;
     }
@@ -673,6 +1328,10 @@ void MBRtuClient::onModbusReply()
     if (!(isUnit = unit.isValid())) {
         isUnit = translate(unit);
     }
+    /* units of Qt have true register addresses */
+    else {
+        m_cache.update(m_active.server(), unit);
+    }
 
     if (isTrace(TRACE_DATAUNIT | TRACE_INTERNAL)) {
         qDebug() << "MODBUS: DataUnit"                      //
@@ -684,12 +1343,18 @@ void MBRtuClient::onModbusReply()
 
     /* notfiy consumer */
     if (m_worker) {
+        updateHealth(m_worker->activeServer(), QModbusDevice::NoError);
         emit received(m_worker->activeServer(), resp, unit, isUnit);
     }
     else {
         emit received(0, resp, unit, isUnit);
     }
 
+    /* complete request handle */
+    MBRtuRequest handle = m_active;
+    m_active = MBRtuRequest();
+    handle.complete({MBRtuRequest::StatusSuccess, handle.server(), QModbusDevice::NoError, {}, resp, unit, isUnit, m_txStamp, MBRtuRequest::stamp()});
+
     /* remove reply object */
     reply->deleteLater();
     return;
@@ -701,14 +1366,52 @@ void MBRtuClient::onReplyDestroyed()
         qDebug() << "MODBUS: Reply object destoyed.";
     }
 
+    /* retune between two frames */
+    retuneDevice();
+
     /* notfiy consumer */
     if (m_worker) {
         emit complete(m_worker->activeServer());
-        /* run next request */
-        m_worker->notifyResponse();
+        /* run next request, deferred while line recovers */
+        if (m_recovery != RecoveryIdle) {
+            m_resumeWorker = true;
+        }
+        else {
+            m_worker->notifyResponse();
+        }
     }
     else {
         emit complete(0);
+        runPending();
+    }
+}
+
+void MBRtuClient::onRecoveryTimer()
+{
+    if (m_recovery != RecoveryResync) {
+        return;
+    }
+
+    /* line not silent for t3.5, flush again */
+    if (m_lineActivity) {
+        if (++m_resyncCount > 10) {
+            reopenDevice();
+            return;
+        }
+        resyncLine();
+        return;
+    }
+
+    if (isTrace(TRACE_INTERNAL)) {
+        qDebug() << "MODBUS: Line resynchronized.";
+    }
+    finishRecovery();
+}
+
+void MBRtuClient::onSerialReadyRead()
+{
+    if (m_recovery == RecoveryResync) {
+        m_lineActivity = true;
     }
 }
 
@@ -724,6 +1427,8 @@ void MBRtuClient::onWorkerFinished()
     if (isTrace(TRACE_INTERNAL)) {
         qDebug() << "MODBUS: Queue worker finished.";
     }
+    m_workers--;
+    finishClose();
 }
 
 void MBRtuClient::onWorkerDestroyed()
@@ -731,7 +1436,9 @@ void MBRtuClient::onWorkerDestroyed()
     if (isTrace(TRACE_INTERNAL)) {
         qDebug() << "MODBUS: Queue worker destoyed.";
     }
-    m_worker = nullptr;
+    if (sender() == m_worker) {
+        m_worker = nullptr;
+    }
 }
 
 /* --------------------------------------------------------------------
@@ -741,13 +1448,14 @@ void MBRtuClient::onWorkerDestroyed()
 MBQueueWorker::MBQueueWorker(MBRtuClient* client, QObject* parent)
     : QThread(parent)
     , m_client(client)
+    , m_trace(client->isTrace(MBRtuClient::TRACE_INTERNAL))
     , m_queue()
     , m_queueLock()
-    , m_queueWaitLock()
     , m_responseWaitLock()
     , m_queueWait()
     , m_responseWait()
     , m_pendingRequest()
+    , m_responseDone(false)
 {
 }
 
@@ -764,25 +1472,59 @@ MBQueueWorker::~MBQueueWorker()
     }
 }
 
-void MBQueueWorker::clearQueue()
+/* release client, thread may outlive it while draining */
+void MBQueueWorker::detach()
 {
     QMutexLocker lock(&m_queueLock);
-    m_queue.clear();
+    m_client = nullptr;
+}
+
+QList<MBQueueWorker::TRequest> MBQueueWorker::clearQueue()
+{
+    QMutexLocker lock(&m_queueLock);
+    QList<TRequest> queue;
+    queue.swap(m_queue);
+    return queue;
+}
+
+QList<MBQueueWorker::TRequest> MBQueueWorker::dropRequests(uint server)
+{
+    QMutexLocker lock(&m_queueLock);
+    QList<TRequest> dropped;
+    for (int i = m_queue.count() - 1; i >= 0; i--) {
+        if (m_queue.at(i).server == server) {
+            dropped.prepend(m_queue.takeAt(i));
+        }
+    }
+    return dropped;
 }
 
 void MBQueueWorker::scheduleRequest(const TRequest& request)
 {
     QMutexLocker lock(&m_queueLock);
-    m_queue.append(request);
+    if (!request.priority) {
+        m_queue.append(request);
+        return;
+    }
+    /* behind queued priority requests, ahead of others */
+    int i = 0;
+    while (i < m_queue.count() && m_queue.at(i).priority) {
+        i++;
+    }
+    m_queue.insert(i, request);
 }
 
 void MBQueueWorker::notifyRequest()
 {
+    /* lock to not lose wakeup between check and wait */
+    QMutexLocker lock(&m_queueLock);
     m_queueWait.wakeOne();
 }
 
 void MBQueueWorker::notifyResponse()
 {
+    QMutexLocker lock(&m_responseWaitLock);
+    m_responseDone = true;
     m_responseWait.wakeOne();
 }
 
@@ -797,11 +1539,33 @@ inline bool MBQueueWorker::isQueueEmpty()
     return m_queue.isEmpty();
 }
 
-inline void MBQueueWorker::sendRequest()
+inline bool MBQueueWorker::sendRequest()
 {
     QMutexLocker lock(&m_queueLock);
 
+    if (!m_client || m_queue.isEmpty()) {
+        return false;
+    }
+
+    {
+        QMutexLocker rlock(&m_responseWaitLock);
+        m_responseDone = false;
+    }
+
     m_pendingRequest = m_queue.takeFirst();
+
+    /* skip polls of quarantined servers */
+    if (!m_client->isServerAccessible(m_pendingRequest.server, m_pendingRequest.handle)) {
+        qApp->postEvent(
+           m_client,                 //
+           new MBRtuClient::IOEvent( //
+              CS_EVENT(MBRtuClient::ID_EVENT_DROPPED),
+              m_pendingRequest.server,
+              m_pendingRequest.request,
+              m_pendingRequest.handle));
+        return false;
+    }
+
     switch (m_pendingRequest.type) {
         case RequestSend: {
             qApp->postEvent(
@@ -809,8 +1573,9 @@ inline void MBQueueWorker::sendRequest()
                new MBRtuClient::IOEvent( //
                   CS_EVENT(MBRtuClient::ID_EVENT_REQUEST),
                   m_pendingRequest.server,
-                  m_pendingRequest.request));
-            return;
+                  m_pendingRequest.request,
+                  m_pendingRequest.handle));
+            return true;
         }
         case DataUnitRead: {
             qApp->postEvent(
@@ -818,8 +1583,9 @@ inline void MBQueueWorker::sendRequest()
                new MBRtuClient::IOEvent( //
                   CS_EVENT(MBRtuClient::ID_EVENT_READ),
                   m_pendingRequest.server,
-                  m_pendingRequest.unit));
-            return;
+                  m_pendingRequest.unit,
+                  m_pendingRequest.handle));
+            return true;
         }
         case DataUnitWrite: {
             qApp->postEvent(
@@ -827,16 +1593,20 @@ inline void MBQueueWorker::sendRequest()
                new MBRtuClient::IOEvent( //
                   CS_EVENT(MBRtuClient::ID_EVENT_WRITE),
                   m_pendingRequest.server,
-                  m_pendingRequest.unit));
-            return;
+                  m_pendingRequest.unit,
+                  m_pendingRequest.handle));
+            return true;
         }
     }
+    return false;
 }
 
 inline bool MBQueueWorker::waitForRequests()
 {
-    QMutexLocker lock(&m_queueWaitLock);
-    m_queueWait.wait(&m_queueWaitLock);
+    QMutexLocker lock(&m_queueLock);
+    while (m_queue.isEmpty() && !isInterruptionRequested()) {
+        m_queueWait.wait(&m_queueLock);
+    }
 
     /* stop thread if interrupted */
     if (isInterruptionRequested()) {
@@ -850,9 +1620,11 @@ inline bool MBQueueWorker::waitForResponse()
 {
     QMutexLocker lock(&m_responseWaitLock);
 
-    if (!m_responseWait.wait(&m_responseWaitLock, 30000)) {
-        qCritical() << "MODBUS: Request timed out!";
-        return false;
+    while (!m_responseDone && !isInterruptionRequested()) {
+        if (!m_responseWait.wait(&m_responseWaitLock, 30000)) {
+            qCritical() << "MODBUS: Request timed out!";
+            return false;
+        }
     }
 
     /* stop thread if interrupted */
@@ -865,7 +1637,7 @@ inline bool MBQueueWorker::waitForResponse()
 
 void MBQueueWorker::run()
 {
-    if (m_client->isTrace(MBRtuClient::TRACE_INTERNAL)) {
+    if (m_trace) {
         qDebug() << "MODBUS: Worker run enter.";
     }
 
@@ -880,7 +1652,9 @@ void MBQueueWorker::run()
 
         /* send pending request via UI thread. Events
          * handled by modbus client object instance */
-        sendRequest();
+        if (!sendRequest()) {
+            continue;
+        }
 
         /* wait for response ack */
         if (!waitForResponse()) {
@@ -889,14 +1663,14 @@ void MBQueueWorker::run()
     }
 
     if (isInterruptionRequested()) {
-        if (m_client->isTrace(MBRtuClient::TRACE_INTERNAL)) {
+        if (m_trace) {
             qDebug() << "MODBUS: Queue worker interrupted.";
         }
         exit(-1);
         return;
     }
 
-    if (m_client->isTrace(MBRtuClient::TRACE_INTERNAL)) {
+    if (m_trace) {
         qDebug() << "MODBUS: Worker run leave.";
     }
     exit(0);
@@ -5,7 +5,13 @@
  * SPDX-License-Identifier: GPL v3
  **********************************************************************/
 #pragma once
+#include <QElapsedTimer>
 #include <QEvent>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QHash>
+#include <QList>
+#include <QMap>
 #include <QModbusDataUnit>
 #include <QModbusDataUnitMap>
 #include <QModbusDevice>
@@ -16,7 +22,10 @@
 #include <QSerialPort>
 #include <QSettings>
 #include <QThread>
+#include <QTimer>
 #include <QWaitCondition>
+#include <mbregistercache.h>
+#include <mbrturequest.h>
 
 #define CS_EVENT(id)   ((QEvent::Type)(QEvent::User + id))
 #define CS_EVENT_ID(t) ((int) t)
@@ -40,25 +49,74 @@ public:
     static const uint TRACE_DATAUNIT = 0x08;
     static const uint TRACE_INTERNAL = 0x1000;
 
+    /* write to all servers of the line, no reply */
+    static const uint BROADCAST = 0;
+
     typedef struct Config {
         QString m_portName;
-        QSerialPort::BaudRate m_baudRate;
+        qint32 m_baudRate;
         QSerialPort::DataBits m_dataBits;
         QSerialPort::StopBits m_stopBits;
         QSerialPort::Parity m_parity;
         // QSerialPort::FlowControl m_flow;
         uint m_traceFlags;
+        /* response timeout and retries per request */
+        int m_timeout;
+        int m_retries;
+        /* line silence after a broadcast in ms */
+        int m_turnaroundDelay;
+        /* consecutive failed replies until a server is quarantined */
+        uint m_quarantineAfter;
+        /* quarantine probe backoff range in ms */
+        uint m_backoffMin;
+        uint m_backoffMax;
+        /* in place recoveries within window until reopen */
+        uint m_recoverLimit;
+        uint m_recoverWindow;
     } TConfig;
 
+    enum TPriority {
+        PriorityNormal,
+        /* queued ahead of normal requests */
+        PriorityHigh,
+    };
+    Q_ENUM(TPriority)
+
+    enum TRecoveryState {
+        RecoveryIdle,
+        RecoveryResync,
+        RecoveryReopen,
+    };
+    Q_ENUM(TRecoveryState)
+
+    typedef struct ServerHealth {
+        /* consecutive timeouts and garbled replies */
+        uint m_timeouts;
+        /* server is in quarantine */
+        bool m_quarantined;
+        /* probe request is on the line */
+        bool m_probing;
+        /* current probe backoff in ms */
+        uint m_backoff;
+        /* monotonic time in ms of next probe */
+        qint64 m_nextProbe;
+    } TServerHealth;
+
     /**
      * @brief Default constructor
      * @param parent
      */
     explicit MBRtuClient(QObject* parent = nullptr);
     /**
-     * Destructor kills worker thread
+     * Destructor detaches worker thread, never waits
      */
     ~MBRtuClient();
+    /**
+     * @brief readyFuture
+     * @param result
+     * @return Finished future holding the result
+     */
+    static QFuture<bool> readyFuture(bool result);
     /**
      * @brief customEvent
      * @param event
@@ -69,6 +127,11 @@ public:
      * @return
      */
     const TConfig& config() const;
+    /**
+     * @brief setConfig
+     * @param config Takes effect on next open
+     */
+    void setConfig(const TConfig& config);
     /**
      * @brief isOpen
      * @return
@@ -76,31 +139,79 @@ public:
     bool isOpen() const;
     /**
      * @brief open
-     * @return
+     * @return Future resolved when port and worker are ready
      */
-    void open();
+    QFuture<bool> open();
     /**
      * @brief close
+     * @return Future resolved when port closed and worker drained
      */
-    void close();
+    QFuture<bool> close();
     /**
      * @brief read
+     * Identical normal priority reads while one is queued or
+     * on the line share its handle and the single transaction
      * @param server
      * @param unit
+     * @param priority
+     * @return Request handle completed with the result
      */
-    void read(const uint server, const QModbusDataUnit& unit);
+    MBRtuRequest read(const uint server, const QModbusDataUnit& unit, const TPriority priority = PriorityNormal);
     /**
      * @brief write
-     * @param server
+     * @param server 1..247 or BROADCAST, completed after sending
      * @param unit
+     * @param priority
+     * @return Request handle completed with the result
      */
-    void write(const uint server, const QModbusDataUnit& unit);
+    MBRtuRequest write(const uint server, const QModbusDataUnit& unit, const TPriority priority = PriorityNormal);
     /**
      * @brief send
-     * @param server
+     * @param server 1..247 or BROADCAST for write functions
      * @param mr
+     * @param priority
+     * @return Request handle completed with the result
+     */
+    MBRtuRequest send(const uint server, const QModbusRequest& mr, const TPriority priority = PriorityNormal);
+    /**
+     * @brief readHolding
+     * Function 0x03, awaitable in a MBTask coroutine
+     * @param server
+     * @param start
+     * @param count
+     * @return Request handle completed with the result
+     */
+    MBRtuRequest readHolding(const uint server, quint16 start, quint16 count);
+    /**
+     * @brief readInput
+     * Function 0x04
+     * @return Request handle completed with the result
+     */
+    MBRtuRequest readInput(const uint server, quint16 start, quint16 count);
+    /**
+     * @brief readCoils
+     * Function 0x01
+     * @return Request handle completed with the result
+     */
+    MBRtuRequest readCoils(const uint server, quint16 start, quint16 count);
+    /**
+     * @brief readDiscreteInputs
+     * Function 0x02
+     * @return Request handle completed with the result
+     */
+    MBRtuRequest readDiscreteInputs(const uint server, quint16 start, quint16 count);
+    /**
+     * @brief writeCoil
+     * Function 0x05
+     * @return Request handle completed with the result
      */
-    void send(const uint server, const QModbusRequest& mr);
+    MBRtuRequest writeCoil(const uint server, quint16 address, bool state);
+    /**
+     * @brief writeRegister
+     * Function 0x06
+     * @return Request handle completed with the result
+     */
+    MBRtuRequest writeRegister(const uint server, quint16 address, quint16 value);
     /**
      * @brief portName
      * @return
@@ -115,12 +226,12 @@ public:
      * @brief baudRate
      * @return
      */
-    const QSerialPort::BaudRate& baudRate() const;
+    const qint32& baudRate() const;
     /**
      * @brief setBaudRate
-     * @param rate
+     * @param rate In bit/s, also non-standard like 128000
      */
-    void setBaudRate(const QSerialPort::BaudRate rate);
+    void setBaudRate(const qint32 rate);
     /**
      * @brief parity
      * @return
@@ -151,6 +262,15 @@ public:
      * @param bits
      */
     void setStopBits(const QSerialPort::StopBits bits);
+    /**
+     * @brief retuneLine
+     * Baud rate, parity, data and stop bits of config. The
+     * master reconnects with them, its frame timing follows
+     * the new rate. A frame on the line is answered first,
+     * queued requests wait and go out retuned.
+     * @param config Port name is not applied
+     */
+    void retuneLine(const TConfig& config);
     /**
      * @brief setTraceFlags
      * @param flags
@@ -167,6 +287,42 @@ public:
      * @return true or false
      */
     bool isTrace(uint mask) const;
+    /**
+     * @brief serverHealth
+     * @param server
+     * @return Health state of the given server
+     */
+    TServerHealth serverHealth(uint server) const;
+    /**
+     * @brief isQuarantined
+     * @param server
+     * @return true if requests to the server are dropped
+     */
+    bool isQuarantined(uint server) const;
+    /**
+     * @brief resetServerHealth
+     * @param server Release the server from quarantine
+     */
+    void resetServerHealth(uint server);
+    /**
+     * @brief recoveryState
+     * @return Current line recovery state
+     */
+    TRecoveryState recoveryState() const;
+    /**
+     * @brief registerCache
+     * @return Last values read or written on the bus
+     */
+    const MBRegisterCache& registerCache() const;
+    /**
+     * @brief invalidateCache
+     * Forget cached values changed behind the cache
+     * @param server
+     * @param type
+     * @param start
+     * @param count
+     */
+    void invalidateCache(uint server, QModbusDataUnit::RegisterType type, quint16 start, quint16 count);
 
 signals:
     /**
@@ -191,12 +347,39 @@ signals:
      * @brief complete
      */
     void complete(uint server);
+    /**
+     * @brief dropped
+     * Request to the server was dropped without sending
+     */
+    void dropped(uint server);
+    /**
+     * @brief quarantined
+     * Server stopped responding, next probe after backoff ms
+     */
+    void quarantined(uint server, uint backoff);
+    /**
+     * @brief recovered
+     * Quarantined server responded again
+     */
+    void recovered(uint server);
+    /**
+     * @brief recovering
+     * Line error occured, port stays open and resyncs
+     */
+    void recovering(const int code);
+    /**
+     * @brief reconnected
+     * Port was reopened as last resort after msecs
+     */
+    void reconnected(qint64 msecs);
 
 private slots:
     void onModbusError(QModbusDevice::Error);
     void onModbusState(QModbusDevice::State);
     void onModbusReply();
     void onReplyDestroyed();
+    void onRecoveryTimer();
+    void onSerialReadyRead();
     /* -- */
     void onWorkerStarted();
     void onWorkerFinished();
@@ -209,18 +392,21 @@ private:
     static const uint ID_EVENT_READ = 603;
     static const uint ID_EVENT_WRITE = 604;
     static const uint ID_EVENT_REQUEST = 605;
+    static const uint ID_EVENT_DROPPED = 606;
 
     class IOEvent: public QEvent
     {
     public:
-        explicit IOEvent(QEvent::Type type, const int server, const QModbusDataUnit& unit)
+        explicit IOEvent(QEvent::Type type, const int server, const QModbusDataUnit& unit, const MBRtuRequest& handle)
             : QEvent(type)
             , m_server(server)
-            , m_unit(unit) {};
-        explicit IOEvent(QEvent::Type type, const int server, const QModbusRequest& mr)
+            , m_unit(unit)
+            , m_handle(handle) {};
+        explicit IOEvent(QEvent::Type type, const int server, const QModbusRequest& mr, const MBRtuRequest& handle)
             : QEvent(type)
             , m_server(server)
-            , m_request(mr) {};
+            , m_request(mr)
+            , m_handle(handle) {};
 
         inline const QModbusDataUnit& unit() const
         {
@@ -237,15 +423,52 @@ private:
             return m_server;
         }
 
+        inline const MBRtuRequest& handle() const
+        {
+            return m_handle;
+        }
+
     private:
         int m_server;
         QModbusDataUnit m_unit;
         QModbusRequest m_request;
+        MBRtuRequest m_handle;
     };
 
     TConfig m_config;
     QModbusRtuSerialMaster m_modbus;
     bool m_isOpen;
+    /* request on the line */
+    MBRtuRequest m_active;
+    /* posted without worker while a request is on the line */
+    QList<IOEvent*> m_pending;
+    /* values seen on the bus */
+    MBRegisterCache m_cache;
+    /* pending reads by (server, type, start, count) */
+    QHash<quint64, MBRtuRequest> m_inflight;
+    QMutex m_inflightLock;
+    /* per server health, shared with worker */
+    QMap<uint, TServerHealth> m_health;
+    mutable QMutex m_healthLock;
+    QElapsedTimer m_clock;
+    /* pending open / close results */
+    QFutureInterface<bool> m_openResult;
+    QFutureInterface<bool> m_closeResult;
+    /* running worker threads, old ones drain */
+    int m_workers;
+    /* line recovery state machine */
+    TRecoveryState m_recovery;
+    QTimer m_recoveryTimer;
+    QElapsedTimer m_reopenTimer;
+    uint m_recoveryCount;
+    qint64 m_recoveryStart;
+    uint m_resyncCount;
+    bool m_lineActivity;
+    bool m_resumeWorker;
+    /* line parameters wait for the active frame */
+    bool m_retunePending;
+    /* monotonic us the active frame went to the line */
+    qint64 m_txStamp;
 
 private:
     MBQueueWorker* m_worker;
@@ -256,6 +479,27 @@ private:
     inline void request(IOEvent* event);
     inline void request(uint server, const QModbusRequest& mr);
     inline void request(uint action, uint server, const QModbusDataUnit& unit);
+    inline void rejectRequest(const QString& message);
+    inline void runPending();
+    inline void dropPending();
+    static inline bool isBroadcast(int function);
+    inline void completeRequest(MBRtuRequest::TStatus status, int code, const QString& message);
+    inline void prepareRequest(uint server);
+    static inline quint64 readKey(uint server, const QModbusDataUnit& unit);
+    inline void updateHealth(uint server, QModbusDevice::Error code);
+    inline void finishProbe(uint server);
+    bool isServerAccessible(uint server, const MBRtuRequest& handle);
+    inline QSerialPort* serialPort() const;
+    inline int silenceInterval() const;
+    inline bool applyLineRate();
+    inline void retuneDevice();
+    inline void startRecovery(QModbusDevice::Error code);
+    inline void resyncLine();
+    inline void reopenDevice();
+    inline void abortRecovery();
+    inline void finishRecovery();
+    inline void finishOpen(bool result);
+    inline void finishClose();
 };
 
 class MBQueueWorker: public QThread
@@ -274,6 +518,8 @@ public:
         uint server;
         QModbusRequest request;
         QModbusDataUnit unit;
+        MBRtuRequest handle;
+        bool priority;
     } TRequest;
 
     MBQueueWorker(MBRtuClient* client, QObject* parent = nullptr);
@@ -281,7 +527,9 @@ public:
 
     void run() override;
 
-    void clearQueue();
+    void detach();
+    QList<TRequest> clearQueue();
+    QList<TRequest> dropRequests(uint server);
     void scheduleRequest(const TRequest& request);
     void notifyRequest();
     void notifyResponse();
@@ -289,17 +537,19 @@ public:
 
 private:
     MBRtuClient* m_client;
+    /* taken at creation, client may be detached */
+    const bool m_trace;
     QList<TRequest> m_queue;
     QMutex m_queueLock;
-    QMutex m_queueWaitLock;
     QMutex m_responseWaitLock;
     QWaitCondition m_queueWait;
     QWaitCondition m_responseWait;
     TRequest m_pendingRequest;
+    bool m_responseDone;
 
 private:
     inline bool isQueueEmpty();
-    inline void sendRequest();
+    inline bool sendRequest();
     inline bool waitForRequests();
     inline bool waitForResponse();
 };
@@ -0,0 +1,173 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#include <QAtomicInteger>
+#include <QDeadlineTimer>
+#include <QFutureInterface>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPointer>
+#include <QThread>
+#include <mbrturequest.h>
+
+class MBRtuRequest::Private
+{
+public:
+    typedef struct {
+        QPointer<QObject> m_context;
+        bool m_direct;
+        TCallback m_callback;
+    } TContextCallback;
+
+    quint64 m_id;
+    uint m_server;
+    mutable QMutex m_lock;
+    bool m_finished;
+    TResult m_result;
+    QList<TContextCallback> m_callbacks;
+    QFutureInterface<TResult> m_future;
+};
+
+static QAtomicInteger<quint64> s_requestId(0);
+
+/* run callback in the thread of its context */
+static inline void invokeCallback(QObject* context, bool direct, const MBRtuRequest::TCallback& callback, const MBRtuRequest::TResult& result)
+{
+    if (direct) {
+        callback(result);
+        return;
+    }
+    if (!context) {
+        return;
+    }
+    if (context->thread() == QThread::currentThread()) {
+        callback(result);
+        return;
+    }
+    QMetaObject::invokeMethod(
+       context, [callback, result]() { callback(result); }, Qt::QueuedConnection);
+}
+
+MBRtuRequest::MBRtuRequest()
+    : d()
+{
+}
+
+qint64 MBRtuRequest::stamp()
+{
+    /* same clock as QElapsedTimer, CLOCK_MONOTONIC on Linux */
+    return QDeadlineTimer::current(Qt::PreciseTimer).deadlineNSecs() / 1000;
+}
+
+MBRtuRequest MBRtuRequest::create(uint server)
+{
+    MBRtuRequest request;
+    request.d.reset(new Private());
+    request.d->m_id = ++s_requestId;
+    request.d->m_server = server;
+    request.d->m_finished = false;
+    request.d->m_result = {};
+    request.d->m_result.m_status = StatusPending;
+    request.d->m_result.m_server = server;
+    request.d->m_future.reportStarted();
+    return request;
+}
+
+/* -------------------------------------------------------
+ * Api Methods
+ * ------------------------------------------------------- */
+
+bool MBRtuRequest::isNull() const
+{
+    return d.isNull();
+}
+
+bool MBRtuRequest::isFinished() const
+{
+    if (!d) {
+        return false;
+    }
+    QMutexLocker lock(&d->m_lock);
+    return d->m_finished;
+}
+
+quint64 MBRtuRequest::id() const
+{
+    return (d ? d->m_id : 0);
+}
+
+uint MBRtuRequest::server() const
+{
+    return (d ? d->m_server : 0);
+}
+
+MBRtuRequest::TResult MBRtuRequest::result() const
+{
+    if (!d) {
+        return {};
+    }
+    QMutexLocker lock(&d->m_lock);
+    return d->m_result;
+}
+
+QFuture<MBRtuRequest::TResult> MBRtuRequest::future() const
+{
+    if (!d) {
+        return QFuture<TResult>();
+    }
+    return d->m_future.future();
+}
+
+const MBRtuRequest& MBRtuRequest::then(QObject* context, const TCallback& callback) const
+{
+    if (!d || !callback) {
+        return *this;
+    }
+
+    TResult result;
+    {
+        QMutexLocker lock(&d->m_lock);
+        if (!d->m_finished) {
+            d->m_callbacks.append({QPointer<QObject>(context), (context == nullptr), callback});
+            return *this;
+        }
+        result = d->m_result;
+    }
+
+    invokeCallback(context, (context == nullptr), callback, result);
+    return *this;
+}
+
+/* -------------------------------------------------------
+ * Private Methods
+ * ------------------------------------------------------- */
+
+void MBRtuRequest::complete(const TResult& result) const
+{
+    if (!d) {
+        return;
+    }
+
+    QList<Private::TContextCallback> callbacks;
+    {
+        QMutexLocker lock(&d->m_lock);
+        if (d->m_finished) {
+            return;
+        }
+        d->m_finished = true;
+        d->m_result = result;
+        d->m_result.m_server = d->m_server;
+        callbacks.swap(d->m_callbacks);
+    }
+
+    d->m_future.reportResult(d->m_result);
+    d->m_future.reportFinished();
+
+    foreach (auto cb, callbacks) {
+        invokeCallback(cb.m_context.data(), cb.m_direct, cb.m_callback, d->m_result);
+    }
+}
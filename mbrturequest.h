@@ -0,0 +1,108 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <QFuture>
+#include <QModbusDataUnit>
+#include <QModbusDevice>
+#include <QModbusResponse>
+#include <QObject>
+#include <QSharedPointer>
+#include <functional>
+
+/**
+ * @brief The handle of a single Modbus RTU request
+ * Returned by MBRtuClient send, read and write. A handle is
+ * completed exactly once with the typed result. Attached
+ * callbacks run in the thread of their context object, the
+ * future can be used by consumers without a context.
+ */
+class MBRtuRequest
+{
+public:
+    enum TStatus {
+        StatusPending,
+        StatusSuccess,
+        StatusFailed,
+        StatusDropped,
+    };
+
+    typedef struct Result {
+        TStatus m_status;
+        uint m_server;
+        /* QModbusDevice::Error on failure */
+        int m_error;
+        QString m_message;
+        QModbusResponse m_response;
+        QModbusDataUnit m_unit;
+        bool m_isDataUnit;
+        /* monotonic us the frame went to the line and the
+         * response arrived, 0 if not transmitted */
+        qint64 m_txStamp = 0;
+        qint64 m_rxStamp = 0;
+    } TResult;
+
+    typedef std::function<void(const TResult&)> TCallback;
+
+    /**
+     * @brief Null handle
+     */
+    MBRtuRequest();
+    /**
+     * @brief stamp
+     * @return Monotonic clock in us, time base of result stamps
+     */
+    static qint64 stamp();
+    /**
+     * @brief isNull
+     * @return true if handle not bound to a request
+     */
+    bool isNull() const;
+    /**
+     * @brief isFinished
+     * @return true if result available
+     */
+    bool isFinished() const;
+    /**
+     * @brief id
+     * @return Unique request id
+     */
+    quint64 id() const;
+    /**
+     * @brief server
+     * @return Target server address
+     */
+    uint server() const;
+    /**
+     * @brief result
+     * @return Result, status pending if not finished
+     */
+    TResult result() const;
+    /**
+     * @brief future
+     * @return Future resolved with the result
+     */
+    QFuture<TResult> future() const;
+    /**
+     * @brief then
+     * Attach completion callback, runs at once if finished
+     * @param context Callback not called if destroyed, null
+     * runs the callback in the completing thread
+     * @param callback
+     * @return The handle itself
+     */
+    const MBRtuRequest& then(QObject* context, const TCallback& callback) const;
+
+private:
+    friend class MBRtuClient;
+    class Private;
+    QSharedPointer<Private> d;
+
+    static MBRtuRequest create(uint server);
+    void complete(const TResult& result) const;
+};
+
+Q_DECLARE_METATYPE(MBRtuRequest)
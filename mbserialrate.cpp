@@ -0,0 +1,90 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#include <QDebug>
+#include <mbserialrate.h>
+
+#ifdef Q_OS_LINUX
+/* termios2 of the kernel, must not meet <termios.h> */
+#include <asm/termbits.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#endif
+
+bool MBSerialRate::isStandard(qint32 rate)
+{
+    switch (rate) {
+        case 1200:
+        case 2400:
+        case 4800:
+        case 9600:
+        case 19200:
+        case 38400:
+        case 57600:
+        case 115200:
+        case 230400:
+        case 460800:
+        case 921600: {
+            return true;
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+qint32 MBSerialRate::lineRate(QSerialPort* port)
+{
+    if (!port || !port->isOpen()) {
+        return 0;
+    }
+
+#ifdef Q_OS_LINUX
+    struct termios2 tio;
+    if (::ioctl(port->handle(), TCGETS2, &tio) < 0) {
+        return 0;
+    }
+    return (qint32) tio.c_ospeed;
+#else
+    return port->baudRate(QSerialPort::Output);
+#endif
+}
+
+bool MBSerialRate::apply(QSerialPort* port, qint32 rate)
+{
+    if (!port || !port->isOpen() || rate <= 0) {
+        return false;
+    }
+
+#ifdef Q_OS_LINUX
+    struct termios2 tio;
+    if (::ioctl(port->handle(), TCGETS2, &tio) < 0) {
+        qWarning() << "MODBUS: TCGETS2 failed:" << strerror(errno);
+        return false;
+    }
+
+    /* same rate in both directions, no Bxxx code */
+    tio.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    tio.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    tio.c_ispeed = (speed_t) rate;
+    tio.c_ospeed = (speed_t) rate;
+
+    if (::ioctl(port->handle(), TCSETS2, &tio) < 0) {
+        qWarning() << "MODBUS: TCSETS2 failed:" << rate << strerror(errno);
+        return false;
+    }
+
+    /* the driver reports the rate it could derive */
+    const qint32 actual = lineRate(port);
+    if (actual != rate) {
+        qWarning() << "MODBUS: Line rate" << rate << "programmed as" << actual;
+    }
+    return true;
+#else
+    return port->setBaudRate(rate);
+#endif
+}
@@ -0,0 +1,40 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <QSerialPort>
+
+/**
+ * @brief The custom serial line rate support
+ * Programs rates outside the POSIX Bxxx table like 128000
+ * and 256000 exactly. On Linux the rate is set as divisor
+ * free BOTHER rate through termios2, the UART driver picks
+ * the nearest clock. Other platforms keep the rate as set
+ * by QSerialPort.
+ */
+class MBSerialRate
+{
+public:
+    /**
+     * @brief isStandard
+     * @param rate Line rate in bit/s
+     * @return true if the rate has a POSIX Bxxx constant
+     */
+    static bool isStandard(qint32 rate);
+    /**
+     * @brief lineRate
+     * @param port Open serial port
+     * @return Output rate of the line, 0 on error
+     */
+    static qint32 lineRate(QSerialPort* port);
+    /**
+     * @brief apply
+     * @param port Open serial port
+     * @param rate Line rate in bit/s for both directions
+     * @return false if the driver rejects the rate
+     */
+    static bool apply(QSerialPort* port, qint32 rate);
+};
@@ -0,0 +1,228 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#include <QDebug>
+#include <QModbusDataUnit>
+#include <chrono>
+#include <mbserialrate.h>
+#include <mbspeedupgrade.h>
+#include <wsmodbusrtu.h>
+
+MBSpeedUpgrade::MBSpeedUpgrade(MBRtuClient* modbus, QObject* parent)
+    : QObject {parent}
+    , m_modbus(modbus)
+    , m_config()
+    , m_runConfig()
+    , m_running(false)
+{
+    Q_ASSERT_X(m_modbus != 0L, Q_FUNC_INFO, "Null pointer modbus object!");
+
+    m_config.m_baudRates = {
+       256000,
+       128000,
+       QSerialPort::Baud115200,
+       QSerialPort::Baud57600,
+       QSerialPort::Baud38400,
+       QSerialPort::Baud19200,
+    };
+    m_config.m_settleTime = 100;
+    m_config.m_verifyRetries = 3;
+}
+
+/* -------------------------------------------------------
+ * Api Methods
+ * ------------------------------------------------------- */
+
+const MBSpeedUpgrade::TConfig& MBSpeedUpgrade::config() const
+{
+    return m_config;
+}
+
+void MBSpeedUpgrade::setConfig(const TConfig& config)
+{
+    m_config = config;
+}
+
+bool MBSpeedUpgrade::start(const QList<uint>& servers)
+{
+    if (m_running || servers.isEmpty()) {
+        return false;
+    }
+    m_running = true;
+    m_runConfig = m_config;
+    run(servers).start();
+    return true;
+}
+
+bool MBSpeedUpgrade::isRunning() const
+{
+    return m_running;
+}
+
+/* -------------------------------------------------------
+ * Private Methods
+ * ------------------------------------------------------- */
+
+MBTask<> MBSpeedUpgrade::run(QList<uint> servers)
+{
+    const qint32 origin = m_modbus->baudRate();
+    const QSerialPort::Parity parity = m_modbus->parity();
+
+    quint16 restore;
+    if (!WSModbusRtu::uartRegister(origin, parity, &restore)) {
+        qWarning() << "MBSPEED: Unsupported line setting" << origin << parity;
+        finish(false, {});
+        co_return;
+    }
+
+    if (!m_modbus->isOpen() && !co_await m_modbus->open()) {
+        qWarning() << "MBSPEED: Can't open" << m_modbus->portName();
+        finish(false, servers);
+        co_return;
+    }
+
+    /* start only from a complete line */
+    QList<uint> lost = co_await verify(servers);
+    if (!lost.isEmpty()) {
+        qWarning() << "MBSPEED: Servers not answering at" << origin << lost;
+        finish(false, lost);
+        co_return;
+    }
+
+    for (qint32 baudRate : m_runConfig.m_baudRates) {
+        quint16 value;
+        if (baudRate <= origin || !WSModbusRtu::uartRegister(baudRate, parity, &value)) {
+            continue;
+        }
+
+        /* adapter must take the rate before devices are moved */
+        if (!MBSerialRate::isStandard(baudRate)) {
+            const bool supported = co_await switchLine(baudRate);
+            if (!supported) {
+                qWarning() << "MBSPEED: Rate" << baudRate << "not supported by" << m_modbus->portName();
+            }
+            if (!co_await switchLine(origin)) {
+                qCritical() << "MBSPEED: Can't reopen" << m_modbus->portName() << "at" << origin;
+                finish(false, servers);
+                co_return;
+            }
+            if (!supported) {
+                continue;
+            }
+        }
+
+        qInfo() << "MBSPEED: Upgrade" << m_modbus->portName() << origin << "->" << baudRate;
+
+        /* reply at the old rate, switched after it */
+        const QList<uint> rejected = co_await program(servers, value);
+        QList<uint> switched = servers;
+        for (uint server : rejected) {
+            switched.removeAll(server);
+        }
+
+        if (rejected.isEmpty()) {
+            co_await switchLine(baudRate);
+            const QList<uint> missing = co_await verify(servers);
+            if (missing.isEmpty()) {
+                qInfo() << "MBSPEED: Line" << m_modbus->portName() << "verified at" << baudRate;
+                finish(true, {});
+                co_return;
+            }
+            qWarning() << "MBSPEED: Not verified at" << baudRate << missing;
+            for (uint server : missing) {
+                switched.removeAll(server);
+            }
+        }
+        else {
+            qWarning() << "MBSPEED: Rate" << baudRate << "rejected by" << rejected;
+            if (!switched.isEmpty()) {
+                co_await switchLine(baudRate);
+            }
+        }
+
+        /* roll back who answers at the new rate */
+        if (!switched.isEmpty()) {
+            co_await program(switched, restore);
+        }
+        if (m_modbus->baudRate() != origin) {
+            co_await switchLine(origin);
+        }
+
+        lost = co_await verify(servers);
+        if (!lost.isEmpty()) {
+            qCritical() << "MBSPEED: Rollback incomplete, servers lost:" << lost;
+            finish(false, lost);
+            co_return;
+        }
+    }
+
+    finish(false, {});
+}
+
+/* write UART config register, returns servers without success */
+MBTask<QList<uint>> MBSpeedUpgrade::program(QList<uint> servers, quint16 value)
+{
+    QList<uint> failed;
+    for (uint server : servers) {
+        const MBRtuRequest::TResult result = co_await m_modbus->send( //
+           server,
+           QModbusRequest( //
+              QModbusRequest::WriteSingleRegister,
+              (quint16) 0x2000,               // 16bit uart config register
+              (quint8) ((value >> 8) & 0xff), // 16bit parity - byte HI
+              (quint8) (value & 0xff)),       // 16bit baud rate - byte LO
+           MBRtuClient::PriorityHigh);
+        if (result.m_status != MBRtuRequest::StatusSuccess) {
+            failed.append(server);
+        }
+    }
+    co_return failed;
+}
+
+/* read version register, returns servers without answer */
+MBTask<QList<uint>> MBSpeedUpgrade::verify(QList<uint> servers)
+{
+    QList<uint> missing;
+    for (uint server : servers) {
+        bool answered = false;
+        for (int i = 0; i < m_runConfig.m_verifyRetries && !answered; i++) {
+            /* timeouts of the switch must not quarantine */
+            m_modbus->resetServerHealth(server);
+            const MBRtuRequest::TResult result = co_await m_modbus->read( //
+               server,
+               QModbusDataUnit(QModbusDataUnit::HoldingRegisters, 0x8000, 1),
+               MBRtuClient::PriorityHigh);
+            answered = (result.m_status == MBRtuRequest::StatusSuccess);
+        }
+        if (!answered) {
+            missing.append(server);
+        }
+    }
+    co_return missing;
+}
+
+MBTask<bool> MBSpeedUpgrade::switchLine(qint32 baudRate)
+{
+    /* retuned between frames, drivers keep running */
+    MBRtuClient::TConfig config = m_modbus->config();
+    config.m_baudRate = baudRate;
+    m_modbus->retuneLine(config);
+    co_await std::chrono::milliseconds(m_runConfig.m_settleTime);
+    if (m_modbus->isOpen()) {
+        co_return true;
+    }
+
+    /* rate not taken by the port, retune closed it */
+    const bool opened = co_await m_modbus->open();
+    co_await std::chrono::milliseconds(m_runConfig.m_settleTime);
+    co_return opened;
+}
+
+inline void MBSpeedUpgrade::finish(bool upgraded, const QList<uint>& lost)
+{
+    m_running = false;
+    emit finished(upgraded, m_modbus->baudRate(), lost);
+}
@@ -0,0 +1,86 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <QList>
+#include <QObject>
+#include <QSerialPort>
+#include <mbrtuclient.h>
+#include <mbtask.h>
+
+/**
+ * @brief The coordinated line speed upgrade
+ * Moves all given Waveshare servers of a line to the highest
+ * candidate rate. Every server is programmed at the current
+ * rate, the line follows and verifies each one at the new
+ * rate. On any failure the switched servers are programmed
+ * back and the next lower candidate is tried.
+ */
+class MBSpeedUpgrade: public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef struct Config {
+        /* candidate rates, highest first */
+        QList<qint32> m_baudRates;
+        /* wait after switching the line in ms */
+        int m_settleTime;
+        /* verify reads per server at the new rate */
+        int m_verifyRetries;
+    } TConfig;
+
+    /**
+     * @brief Default constructor
+     * @param modbus Client of the line
+     * @param parent
+     */
+    explicit MBSpeedUpgrade(MBRtuClient* modbus, QObject* parent = nullptr);
+    /**
+     * @brief config
+     * @return
+     */
+    const TConfig& config() const;
+    /**
+     * @brief setConfig
+     * @param config
+     */
+    void setConfig(const TConfig& config);
+    /**
+     * @brief start
+     * @param servers All servers of the line
+     * @return false if running or no servers
+     */
+    bool start(const QList<uint>& servers);
+    /**
+     * @brief isRunning
+     * @return
+     */
+    bool isRunning() const;
+
+signals:
+    /**
+     * @brief finished
+     * @param upgraded Line runs at a higher rate
+     * @param baudRate Rate of the line
+     * @param lost Servers not answering at the line rate
+     */
+    void finished(bool upgraded, qint32 baudRate, const QList<uint>& lost);
+
+private:
+    MBRtuClient* m_modbus;
+    TConfig m_config;
+    /* config of the running upgrade, taken at start */
+    TConfig m_runConfig;
+    bool m_running;
+
+private:
+    MBTask<> run(QList<uint> servers);
+    MBTask<QList<uint>> program(QList<uint> servers, quint16 value);
+    MBTask<QList<uint>> verify(QList<uint> servers);
+    MBTask<bool> switchLine(qint32 baudRate);
+    inline void finish(bool upgraded, const QList<uint>& lost);
+};
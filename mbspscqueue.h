@@ -0,0 +1,89 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief The lock free single producer single consumer queue
+ * Fixed ring of a power of two size, push() from one thread
+ * and pop() from one other thread without locks. A full
+ * queue rejects new items, the consumer sees no gaps.
+ */
+template<typename T>
+class MBSpscQueue
+{
+public:
+    /**
+     * @brief Default constructor
+     * @param capacity Rounded up to a power of two
+     */
+    explicit MBSpscQueue(std::size_t capacity = 1024)
+        : m_ring()
+        , m_mask(0)
+        , m_head(0)
+        , m_tail(0)
+    {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_ring.resize(size);
+        m_mask = size - 1;
+    }
+    /**
+     * @brief push
+     * Producer side
+     * @param item
+     * @return false if the queue is full
+     */
+    bool push(const T& item)
+    {
+        const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) > m_mask) {
+            return false;
+        }
+        m_ring[tail & m_mask] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+    /**
+     * @brief pop
+     * Consumer side
+     * @param item Receives the oldest item
+     * @return false if the queue is empty
+     */
+    bool pop(T* item)
+    {
+        const std::size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        *item = m_ring[head & m_mask];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    /**
+     * @brief isEmpty
+     * @return true if no item was queued at the time of the call
+     */
+    bool isEmpty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    /* no implicit sharing, no detach checks from two threads */
+    std::vector<T> m_ring;
+    std::size_t m_mask;
+    /* consumer and producer index on own cache lines */
+    alignas(64) std::atomic<std::size_t> m_head;
+    alignas(64) std::atomic<std::size_t> m_tail;
+};
+
+static_assert(std::atomic<std::size_t>::is_always_lock_free, "queue needs lock free atomics");
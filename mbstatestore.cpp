@@ -0,0 +1,177 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#include <QCoreApplication>
+#include <QDebug>
+#include <QMutexLocker>
+#include <mbstatestore.h>
+
+MBStateStore* MBStateStore::instance()
+{
+    static MBStateStore* store = nullptr;
+    if (!store) {
+        store = new MBStateStore(qApp);
+    }
+    return store;
+}
+
+MBStateStore::MBStateStore(QObject* parent)
+    : QObject {parent}
+    , m_lock()
+    , m_clock()
+    , m_frameTimer(this)
+    , m_channels()
+    , m_index()
+    , m_dirty()
+    , m_changed()
+    , m_added(0)
+{
+    qRegisterMetaType<MBStateStore::TChannel>();
+
+    m_clock.start();
+
+    /* armed by the first change of a frame */
+    m_frameTimer.setSingleShot(true);
+    m_frameTimer.setInterval(1000 / 30);
+    connect(&m_frameTimer, &QTimer::timeout, this, &MBStateStore::onFrameTimer);
+}
+
+/* -------------------------------------------------------
+ * Api Methods
+ * ------------------------------------------------------- */
+
+int MBStateStore::frameRate() const
+{
+    return 1000 / qMax(1, m_frameTimer.interval());
+}
+
+void MBStateStore::setFrameRate(int fps)
+{
+    m_frameTimer.setInterval(1000 / qBound(1, fps, 1000));
+}
+
+void MBStateStore::update(const QString& port, quint8 server, TTable table, quint16 index, const QVector<double>& values)
+{
+    bool arm;
+    {
+        QMutexLocker lock(&m_lock);
+        arm = m_changed.isEmpty() && m_added == 0;
+
+        const qint64 now = m_clock.elapsed();
+        for (int i = 0; i < values.count(); i++) {
+            const int created = m_channels.count();
+            const int id = lookup(port, server, table, index + i);
+            TChannel& c = m_channels[id];
+            if (id < created && c.m_value == values[i]) {
+                continue;
+            }
+            c.m_value = values[i];
+            c.m_stamp = now;
+            if (!m_dirty[id]) {
+                m_dirty[id] = true;
+                m_changed.append(id);
+            }
+        }
+
+        arm = arm && (!m_changed.isEmpty() || m_added > 0);
+    }
+
+    /* writers may run in other threads */
+    if (arm) {
+        QMetaObject::invokeMethod(
+           this,
+           [this]() {
+               if (!m_frameTimer.isActive()) {
+                   m_frameTimer.start();
+               }
+           },
+           Qt::QueuedConnection);
+    }
+}
+
+int MBStateStore::channel(const QString& port, quint8 server, TTable table, quint16 index)
+{
+    QMutexLocker lock(&m_lock);
+    return lookup(port, server, table, index);
+}
+
+int MBStateStore::count() const
+{
+    QMutexLocker lock(&m_lock);
+    return m_channels.count();
+}
+
+MBStateStore::TChannel MBStateStore::at(int id) const
+{
+    QMutexLocker lock(&m_lock);
+    return m_channels.value(id, {});
+}
+
+QVector<MBStateStore::TChannel> MBStateStore::channels(const QVector<int>& ids) const
+{
+    QVector<TChannel> result;
+    result.reserve(ids.count());
+
+    QMutexLocker lock(&m_lock);
+    for (int id : ids) {
+        result.append(m_channels.value(id, {}));
+    }
+    return result;
+}
+
+/* -------------------------------------------------------
+ * Private Methods
+ * ------------------------------------------------------- */
+
+inline quint32 MBStateStore::key(quint8 server, TTable table, quint16 index)
+{
+    return ((quint32) server << 24) | (((quint32) table & 0xff) << 16) | index;
+}
+
+/* caller holds the lock */
+inline int MBStateStore::lookup(const QString& port, quint8 server, TTable table, quint16 index)
+{
+    const TKey k(port, key(server, table, index));
+    auto it = m_index.constFind(k);
+    if (it != m_index.constEnd()) {
+        return it.value();
+    }
+
+    const int id = m_channels.count();
+    m_channels.append({port, server, table, index, 0.0, m_clock.elapsed()});
+    m_dirty.append(false);
+    m_index.insert(k, id);
+    m_added++;
+    return id;
+}
+
+/* -------------------------------------------------------
+ * Event Methods
+ * ------------------------------------------------------- */
+
+void MBStateStore::onFrameTimer()
+{
+    QVector<int> changed;
+    int first;
+    int added;
+    {
+        QMutexLocker lock(&m_lock);
+        changed.swap(m_changed);
+        for (int id : changed) {
+            m_dirty[id] = false;
+        }
+        added = m_added;
+        first = m_channels.count() - added;
+        m_added = 0;
+    }
+
+    if (added > 0) {
+        emit channelsAdded(first, first + added - 1);
+    }
+    if (!changed.isEmpty()) {
+        emit frame(changed);
+    }
+}
@@ -0,0 +1,139 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QPair>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+
+/**
+ * @brief The UI side state of all device channels
+ * Drivers write decoded values from any thread, a write
+ * only stores the value and marks the channel dirty. The
+ * first dirty channel arms a frame timer, one frame signal
+ * per frame interval hands the changed channels to the
+ * views. UI cost depends on the frame rate, not on poll
+ * rate or device count.
+ */
+class MBStateStore: public QObject
+{
+    Q_OBJECT
+
+public:
+    enum TTable {
+        Coils,
+        DiscreteInputs,
+        HoldingRegisters,
+        InputRegisters,
+        Analog,
+    };
+    Q_ENUM(TTable)
+
+    typedef struct {
+        QString m_port;
+        quint8 m_server;
+        TTable m_table;
+        quint16 m_index;
+        double m_value;
+        /* monotonic time of last change in ms */
+        qint64 m_stamp;
+    } TChannel;
+
+    /**
+     * @brief Shared store of the application
+     * @return The store instance
+     */
+    static MBStateStore* instance();
+    /**
+     * @brief Default constructor
+     * @param parent
+     */
+    explicit MBStateStore(QObject* parent = nullptr);
+    /**
+     * @brief frameRate
+     * @return Frames per second
+     */
+    int frameRate() const;
+    /**
+     * @brief setFrameRate
+     * @param fps Frames per second, default 30
+     */
+    void setFrameRate(int fps);
+    /**
+     * @brief update
+     * Thread safe, unchanged values are not marked dirty
+     * @param port
+     * @param server
+     * @param table
+     * @param index First channel index
+     * @param values
+     */
+    void update(const QString& port, quint8 server, TTable table, quint16 index, const QVector<double>& values);
+    /**
+     * @brief channel
+     * @return Id of the channel, created if unknown
+     */
+    int channel(const QString& port, quint8 server, TTable table, quint16 index);
+    /**
+     * @brief count
+     * @return Number of known channels
+     */
+    int count() const;
+    /**
+     * @brief at
+     * @param id Channel id
+     * @return Copy of the channel
+     */
+    TChannel at(int id) const;
+    /**
+     * @brief channels
+     * One lock for a whole frame
+     * @param ids Channel ids
+     * @return Copies of the channels
+     */
+    QVector<TChannel> channels(const QVector<int>& ids) const;
+
+signals:
+    /**
+     * @brief channelsAdded
+     * @param first Id of the first new channel
+     * @param last Id of the last new channel
+     */
+    void channelsAdded(int first, int last);
+    /**
+     * @brief frame
+     * @param changed Ids of channels changed since last frame
+     */
+    void frame(const QVector<int>& changed);
+
+private slots:
+    void onFrameTimer();
+
+private:
+    typedef QPair<QString, quint32> TKey;
+
+    mutable QMutex m_lock;
+    QElapsedTimer m_clock;
+    QTimer m_frameTimer;
+    QVector<TChannel> m_channels;
+    QHash<TKey, int> m_index;
+    /* one flag per channel, ids in order of change */
+    QVector<bool> m_dirty;
+    QVector<int> m_changed;
+    /* channels created since last frame */
+    int m_added;
+
+private:
+    static inline quint32 key(quint8 server, TTable table, quint16 index);
+    inline int lookup(const QString& port, quint8 server, TTable table, quint16 index);
+};
+
+Q_DECLARE_METATYPE(MBStateStore::TChannel)
@@ -0,0 +1,359 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <mbrturequest.h>
+
+template<typename T = void>
+class MBTask;
+
+/**
+ * @brief The coroutine awaitables of bus transactions
+ * Inside a MBTask coroutine the following can be awaited:
+ * - MBRtuRequest, resumes with its MBRtuRequest::TResult
+ * - std::chrono::milliseconds, resumes after the delay
+ * - QFuture<R>, resumes with its result
+ * - MBTask<U>, runs the nested task and resumes with its value
+ * A coroutine member of a QObject resumes in the thread of
+ * the object and is not resumed after it was destroyed, a
+ * started task suspended at that time is destroyed with it.
+ */
+namespace MBTaskDetail {
+
+class PromiseBase
+{
+public:
+    PromiseBase() = default;
+
+    /* member coroutine of a QObject, bind resumption to it */
+    template<typename Obj, typename... Args>
+    PromiseBase(Obj& obj, Args&...)
+    {
+        if constexpr (std::is_base_of_v<QObject, Obj> && !std::is_const_v<Obj>) {
+            m_context = &obj;
+        }
+    }
+
+    class RequestAwaiter
+    {
+    public:
+        RequestAwaiter(const MBRtuRequest& request, QObject* context)
+            : m_request(request)
+            , m_context(context)
+        {
+        }
+
+        bool await_ready() const
+        {
+            return m_request.isFinished();
+        }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            /* may resume at once, awaiter is gone afterwards */
+            MBRtuRequest request = m_request;
+            request.then(m_context, [h](const MBRtuRequest::TResult&) { h.resume(); });
+        }
+
+        MBRtuRequest::TResult await_resume() const
+        {
+            return m_request.result();
+        }
+
+    private:
+        MBRtuRequest m_request;
+        QObject* m_context;
+    };
+
+    class DelayAwaiter
+    {
+    public:
+        DelayAwaiter(std::chrono::milliseconds delay, QObject* context)
+            : m_delay(delay)
+            , m_context(context)
+        {
+        }
+
+        bool await_ready() const
+        {
+            return m_delay.count() <= 0;
+        }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            if (m_context) {
+                QTimer::singleShot(m_delay, Qt::PreciseTimer, m_context, [h]() { h.resume(); });
+            }
+            else {
+                QTimer::singleShot(m_delay, Qt::PreciseTimer, [h]() { h.resume(); });
+            }
+        }
+
+        void await_resume() const
+        {
+        }
+
+    private:
+        std::chrono::milliseconds m_delay;
+        QObject* m_context;
+    };
+
+    template<typename R>
+    class FutureAwaiter
+    {
+    public:
+        FutureAwaiter(const QFuture<R>& future, QObject* context)
+            : m_future(future)
+            , m_context(context)
+        {
+        }
+
+        bool await_ready() const
+        {
+            return m_future.isFinished();
+        }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            QFutureWatcher<R>* watcher = new QFutureWatcher<R>(m_context);
+            QObject::connect(watcher, &QFutureWatcher<R>::finished, watcher, [watcher, h]() {
+                watcher->deleteLater();
+                h.resume();
+            });
+            watcher->setFuture(m_future);
+        }
+
+        R await_resume() const
+        {
+            return m_future.result();
+        }
+
+    private:
+        QFuture<R> m_future;
+        QObject* m_context;
+    };
+
+    class FinalAwaiter
+    {
+    public:
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+
+        template<typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+        {
+            PromiseBase& p = h.promise();
+            /* continue awaiting coroutine */
+            if (p.m_continuation) {
+                return p.m_continuation;
+            }
+            /* started detached, nobody owns the frame */
+            if (p.m_detached) {
+                QObject::disconnect(p.m_guard);
+                h.destroy();
+            }
+            return std::noop_coroutine();
+        }
+
+        void await_resume() noexcept
+        {
+        }
+    };
+
+    std::suspend_always initial_suspend() noexcept
+    {
+        return {};
+    }
+
+    FinalAwaiter final_suspend() noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception()
+    {
+        std::terminate();
+    }
+
+    RequestAwaiter await_transform(const MBRtuRequest& request)
+    {
+        return RequestAwaiter(request, m_context.data());
+    }
+
+    DelayAwaiter await_transform(std::chrono::milliseconds delay)
+    {
+        return DelayAwaiter(delay, m_context.data());
+    }
+
+    template<typename R>
+    FutureAwaiter<R> await_transform(const QFuture<R>& future)
+    {
+        return FutureAwaiter<R>(future, m_context.data());
+    }
+
+    template<typename U>
+    MBTask<U>&& await_transform(MBTask<U>&& task)
+    {
+        return std::move(task);
+    }
+
+    QPointer<QObject> m_context;
+    std::coroutine_handle<> m_continuation;
+    bool m_detached = false;
+    /* destroys the detached frame with its context */
+    QMetaObject::Connection m_guard;
+};
+
+template<typename T>
+class Promise: public PromiseBase
+{
+public:
+    using PromiseBase::PromiseBase;
+
+    MBTask<T> get_return_object();
+
+    template<typename V>
+    void return_value(V&& value)
+    {
+        m_value.emplace(std::forward<V>(value));
+    }
+
+    std::optional<T> m_value;
+};
+
+template<>
+class Promise<void>: public PromiseBase
+{
+public:
+    using PromiseBase::PromiseBase;
+
+    MBTask<void> get_return_object();
+
+    void return_void()
+    {
+    }
+};
+
+} // namespace MBTaskDetail
+
+/**
+ * @brief The lazy coroutine task of bus transaction sequences
+ * A task starts when awaited by another task or by start().
+ * Usage in a driver member function:
+ *   MBTask<> WSFoo::initDevice() {
+ *       auto v = co_await bus()->readHolding(addr, 0x8000, 1);
+ *       ...
+ *   }
+ *   initDevice().start();
+ */
+template<typename T>
+class MBTask
+{
+public:
+    using promise_type = MBTaskDetail::Promise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    MBTask()
+        : m_handle()
+    {
+    }
+
+    explicit MBTask(handle_type handle)
+        : m_handle(handle)
+    {
+    }
+
+    MBTask(MBTask&& other) noexcept
+        : m_handle(std::exchange(other.m_handle, {}))
+    {
+    }
+
+    MBTask& operator=(MBTask&& other) noexcept
+    {
+        if (this != &other) {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+            m_handle = std::exchange(other.m_handle, {});
+        }
+        return *this;
+    }
+
+    MBTask(const MBTask&) = delete;
+    MBTask& operator=(const MBTask&) = delete;
+
+    ~MBTask()
+    {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    /**
+     * @brief start
+     * Run detached, the frame frees itself when done or
+     * when the object of a member coroutine is destroyed.
+     * Nested task frames are owned by the awaiting frame.
+     */
+    void start() &&
+    {
+        if (m_handle) {
+            handle_type h = std::exchange(m_handle, {});
+            promise_type& p = h.promise();
+            p.m_detached = true;
+            if (p.m_context) {
+                /* suspended frame is never resumed again */
+                p.m_guard = QObject::connect(p.m_context.data(), &QObject::destroyed, [h]() { h.destroy(); });
+            }
+            h.resume();
+        }
+    }
+
+    bool await_ready() const noexcept
+    {
+        return !m_handle || m_handle.done();
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        m_handle.promise().m_continuation = awaiting;
+        return m_handle;
+    }
+
+    T await_resume()
+    {
+        if constexpr (!std::is_void_v<T>) {
+            return std::move(*m_handle.promise().m_value);
+        }
+    }
+
+private:
+    handle_type m_handle;
+};
+
+template<typename T>
+inline MBTask<T> MBTaskDetail::Promise<T>::get_return_object()
+{
+    return MBTask<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline MBTask<void> MBTaskDetail::Promise<void>::get_return_object()
+{
+    return MBTask<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
@@ -0,0 +1,367 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#include <QDebug>
+#include <QPointer>
+#include <QtEndian>
+#include <mbtcpgateway.h>
+
+/* MBAP header: transaction, protocol, length, unit */
+#define MBAP_SIZE    7
+#define MBAP_MAX_PDU 253
+
+MBTcpGateway::MBTcpGateway(MBRtuClient* modbus, QObject* parent)
+    : QObject {parent}
+    , m_modbus(modbus)
+    , m_config()
+    , m_server(this)
+    , m_buffers()
+{
+    Q_ASSERT_X(m_modbus != 0L, Q_FUNC_INFO, "Null pointer modbus object!");
+
+    /* default configuration, local clients only */
+    m_config.m_address = QHostAddress::LocalHost;
+    m_config.m_port = 1502;
+    m_config.m_maxAge = 2000;
+    m_config.m_readThrough = true;
+    m_config.m_maxClients = 16;
+
+    connect(&m_server, &QTcpServer::newConnection, this, &MBTcpGateway::onNewConnection);
+}
+
+MBTcpGateway::~MBTcpGateway()
+{
+    close();
+}
+
+/* -------------------------------------------------------
+ * Api Methods
+ * ------------------------------------------------------- */
+
+const MBTcpGateway::TConfig& MBTcpGateway::config() const
+{
+    return m_config;
+}
+
+void MBTcpGateway::setConfig(const TConfig& config)
+{
+    m_config = config;
+}
+
+bool MBTcpGateway::listen()
+{
+    if (m_server.isListening()) {
+        m_server.close();
+    }
+    m_server.setMaxPendingConnections(m_config.m_maxClients);
+    if (!m_server.listen(m_config.m_address, m_config.m_port)) {
+        qWarning() << "MBGATE: Listen failed:" << m_config.m_address //
+                   << m_config.m_port << m_server.errorString();
+        return false;
+    }
+    qDebug() << "MBGATE: Listening on" << m_server.serverAddress() << m_server.serverPort();
+    return true;
+}
+
+void MBTcpGateway::close()
+{
+    m_server.close();
+    foreach (QTcpSocket* socket, m_buffers.keys()) {
+        socket->disconnect(this);
+        socket->abort();
+        socket->deleteLater();
+    }
+    m_buffers.clear();
+}
+
+bool MBTcpGateway::isListening() const
+{
+    return m_server.isListening();
+}
+
+quint16 MBTcpGateway::serverPort() const
+{
+    return m_server.serverPort();
+}
+
+/* -------------------------------------------------------
+ * Private Methods
+ * ------------------------------------------------------- */
+
+inline void MBTcpGateway::processFrame(QTcpSocket* socket, quint16 tid, quint8 unit, const QByteArray& pdu)
+{
+    const quint8 function = static_cast<quint8>(pdu.at(0));
+
+    /* unicast RTU addresses only */
+    if (unit < 1 || unit > 247) {
+        replyException(socket, tid, unit, function, EX_PATH_UNAVAILABLE);
+        return;
+    }
+
+    switch (function) {
+        case QModbusPdu::ReadCoils:
+        case QModbusPdu::ReadDiscreteInputs:
+        case QModbusPdu::ReadHoldingRegisters:
+        case QModbusPdu::ReadInputRegisters: {
+            processRead(socket, tid, unit, pdu);
+            break;
+        }
+        case QModbusPdu::WriteSingleCoil:
+        case QModbusPdu::WriteSingleRegister:
+        case QModbusPdu::WriteMultipleCoils:
+        case QModbusPdu::WriteMultipleRegisters: {
+            processWrite(socket, tid, unit, pdu);
+            break;
+        }
+        default: {
+            replyException(socket, tid, unit, function, EX_ILLEGAL_FUNCTION);
+            break;
+        }
+    }
+}
+
+inline void MBTcpGateway::processRead(QTcpSocket* socket, quint16 tid, quint8 unit, const QByteArray& pdu)
+{
+    const quint8 function = static_cast<quint8>(pdu.at(0));
+
+    if (pdu.size() != 5) {
+        replyException(socket, tid, unit, function, EX_ILLEGAL_VALUE);
+        return;
+    }
+
+    const quint16 start = qFromBigEndian<quint16>(pdu.constData() + 1);
+    const quint16 count = qFromBigEndian<quint16>(pdu.constData() + 3);
+
+    QModbusDataUnit::RegisterType type;
+    quint16 maxCount;
+    switch (function) {
+        case QModbusPdu::ReadCoils: {
+            type = QModbusDataUnit::Coils;
+            maxCount = 2000;
+            break;
+        }
+        case QModbusPdu::ReadDiscreteInputs: {
+            type = QModbusDataUnit::DiscreteInputs;
+            maxCount = 2000;
+            break;
+        }
+        case QModbusPdu::ReadHoldingRegisters: {
+            type = QModbusDataUnit::HoldingRegisters;
+            maxCount = 125;
+            break;
+        }
+        default: {
+            type = QModbusDataUnit::InputRegisters;
+            maxCount = 125;
+            break;
+        }
+    }
+
+    if (count < 1 || count > maxCount) {
+        replyException(socket, tid, unit, function, EX_ILLEGAL_VALUE);
+        return;
+    }
+    if (((uint) start + count) > 0x10000) {
+        replyException(socket, tid, unit, function, EX_ILLEGAL_ADDRESS);
+        return;
+    }
+
+    /* served from cache, no bus access */
+    QVector<quint16> values;
+    if (m_modbus->registerCache().lookup(unit, type, start, count, m_config.m_maxAge, &values)) {
+        reply(socket, tid, unit, encodeRead(function, values));
+        return;
+    }
+
+    if (!m_config.m_readThrough) {
+        replyException(socket, tid, unit, function, EX_TARGET_FAILED);
+        return;
+    }
+
+    /* fetch once, result refreshes the cache */
+    QPointer<QTcpSocket> client(socket);
+    m_modbus->read(unit, QModbusDataUnit(type, start, count))
+       .then(this, [this, client, tid, unit, function](const MBRtuRequest::TResult& result) {
+           if (!client) {
+               return;
+           }
+           if (result.m_status != MBRtuRequest::StatusSuccess || !result.m_isDataUnit) {
+               replyException(client, tid, unit, function, exceptionCode(result));
+               return;
+           }
+           reply(client, tid, unit, encodeRead(function, result.m_unit.values()));
+       });
+}
+
+inline void MBTcpGateway::processWrite(QTcpSocket* socket, quint16 tid, quint8 unit, const QByteArray& pdu)
+{
+    const quint8 function = static_cast<quint8>(pdu.at(0));
+
+    if (pdu.size() < 5) {
+        replyException(socket, tid, unit, function, EX_ILLEGAL_VALUE);
+        return;
+    }
+
+    QModbusRequest request(static_cast<QModbusPdu::FunctionCode>(function), pdu.mid(1));
+    if (!request.isValid()) {
+        replyException(socket, tid, unit, function, EX_ILLEGAL_VALUE);
+        return;
+    }
+
+    /* written range, single writes change one value */
+    const bool isCoil = (function == QModbusPdu::WriteSingleCoil || function == QModbusPdu::WriteMultipleCoils);
+    const QModbusDataUnit::RegisterType type = (isCoil ? QModbusDataUnit::Coils : QModbusDataUnit::HoldingRegisters);
+    const quint16 start = qFromBigEndian<quint16>(pdu.constData() + 1);
+    quint16 count = 1;
+    if (function == QModbusPdu::WriteMultipleCoils || function == QModbusPdu::WriteMultipleRegisters) {
+        count = qFromBigEndian<quint16>(pdu.constData() + 3);
+    }
+
+    /* writes bypass the cache and the poll queue */
+    QPointer<QTcpSocket> client(socket);
+    m_modbus->send(unit, request, MBRtuClient::PriorityHigh)
+       .then(this, [this, client, tid, unit, function, type, start, count](const MBRtuRequest::TResult& result) {
+           if (result.m_status == MBRtuRequest::StatusSuccess) {
+               /* next read sees the written values */
+               m_modbus->invalidateCache(unit, type, start, count);
+           }
+           if (!client) {
+               return;
+           }
+           if (result.m_status != MBRtuRequest::StatusSuccess) {
+               replyException(client, tid, unit, function, exceptionCode(result));
+               return;
+           }
+           QByteArray data;
+           data.append((char) result.m_response.functionCode());
+           data.append(result.m_response.data());
+           reply(client, tid, unit, data);
+       });
+}
+
+inline void MBTcpGateway::reply(QTcpSocket* socket, quint16 tid, quint8 unit, const QByteArray& pdu)
+{
+    QByteArray frame(MBAP_SIZE, 0);
+    qToBigEndian<quint16>(tid, frame.data());
+    qToBigEndian<quint16>(0, frame.data() + 2);
+    qToBigEndian<quint16>(pdu.size() + 1, frame.data() + 4);
+    frame[6] = (char) unit;
+    frame.append(pdu);
+    socket->write(frame);
+}
+
+inline void MBTcpGateway::replyException(QTcpSocket* socket, quint16 tid, quint8 unit, quint8 function, quint8 code)
+{
+    QByteArray pdu;
+    pdu.append((char) (function | 0x80));
+    pdu.append((char) code);
+    reply(socket, tid, unit, pdu);
+}
+
+inline QByteArray MBTcpGateway::encodeRead(quint8 function, const QVector<quint16>& values)
+{
+    QByteArray pdu;
+    pdu.append((char) function);
+
+    /* bit tables, LSB first */
+    if (function == QModbusPdu::ReadCoils || function == QModbusPdu::ReadDiscreteInputs) {
+        QByteArray bits((values.count() + 7) / 8, 0);
+        for (int i = 0; i < values.count(); i++) {
+            if (values[i]) {
+                bits[i / 8] = (char) (bits[i / 8] | (1 << (i % 8)));
+            }
+        }
+        pdu.append((char) bits.size());
+        pdu.append(bits);
+        return pdu;
+    }
+
+    pdu.append((char) (values.count() * 2));
+    foreach (quint16 value, values) {
+        pdu.append((char) ((value >> 8) & 0xff));
+        pdu.append((char) (value & 0xff));
+    }
+    return pdu;
+}
+
+inline quint8 MBTcpGateway::exceptionCode(const MBRtuRequest::TResult& result)
+{
+    /* answer of the server, e.g. illegal address or value */
+    if (result.m_response.isException()) {
+        return static_cast<quint8>(result.m_response.exceptionCode());
+    }
+    if (result.m_status == MBRtuRequest::StatusDropped || result.m_error == QModbusDevice::TimeoutError) {
+        return EX_TARGET_FAILED;
+    }
+    return EX_DEVICE_FAILURE;
+}
+
+/* -------------------------------------------------------
+ * Event Methods
+ * ------------------------------------------------------- */
+
+void MBTcpGateway::onNewConnection()
+{
+    QTcpSocket* socket;
+    while ((socket = m_server.nextPendingConnection())) {
+        if (m_buffers.count() >= m_config.m_maxClients) {
+            qWarning() << "MBGATE: Too many clients, reject" << socket->peerAddress();
+            socket->abort();
+            socket->deleteLater();
+            continue;
+        }
+        m_buffers.insert(socket, QByteArray());
+        connect(socket, &QTcpSocket::readyRead, this, &MBTcpGateway::onClientReadyRead);
+        connect(socket, &QTcpSocket::disconnected, this, &MBTcpGateway::onClientDisconnected);
+        qDebug() << "MBGATE: Client connected" << socket->peerAddress() << socket->peerPort();
+    }
+    emit clientsChanged(m_buffers.count());
+}
+
+void MBTcpGateway::onClientReadyRead()
+{
+    QTcpSocket* socket;
+    if (!(socket = dynamic_cast<QTcpSocket*>(sender())) || !m_buffers.contains(socket)) {
+        return;
+    }
+
+    QByteArray& buffer = m_buffers[socket];
+    buffer.append(socket->readAll());
+
+    while (buffer.size() >= MBAP_SIZE) {
+        const quint16 tid = qFromBigEndian<quint16>(buffer.constData());
+        const quint16 protocol = qFromBigEndian<quint16>(buffer.constData() + 2);
+        const quint16 length = qFromBigEndian<quint16>(buffer.constData() + 4);
+
+        /* not Modbus or broken framing, drop client */
+        if (protocol != 0 || length < 2 || length > (MBAP_MAX_PDU + 1)) {
+            qWarning() << "MBGATE: Invalid frame from" << socket->peerAddress();
+            socket->abort();
+            return;
+        }
+        if (buffer.size() < (6 + length)) {
+            break;
+        }
+
+        const quint8 unit = static_cast<quint8>(buffer.at(6));
+        const QByteArray pdu = buffer.mid(MBAP_SIZE, length - 1);
+        buffer.remove(0, 6 + length);
+
+        processFrame(socket, tid, unit, pdu);
+    }
+}
+
+void MBTcpGateway::onClientDisconnected()
+{
+    QTcpSocket* socket;
+    if (!(socket = dynamic_cast<QTcpSocket*>(sender()))) {
+        return;
+    }
+    qDebug() << "MBGATE: Client disconnected" << socket->peerAddress();
+    m_buffers.remove(socket);
+    socket->deleteLater();
+    emit clientsChanged(m_buffers.count());
+}
@@ -0,0 +1,115 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <QByteArray>
+#include <QHash>
+#include <QHostAddress>
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <mbrtuclient.h>
+
+/**
+ * @brief The Modbus TCP gateway to the RTU bus
+ * Serves TCP clients from the register cache of the RTU
+ * client while values are younger than max-age. Missed
+ * reads go to the bus once (read-through), writes are
+ * forwarded at high priority. The serial line load does
+ * not grow with the number of TCP clients or their rate.
+ */
+class MBTcpGateway: public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef struct Config {
+        QHostAddress m_address;
+        quint16 m_port;
+        /* oldest cached value served in ms */
+        qint64 m_maxAge;
+        /* read missed values from the bus */
+        bool m_readThrough;
+        int m_maxClients;
+    } TConfig;
+
+    /**
+     * @brief Default constructor
+     * @param modbus
+     * @param parent
+     */
+    explicit MBTcpGateway(MBRtuClient* modbus, QObject* parent = nullptr);
+    /**
+     * Destructor closes all connections
+     */
+    ~MBTcpGateway();
+    /**
+     * @brief config
+     * @return
+     */
+    const TConfig& config() const;
+    /**
+     * @brief setConfig
+     * Takes effect on next listen
+     * @param config
+     */
+    void setConfig(const TConfig& config);
+    /**
+     * @brief listen
+     * @return true if server is listening
+     */
+    bool listen();
+    /**
+     * @brief close
+     */
+    void close();
+    /**
+     * @brief isListening
+     * @return
+     */
+    bool isListening() const;
+    /**
+     * @brief serverPort
+     * @return Bound port, useful with port 0
+     */
+    quint16 serverPort() const;
+
+signals:
+    /**
+     * @brief clientsChanged
+     * @param count Connected TCP clients
+     */
+    void clientsChanged(int count);
+
+private slots:
+    void onNewConnection();
+    void onClientReadyRead();
+    void onClientDisconnected();
+
+private:
+    /* Modbus exception codes */
+    static const quint8 EX_ILLEGAL_FUNCTION = 0x01;
+    static const quint8 EX_ILLEGAL_ADDRESS = 0x02;
+    static const quint8 EX_ILLEGAL_VALUE = 0x03;
+    static const quint8 EX_DEVICE_FAILURE = 0x04;
+    static const quint8 EX_PATH_UNAVAILABLE = 0x0a;
+    static const quint8 EX_TARGET_FAILED = 0x0b;
+
+    MBRtuClient* m_modbus;
+    TConfig m_config;
+    QTcpServer m_server;
+    /* receive buffer per connection */
+    QHash<QTcpSocket*, QByteArray> m_buffers;
+
+private:
+    inline void processFrame(QTcpSocket* socket, quint16 tid, quint8 unit, const QByteArray& pdu);
+    inline void processRead(QTcpSocket* socket, quint16 tid, quint8 unit, const QByteArray& pdu);
+    inline void processWrite(QTcpSocket* socket, quint16 tid, quint8 unit, const QByteArray& pdu);
+    inline void reply(QTcpSocket* socket, quint16 tid, quint8 unit, const QByteArray& pdu);
+    inline void replyException(QTcpSocket* socket, quint16 tid, quint8 unit, quint8 function, quint8 code);
+    static inline QByteArray encodeRead(quint8 function, const QVector<quint16>& values);
+    static inline quint8 exceptionCode(const MBRtuRequest::TResult& result);
+};
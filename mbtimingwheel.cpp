@@ -0,0 +1,145 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#include <mbtimingwheel.h>
+
+MBTimingWheel::MBTimingWheel(int tick, QObject* parent)
+    : QObject {parent}
+    , m_clock()
+    , m_timer(this)
+    , m_tick(qMax(1, tick))
+    , m_now(0)
+    , m_nextId(0)
+    , m_slots()
+    , m_armed()
+{
+    /* QElapsedTimer uses CLOCK_MONOTONIC where available */
+    m_clock.start();
+
+    m_timer.setTimerType(Qt::PreciseTimer);
+    m_timer.setInterval(m_tick);
+    connect(&m_timer, &QTimer::timeout, this, &MBTimingWheel::onTick);
+}
+
+/* -------------------------------------------------------
+ * Api Methods
+ * ------------------------------------------------------- */
+
+qint64 MBTimingWheel::now() const
+{
+    return m_clock.elapsed();
+}
+
+quint64 MBTimingWheel::schedule(qint64 due, std::function<void()> fn)
+{
+    /* an idle wheel starts at the current tick */
+    if (m_armed.isEmpty()) {
+        m_now = m_clock.elapsed() / m_tick;
+    }
+
+    /* never before due, never in the running slot */
+    const qint64 tick = qMax((due + m_tick - 1) / m_tick, m_now + 1);
+    const quint64 id = ++m_nextId;
+
+    place({id, tick, std::move(fn)});
+
+    if (!m_timer.isActive()) {
+        m_timer.start();
+    }
+    return id;
+}
+
+void MBTimingWheel::cancel(quint64 id)
+{
+    auto it = m_armed.find(id);
+    if (it == m_armed.end()) {
+        return;
+    }
+
+    /* not found if its slot is running or cascading */
+    QList<TAction>& actions = m_slots[it.value() / SLOTS][it.value() % SLOTS];
+    for (int i = 0; i < actions.count(); i++) {
+        if (actions.at(i).m_id == id) {
+            actions.removeAt(i);
+            break;
+        }
+    }
+    m_armed.erase(it);
+
+    if (m_armed.isEmpty()) {
+        m_timer.stop();
+    }
+}
+
+int MBTimingWheel::count() const
+{
+    return m_armed.count();
+}
+
+/* -------------------------------------------------------
+ * Event Methods
+ * ------------------------------------------------------- */
+
+void MBTimingWheel::onTick()
+{
+    /* catch up all ticks passed since the last timeout */
+    const qint64 target = m_clock.elapsed() / m_tick;
+    while (m_now < target && !m_armed.isEmpty()) {
+        m_now++;
+
+        for (int level = 1; level < LEVELS; level++) {
+            if (m_now & ((1LL << (SLOT_BITS * level)) - 1)) {
+                break;
+            }
+            cascade(level);
+        }
+
+        QList<TAction> due;
+        due.swap(m_slots[0][m_now & (SLOTS - 1)]);
+        for (TAction& action : due) {
+            if (m_armed.remove(action.m_id) == 0) {
+                continue;
+            }
+            action.m_fn();
+        }
+    }
+
+    if (m_armed.isEmpty()) {
+        m_timer.stop();
+    }
+}
+
+/* -------------------------------------------------------
+ * Private Methods
+ * ------------------------------------------------------- */
+
+/* lowest level covering the distance, slot by due bits */
+inline void MBTimingWheel::place(TAction&& action)
+{
+    const qint64 due = qMax(action.m_due, m_now);
+    const qint64 delta = due - m_now;
+
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (1LL << (SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+
+    const int slot = (due >> (SLOT_BITS * level)) & (SLOTS - 1);
+    m_armed.insert(action.m_id, level * SLOTS + slot);
+    m_slots[level][slot].append(std::move(action));
+}
+
+/* move the current slot of a level one level down */
+inline void MBTimingWheel::cascade(int level)
+{
+    QList<TAction> actions;
+    actions.swap(m_slots[level][(m_now >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+    for (TAction& action : actions) {
+        if (m_armed.contains(action.m_id)) {
+            place(std::move(action));
+        }
+    }
+}
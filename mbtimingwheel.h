@@ -0,0 +1,89 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QTimer>
+#include <functional>
+
+/**
+ * @brief The hierarchical timing wheel of timed actions
+ * Four levels of 64 slots on the monotonic clock, insert
+ * in constant time, cancel unlinks the action and frees
+ * its functor at once. Due times are absolute, a
+ * late tick runs all passed slots without drift. The tick
+ * timer runs only while actions are armed.
+ */
+class MBTimingWheel: public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Default constructor
+     * @param tick Resolution in ms
+     * @param parent
+     */
+    explicit MBTimingWheel(int tick = 5, QObject* parent = nullptr);
+    /**
+     * @brief now
+     * @return Monotonic time of the wheel in ms
+     */
+    qint64 now() const;
+    /**
+     * @brief schedule
+     * Runs the functor at the first tick not before due,
+     * due times in the past run at the next tick.
+     * @param due Monotonic time in ms
+     * @param fn Functor
+     * @return Action id, never 0
+     */
+    quint64 schedule(qint64 due, std::function<void()> fn);
+    /**
+     * @brief cancel
+     * @param id Action id
+     */
+    void cancel(quint64 id);
+    /**
+     * @brief count
+     * @return Number of armed actions
+     */
+    int count() const;
+
+private slots:
+    void onTick();
+
+private:
+    enum {
+        LEVELS = 4,
+        SLOT_BITS = 6,
+        SLOTS = 1 << SLOT_BITS,
+    };
+
+    typedef struct {
+        quint64 m_id;
+        /* due time in ticks */
+        qint64 m_due;
+        std::function<void()> m_fn;
+    } TAction;
+
+    QElapsedTimer m_clock;
+    QTimer m_timer;
+    int m_tick;
+    /* last processed tick */
+    qint64 m_now;
+    quint64 m_nextId;
+    QList<TAction> m_slots[LEVELS][SLOTS];
+    /* armed ids and their slot, level * SLOTS + slot */
+    QHash<quint64, int> m_armed;
+
+private:
+    inline void place(TAction&& action);
+    inline void cascade(int level);
+};
@@ -18,7 +18,7 @@ QT += xml
 TEMPLATE = app
 
 ###
-CONFIG += c++17
+CONFIG += c++2a
 CONFIG += sdk_no_version_check
 CONFIG += nostrip
 CONFIG += debug
@@ -27,29 +27,72 @@ CONFIG += embed_translations
 CONFIG += create_prl
 CONFIG += app_bundle
 
+# coroutine support, see mbtask.h
+linux-g++*: QMAKE_CXXFLAGS += -fcoroutines
+
 #INCLUDEPATH += $$PWD/libmodbus/src
 #INCLUDEPATH += /usr/include/modbus
 
 #LIBS += -lmodbus
 
+# POSIX shared memory process image
+unix:!macx: LIBS += -lrt
+
 SOURCES += \
 	dlgadcindatatype.cpp \
 	dlgrelaylinkcontrol.cpp \
 	main.cpp \
 	mainwindow.cpp \
+	mbdashboardmodel.cpp \
+	mbdevicelogic.cpp \
+	mbdeviceprofile.cpp \
+	mbdiscovery.cpp \
+	mbhistorian.cpp \
+	mbhistorymodel.cpp \
+	mbportresolver.cpp \
+	mbprocessimage.cpp \
+	mbregistercache.cpp \
 	mbrtuclient.cpp \
+	mbrturequest.cpp \
+	mbserialrate.cpp \
+	mbspeedupgrade.cpp \
+	mbstatestore.cpp \
+	mbtcpgateway.cpp \
+	mbtimingwheel.cpp \
 	wsanaloginmbrtu.cpp \
 	wsmodbusrtu.cpp \
-	wsrelaydiginmbrtu.cpp
+	wsprofilembrtu.cpp \
+	wsrelaydiginmbrtu.cpp \
+	wsrenogympptmbrtu.cpp
 
 HEADERS += \
 	dlgadcindatatype.h \
 	dlgrelaylinkcontrol.h \
 	mainwindow.h \
+	mbdashboardmodel.h \
+	mbdevicelogic.h \
+	mbdeviceprofile.h \
+	mbdiscovery.h \
+	mbgorilla.h \
+	mbhistorian.h \
+	mbhistorymodel.h \
+	mbportresolver.h \
+	mbprocessimage.h \
+	mbregistercache.h \
 	mbrtuclient.h \
+	mbrturequest.h \
+	mbserialrate.h \
+	mbspeedupgrade.h \
+	mbspscqueue.h \
+	mbstatestore.h \
+	mbtask.h \
+	mbtcpgateway.h \
+	mbtimingwheel.h \
 	wsanaloginmbrtu.h \
 	wsmodbusrtu.h \
-	wsrelaydiginmbrtu.h
+	wsprofilembrtu.h \
+	wsrelaydiginmbrtu.h \
+	wsrenogympptmbrtu.h
 
 RESOURCES += \
 	assets.qrc
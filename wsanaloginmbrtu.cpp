@@ -125,57 +125,51 @@ void WSAnalogInMbRtu::setChannelType(quint8 channel, const TChannelType type, bo
  * Protected Methods
  * ------------------------------------------------------- */
 
-/* schedule inital queries */
-void WSAnalogInMbRtu::doModbusOpened()
+/* inital queries */
+MBTask<> WSAnalogInMbRtu::doInitDevice()
 {
-    scheduleFunction(ReadChannelTypes);
-    scheduleFunction(ReadDataValues);
+    MBRtuRequest types = readChannelTypes();
+    MBRtuRequest values = readDataValues();
+    co_await types;
+    co_await values;
 }
 
-/* schedule status query */
-void WSAnalogInMbRtu::startStatusWorker()
+/* status query */
+MBTask<> WSAnalogInMbRtu::doPollDevice()
 {
-    scheduleFunction(ReadDataValues);
+    co_await readDataValues();
 }
 
-/* handle status query */
-void WSAnalogInMbRtu::doFunction(uint function)
+bool WSAnalogInMbRtu::doMduInputRegisters(uint function, const QModbusDataUnit& unit)
 {
     switch (function) {
-        case ReadChannelTypes: {
-            readChannelTypes();
-            break;
-        }
-        case ReadDataValues: {
-            readDataValues();
-            break;
-        }
-    }
-}
-
-bool WSAnalogInMbRtu::doMduInputRegisters(const QModbusDataUnit& unit)
-{
-    switch (function()) {
         case ReadDataValues: {
             if (checkValueCount(8, unit)) {
+                QVector<float> analog;
+                QVector<double> samples;
                 for (uint i = 0; i < unit.valueCount(); i++) {
                     float value = unit.value(i);
                     // TODO: Dval to Volt: calculate something?
                     m_values[i] = value;
+                    analog.append(value);
+                    samples.append(value);
                     emit valueChanged(i, value);
                 }
+                publish(MBProcessImage::InputRegisters, 0, unit.values());
+                publishAnalog(0, analog);
+                record("ain", 0, samples);
                 return true;
             }
             break;
         }
     }
 
-    return WSModbusRtu::doMduInputRegisters(unit);
+    return WSModbusRtu::doMduInputRegisters(function, unit);
 }
 
-bool WSAnalogInMbRtu::doMduHoldingRegisters(const QModbusDataUnit& unit)
+bool WSAnalogInMbRtu::doMduHoldingRegisters(uint function, const QModbusDataUnit& unit)
 {
-    switch (function()) {
+    switch (function) {
         case ReadChannelTypes: {
             if (checkValueCount(8, unit)) {
                 for (uint i = 0; i < unit.valueCount(); i++) {
@@ -184,49 +178,36 @@ bool WSAnalogInMbRtu::doMduHoldingRegisters(const QModbusDataUnit& unit)
                     m_types[i] = type;
                     emit channelChanged(i, type);
                 }
+                publish(MBProcessImage::HoldingRegisters, 0, unit.values());
                 return true;
             }
             break;
         }
     }
 
-    return WSModbusRtu::doMduHoldingRegisters(unit);
+    return WSModbusRtu::doMduHoldingRegisters(function, unit);
 }
 
 /* -------------------------------------------------------
  * Private Methods
  * ------------------------------------------------------- */
 
-inline void WSAnalogInMbRtu::readChannelTypes()
+inline MBRtuRequest WSAnalogInMbRtu::readChannelTypes()
 {
     if (isTrace(MBRtuClient::TRACE_CONTROL)) {
         qDebug() << id() << "Read channel types";
     }
 
-    send(
-       ReadChannelTypes,
-       deviceAddress(),
-       QModbusRequest(
-          QModbusRequest::ReadHoldingRegisters,
-          (quint16) 0x1000, // 16bit Register start address
-          (quint8) 0x00,    // 16bit Number of channels HI
-          (quint8) 0x08)    // 16bit Number of channels LO
-    );
+    /* Register start address 0x1000, one per channel */
+    return track(ReadChannelTypes, bus()->readHolding(deviceAddress(), 0x1000, maxInputs()));
 }
 
-inline void WSAnalogInMbRtu::readDataValues()
+inline MBRtuRequest WSAnalogInMbRtu::readDataValues()
 {
     if (isTrace(MBRtuClient::TRACE_CONTROL)) {
         qDebug() << id() << "Read data values";
     }
 
-    send(
-       ReadDataValues,
-       deviceAddress(),
-       QModbusRequest(
-          QModbusRequest::ReadInputRegisters,
-          (quint16) 0x0000, // 16bit Register start address
-          (quint8) 0x00,    // 16bit Number of channels HI
-          (quint8) 0x08)    // 16bit Number of channels LO
-    );
+    /* Register start address 0x0000, one per channel */
+    return track(ReadDataValues, bus()->readInput(deviceAddress(), 0x0000, maxInputs()));
 }
@@ -56,19 +56,18 @@ signals:
     void valueChanged(quint8 channel, float value);
 
 protected:
-    void doModbusOpened() override;
-    void startStatusWorker() override;
-    void doFunction(uint function) override;
-    bool doMduInputRegisters(const QModbusDataUnit& unit) override;
-    bool doMduHoldingRegisters(const QModbusDataUnit& unit) override;
+    MBTask<> doInitDevice() override;
+    MBTask<> doPollDevice() override;
+    bool doMduInputRegisters(uint function, const QModbusDataUnit& unit) override;
+    bool doMduHoldingRegisters(uint function, const QModbusDataUnit& unit) override;
 
 private:
     QMap<quint8, float> m_values;
     QMap<quint8, TChannelType> m_types;
 
 private:
-    inline void readDataValues();
-    inline void readChannelTypes();
+    inline MBRtuRequest readDataValues();
+    inline MBRtuRequest readChannelTypes();
 };
 
 Q_DECLARE_METATYPE(WSAnalogInMbRtu::TAdcFunction);
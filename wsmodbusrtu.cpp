@@ -4,74 +4,127 @@
  * Written by B. Eschrich (bjoern.eschrich@gmail.com)
  * SPDX-License-Identifier: GPL v3
  **********************************************************************/
+#include <QDateTime>
 #include <QDebug>
+#include <chrono>
+#include <mbstatestore.h>
 #include <wsmodbusrtu.h>
 
-#define QUERY_STATUS_WITH_WORKER
-
 #define NULL_MBO_MSG "Modbus NULL pointer object!"
 #define CHECK_MODBUS(m)                                 \
     do {                                                \
         Q_ASSERT_X(m != 0L, Q_FUNC_INFO, NULL_MBO_MSG); \
     } while (false)
 
+bool WSModbusRtu::uartRegister(const qint32 baud, const QSerialPort::Parity parity, quint16* value)
+{
+    quint8 parval;
+    quint8 baudval;
+
+    switch (parity) {
+        case QSerialPort::Parity::NoParity: {
+            parval = 0x00;
+            break;
+        }
+        case QSerialPort::Parity::EvenParity: {
+            parval = 0x01;
+            break;
+        }
+        case QSerialPort::Parity::OddParity: {
+            parval = 0x02;
+            break;
+        }
+        default: {
+            return false;
+        }
+    }
+
+    switch (baud) {
+        case QSerialPort::Baud4800: {
+            baudval = 0x00;
+            break;
+        }
+        case QSerialPort::Baud9600: {
+            baudval = 0x01;
+            break;
+        }
+        case QSerialPort::Baud19200: {
+            baudval = 0x02;
+            break;
+        }
+        case QSerialPort::Baud38400: {
+            baudval = 0x03;
+            break;
+        }
+        case QSerialPort::Baud57600: {
+            baudval = 0x04;
+            break;
+        }
+        case QSerialPort::Baud115200: {
+            baudval = 0x05;
+            break;
+        }
+        case 128000: {
+            baudval = 0x06;
+            break;
+        }
+        case 256000: {
+            baudval = 0x07;
+            break;
+        }
+        default: {
+            return false;
+        }
+    }
+
+    /* parity HI byte, baud rate LO byte */
+    *value = (quint16) ((parval << 8) | baudval);
+    return true;
+}
+
 WSModbusRtu::WSModbusRtu(MBRtuClient* modbus, QObject* parent)
     : QObject {parent}
     , m_modbus(modbus)
     , m_fwVersion(0)
     , m_address(1)
-    , m_function(RtuUnspecified)
-    , m_funcQueue()
-    , m_timer(nullptr)
+    , m_pending(0)
+    , m_session(0)
 {
     CHECK_MODBUS(m_modbus);
     connect(m_modbus, &MBRtuClient::opened, this, &WSModbusRtu::onModbusOpened);
     connect(m_modbus, &MBRtuClient::closed, this, &WSModbusRtu::onModbusClosed);
-    connect(m_modbus, &MBRtuClient::received, this, &WSModbusRtu::onModbusReceived);
-    connect(m_modbus, &MBRtuClient::complete, this, &WSModbusRtu::onModbusComplete);
-    connect(m_modbus, &MBRtuClient::error, this, &WSModbusRtu::onModbusError);
 }
 
 WSModbusRtu::~WSModbusRtu()
 {
-    CHECK_MODBUS(m_modbus);
-    if (m_timer && m_timer->isActive()) {
-        m_timer->stop();
-        m_timer->deleteLater();
-    }
-    if (m_modbus->isOpen()) {
-        m_modbus->close();
-    }
+    /* the bus is shared with other drivers, stop
+     * own queries only and leave the port open. */
+    stopDevice();
 }
 
 /* -------------------------------------------------------
  * Api Methods
  * ------------------------------------------------------- */
 
-void WSModbusRtu::open()
+QFuture<bool> WSModbusRtu::open()
 {
     Q_ASSERT_X(m_modbus != 0L, Q_FUNC_INFO, "Null pointer modbus object!");
     if (!m_modbus->isOpen()) {
-        m_modbus->open();
-    }
-    else {
-        onModbusOpened();
+        return m_modbus->open();
     }
+    onModbusOpened();
+    return MBRtuClient::readyFuture(true);
 }
 
-void WSModbusRtu::close()
+QFuture<bool> WSModbusRtu::close()
 {
     CHECK_MODBUS(m_modbus);
-    if (m_timer && m_timer->isActive()) {
-        m_timer->stop();
-        m_timer->deleteLater();
-    }
+    stopDevice();
     if (m_modbus->isOpen()) {
-        m_modbus->close();
-    }
-    else {
-        onModbusClosed();
+        return m_modbus->close();
     }
+    onModbusClosed();
+    return MBRtuClient::readyFuture(true);
 }
 
 const quint16& WSModbusRtu::firmwareVersion() const
@@ -93,16 +146,6 @@ void WSModbusRtu::setQueryInterval(uint interval)
     }
 }
 
-const uint& WSModbusRtu::function() const
-{
-    return m_function;
-}
-
-void WSModbusRtu::scheduleFunction(const uint function)
-{
-    m_funcQueue.append(function);
-}
-
 const quint8& WSModbusRtu::deviceAddress() const
 {
     return m_address;
@@ -112,6 +155,8 @@ void WSModbusRtu::setDeviceAddress(const quint8 address, const bool updateDevice
 {
     if (m_address != address) {
         if (!updateDevice) {
+            /* image block follows the device address */
+            MBProcessImage::instance()->release(portName(), m_address);
             m_address = address;
             emit addressChanged(m_address);
             return;
@@ -120,8 +165,8 @@ void WSModbusRtu::setDeviceAddress(const quint8 address, const bool updateDevice
         if (m_modbus->isTrace(MBRtuClient::TRACE_CONTROL)) {
             qDebug() << id() << "Set Device Address:" << address;
         }
-        setFunction(RtuWriteDeviceAddr);
-        m_modbus->send(
+        send(
+           RtuWriteDeviceAddr,
            deviceAddress(),
            QModbusRequest( //
               QModbusRequest::WriteSingleRegister,
@@ -144,13 +189,13 @@ void WSModbusRtu::setPortName(const QString& name)
     m_modbus->setPortName(name);
 }
 
-const QSerialPort::BaudRate& WSModbusRtu::baudRate() const
+const qint32& WSModbusRtu::baudRate() const
 {
     CHECK_MODBUS(m_modbus);
     return m_modbus->baudRate();
 }
 
-void WSModbusRtu::setBaudRate(const QSerialPort::BaudRate rate, const bool updateDevice)
+void WSModbusRtu::setBaudRate(const qint32 rate, const bool updateDevice)
 {
     CHECK_MODBUS(m_modbus);
     if (m_modbus->baudRate() != rate) {
@@ -180,6 +225,14 @@ void WSModbusRtu::setParity(const QSerialPort::Parity parity, const bool updateD
     }
 }
 
+void WSModbusRtu::setUartParams(const qint32 baud, const QSerialPort::Parity parity)
+{
+    CHECK_MODBUS(m_modbus);
+    if (m_modbus->baudRate() != baud || m_modbus->parity() != parity) {
+        setDeviceUartParams(baud, parity);
+    }
+}
+
 const QSerialPort::DataBits& WSModbusRtu::dataBits() const
 {
     CHECK_MODBUS(m_modbus);
@@ -220,109 +273,103 @@ bool WSModbusRtu::isTrace(uint mask) const
     return m_modbus->isTrace(mask);
 }
 
-bool WSModbusRtu::isFunctionQueueEmpty() const
+MBRtuClient* WSModbusRtu::bus() const
 {
-    return m_funcQueue.isEmpty();
-}
-
-void WSModbusRtu::resetFunctionQueue()
-{
-    m_funcQueue.clear();
+    CHECK_MODBUS(m_modbus);
+    return m_modbus;
 }
 
-uint WSModbusRtu::takeFirstFunction()
+/* count request and dispatch its result on completion,
+ * the dispatch runs before awaiting coroutines resume. */
+MBRtuRequest WSModbusRtu::track(uint function, const MBRtuRequest& request)
 {
-    if (m_funcQueue.isEmpty()) {
-        return RtuUnspecified;
-    }
-    return m_funcQueue.takeFirst();
+    m_pending++;
+    request.then(this, [this, function](const MBRtuRequest::TResult& result) {
+        doRequestDone(function, result);
+    });
+    return request;
 }
 
-void WSModbusRtu::startStatusWorker()
+MBRtuRequest WSModbusRtu::send(uint function, quint8 device, const QModbusRequest& mr, const MBRtuClient::TPriority priority)
 {
-    /* nothing here, may overridden */
+    CHECK_MODBUS(m_modbus);
+    return track(function, m_modbus->send(device, mr, priority));
 }
 
-void WSModbusRtu::send(uint function, quint8 device, const QModbusRequest& mr)
+MBRtuRequest WSModbusRtu::read(uint function, quint8 device, const QModbusDataUnit& du)
 {
     CHECK_MODBUS(m_modbus);
-    setFunction(function);
-    m_modbus->send(device, mr);
+    return track(function, m_modbus->read(device, du));
 }
 
-void WSModbusRtu::read(uint function, quint8 device, const QModbusDataUnit& du)
+MBRtuRequest WSModbusRtu::write(uint function, quint8 device, const QModbusDataUnit& du)
 {
     CHECK_MODBUS(m_modbus);
-    setFunction(function);
-    m_modbus->read(device, du);
+    return track(function, m_modbus->write(device, du));
 }
 
-void WSModbusRtu::write(uint function, quint8 device, const QModbusDataUnit& du)
+uint WSModbusRtu::pendingRequests() const
 {
-    CHECK_MODBUS(m_modbus);
-    setFunction(function);
-    m_modbus->write(device, du);
+    return m_pending;
 }
 
 bool WSModbusRtu::checkValueCount(const uint count, const QModbusDataUnit& unit)
 {
     if (count != unit.valueCount()) {
-        qWarning() << id() << "Invalid number of values in function:" //
-                   << function() << "count:" << count;
+        qWarning() << id() << "Invalid number of values:" //
+                   << unit.valueCount() << "expected:" << count;
         return false;
     }
     return true;
 }
 
-void WSModbusRtu::readVersion()
+MBRtuRequest WSModbusRtu::readVersion()
 {
     CHECK_MODBUS(m_modbus);
     if (m_modbus->isTrace(MBRtuClient::TRACE_CONTROL)) {
         qDebug() << id() << "Read Version";
     }
 
-    setFunction(RtuReadVersion);
-    m_modbus->send(
-       deviceAddress(),
-       QModbusRequest(
-          QModbusRequest::ReadHoldingRegisters,
-          (quint16) 0x8000, // 16bit Command Register 'FW Version'
-          (quint8) 0x00,    // 16bit Fixed register value HI
-          (quint8) 0x01)    // 16bit Fixed register value LO
-    );
+    /* 16bit Command Register 'FW Version' */
+    return track(RtuReadVersion, m_modbus->readHolding(deviceAddress(), 0x8000, 1));
 }
 
-void WSModbusRtu::readDeviceAddress()
+MBRtuRequest WSModbusRtu::readDeviceAddress()
 {
     CHECK_MODBUS(m_modbus);
     if (m_modbus->isTrace(MBRtuClient::TRACE_CONTROL)) {
         qDebug() << id() << "Read Device Address";
     }
 
-    setFunction(RtuReadDeviceAddr);
-    m_modbus->send(
-       deviceAddress(),
-       QModbusRequest(
-          QModbusRequest::ReadHoldingRegisters,
-          (quint16) 0x4000, // 16bit Command Register 'Device Address'
-          (quint8) 0x00,    // 16bit Fixed register value HI
-          (quint8) 0x01)    // 16bit Fixed register value LO
-    );
+    /* 16bit Command Register 'Device Address' */
+    return track(RtuReadDeviceAddr, m_modbus->readHolding(deviceAddress(), 0x4000, 1));
+}
+
+/* initial queries, may overridden */
+MBTask<> WSModbusRtu::doInitDevice()
+{
+    co_return;
+}
+
+/* status queries, may overridden */
+MBTask<> WSModbusRtu::doPollDevice()
+{
+    co_return;
 }
 
-bool WSModbusRtu::doMduCoils(const QModbusDataUnit&)
+bool WSModbusRtu::doMduCoils(uint, const QModbusDataUnit&)
 {
     return false;
 }
 
-bool WSModbusRtu::doMduDiscreteInputs(const QModbusDataUnit&)
+bool WSModbusRtu::doMduDiscreteInputs(uint, const QModbusDataUnit&)
 {
     return false;
 }
 
-bool WSModbusRtu::doMduInputRegisters(const QModbusDataUnit& unit)
+bool WSModbusRtu::doMduInputRegisters(uint function, const QModbusDataUnit& unit)
 {
-    switch (function()) {
+    switch (function) {
         case RtuWriteDeviceAddr: {
             if (checkValueCount(2, unit) && unit.value(0) == 0x4000) {
                 /* set to object instance only */
@@ -337,9 +384,9 @@ bool WSModbusRtu::doMduInputRegisters(const QModbusDataUnit& unit)
     return false;
 }
 
-bool WSModbusRtu::doMduHoldingRegisters(const QModbusDataUnit& unit)
+bool WSModbusRtu::doMduHoldingRegisters(uint function, const QModbusDataUnit& unit)
 {
-    switch (function()) {
+    switch (function) {
         case RtuReadDeviceAddr: {
             if (checkValueCount(1, unit)) {
                 /* set to object instance only */
@@ -352,6 +399,7 @@ bool WSModbusRtu::doMduHoldingRegisters(const QModbusDataUnit& unit)
         case RtuReadVersion: {
             if (checkValueCount(1, unit)) {
                 m_fwVersion = unit.value(0);
+                MBProcessImage::instance()->publishFirmware(portName(), deviceAddress(), m_fwVersion);
             }
             return true;
         }
@@ -359,24 +407,55 @@ bool WSModbusRtu::doMduHoldingRegisters(const QModbusDataUnit& unit)
     return false;
 }
 
-void WSModbusRtu::doModbusOpened()
+/* write decoded state to the shared process image */
+void WSModbusRtu::publish(MBProcessImage::TTable table, quint16 index, const QVector<quint16>& values)
 {
+    MBProcessImage::instance()->publish(portName(), deviceAddress(), table, index, values);
+
+    /* tables in process image order */
+    QVector<double> state(values.begin(), values.end());
+    MBStateStore::instance()->update(portName(), deviceAddress(), static_cast<MBStateStore::TTable>(table), index, state);
 }
 
-void WSModbusRtu::doModbusClosed()
+void WSModbusRtu::publishAnalog(quint16 index, const QVector<float>& values)
 {
+    MBProcessImage::instance()->publishAnalog(portName(), deviceAddress(), index, values);
+
+    QVector<double> state(values.begin(), values.end());
+    MBStateStore::instance()->update(portName(), deviceAddress(), MBStateStore::Analog, index, state);
 }
 
-void WSModbusRtu::doModbusError(quint8, int, const QString&)
+/* batch of channel samples to the historian */
+void WSModbusRtu::record(const char* kind, quint16 index, const QVector<double>& values)
+{
+    MBHistorian* historian = MBHistorian::instance();
+    if (!historian->isOpen()) {
+        return;
+    }
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QVector<MBHistorian::TSample> samples;
+    samples.reserve(values.count());
+    for (int i = 0; i < values.count(); i++) {
+        const QString name = MBHistorian::seriesName(portName(), deviceAddress(), kind, index + i);
+        samples.append({historian->series(name), now, values[i]});
+    }
+    historian->append(samples);
+}
+
+void WSModbusRtu::doModbusOpened()
+{
+}
+
+void WSModbusRtu::doModbusClosed()
 {
 }
 
-void WSModbusRtu::doComplete(uint function)
+void WSModbusRtu::doModbusError(quint8, int, const QString&)
 {
-    setFunction(function);
 }
 
-void WSModbusRtu::doFunction(uint)
+void WSModbusRtu::doComplete(uint)
 {
 }
 
@@ -384,86 +463,154 @@ void WSModbusRtu::doFunction(uint)
  * Private Methods
  * ------------------------------------------------------- */
 
-inline void WSModbusRtu::setFunction(const uint function)
+/* end running device task at its next step */
+inline void WSModbusRtu::stopDevice()
 {
-    m_function = function;
+    m_session++;
 }
 
-inline void WSModbusRtu::setDeviceUartParams( //
-   const QSerialPort::BaudRate baud,
-   const QSerialPort::Parity parity)
+/* init sequence followed by the status cycle */
+MBTask<> WSModbusRtu::runDevice(quint64 session)
 {
-    CHECK_MODBUS(m_modbus);
-    if (m_modbus->isTrace(MBRtuClient::TRACE_CONTROL)) {
-        qDebug() << id() << "Set device UART parameters";
-    }
+    /* queue all at once, the bus pipelines them */
+    MBRtuRequest version = readVersion();
+    MBRtuRequest address = readDeviceAddress();
+    co_await version;
+    co_await address;
 
-    quint8 parval = 0x00;  // default: None
-    quint8 baudval = 0x01; // default: 9600
+    /* processing by derived classes */
+    if (session == m_session) {
+        co_await doInitDevice();
+    }
 
-    switch (parity) {
-        case QSerialPort::Parity::NoParity: {
-            parval = 0x00;
+    while (session == m_session && isValidModbus()) {
+        co_await std::chrono::milliseconds(queryInterval());
+        if (session != m_session || !isValidModbus()) {
             break;
         }
-        case QSerialPort::Parity::EvenParity: {
-            parval = 0x01;
+        co_await doPollDevice();
+    }
+
+    if (m_modbus->isTrace(MBRtuClient::TRACE_CONTROL)) {
+        qDebug() << id() << "Device task finished";
+    }
+}
+
+inline void WSModbusRtu::doRequestDone(uint function, const MBRtuRequest::TResult& result)
+{
+    if (m_pending > 0) {
+        m_pending--;
+    }
+
+    switch (result.m_status) {
+        case MBRtuRequest::StatusSuccess: {
+            if (m_modbus->isTrace(MBRtuClient::TRACE_CONTROL)) {
+                qDebug() << id() << "FUNC>" << function                   //
+                         << "RSP>" << result.m_response                   //
+                         << "UNIT>" << result.m_isDataUnit                //
+                         << "RT:" << Qt::dec << result.m_unit.registerType() //
+                         << "VC:" << Qt::dec << result.m_unit.valueCount()   //
+                         << "VD:" << Qt::hex << result.m_unit.values();
+            }
+            if (result.m_isDataUnit) {
+                dispatchDataUnit(function, result.m_unit);
+            }
             break;
         }
-        case QSerialPort::Parity::OddParity: {
-            parval = 0x02;
+        case MBRtuRequest::StatusFailed: {
+            if (m_modbus->isTrace(MBRtuClient::TRACE_CONTROL)) {
+                qCritical() << id() << "Modbus error:" << result.m_error << result.m_message;
+            }
+            /* keep polling on timeout, the client quarantines
+             * the device and drops polls until it answers. */
+            if (result.m_error != QModbusDevice::TimeoutError) {
+                stopDevice();
+            }
+            emit errorOccured(result.m_server, result.m_error, result.m_message);
+            /* processing by derived classes */
+            doModbusError(result.m_server, result.m_error, result.m_message);
             break;
         }
         default: {
-            qWarning() << id() << "Unsupported UART parameter. Parity:" << parity;
+            /* dropped, device quarantined or bus closed */
+            if (m_modbus->isTrace(MBRtuClient::TRACE_CONTROL)) {
+                qDebug() << id() << "Modbus request dropped. Function:" << function;
+            }
             return;
         }
     }
 
-    switch (baud) {
-        case QSerialPort::BaudRate::Baud4800: {
-            baudval = 0x00;
-            break;
-        }
-        case QSerialPort::BaudRate::Baud9600: {
-            baudval = 0x01;
-            break;
-        }
-        case QSerialPort::BaudRate::Baud19200: {
-            baudval = 0x02;
+    if (m_modbus->isTrace(MBRtuClient::TRACE_CONTROL)) {
+        qDebug() << id() << "Modbus complete";
+    }
+
+    emit complete(deviceAddress(), function);
+
+    doComplete(function);
+}
+
+inline void WSModbusRtu::dispatchDataUnit(uint function, const QModbusDataUnit& unit)
+{
+    switch (unit.registerType()) {
+        case QModbusDataUnit::Coils: {
+            doMduCoils(function, unit);
             break;
         }
-        case QSerialPort::BaudRate::Baud38400: {
-            baudval = 0x03;
+        case QModbusDataUnit::DiscreteInputs: {
+            doMduDiscreteInputs(function, unit);
             break;
         }
-        case QSerialPort::BaudRate::Baud57600: {
-            baudval = 0x04;
+        case QModbusDataUnit::InputRegisters: {
+            doMduInputRegisters(function, unit);
             break;
         }
-        case QSerialPort::BaudRate::Baud115200: {
-            baudval = 0x05;
+        case QModbusDataUnit::HoldingRegisters: {
+            doMduHoldingRegisters(function, unit);
             break;
         }
         default: {
-            /* 0x06 = 128000 and 0x07 = 256000 not supported by QT */
-            qWarning() << id() << "Unsupported UART parameter. BaudRate:" << baud;
-            return;
+            qWarning() << id() << "Unhandled modbus data unit:" //
+                       << unit.registerType();
+            break;
         }
     }
+}
+
+inline void WSModbusRtu::setDeviceUartParams( //
+   const qint32 baud,
+   const QSerialPort::Parity parity)
+{
+    CHECK_MODBUS(m_modbus);
+    if (m_modbus->isTrace(MBRtuClient::TRACE_CONTROL)) {
+        qDebug() << id() << "Set device UART parameters";
+    }
 
-    setFunction(RtuWriteUartParams);
-    m_modbus->send(
-       deviceAddress(),
-       QModbusRequest( //
-          QModbusRequest::WriteSingleRegister,
-          (quint16) 0x2000, // 16bit uart config register
-          (quint8) parval,  // 16bit parity - byte HI
-          (quint8) baudval) // 16bit baud rate - byte LO
-    );
+    quint16 value;
+    if (!uartRegister(baud, parity, &value)) {
+        qWarning() << id() << "Unsupported UART parameter. BaudRate:" << baud << "Parity:" << parity;
+        return;
+    }
 
-    m_modbus->setBaudRate(baud);
-    m_modbus->setParity(parity);
+    applyUartParams(value, baud, parity).start();
+}
+
+/* The device answers at the old rate and switches after
+ * the reply, the line follows only on success. Retuned
+ * between frames, other drivers of the line keep running. */
+MBTask<> WSModbusRtu::applyUartParams(quint16 value, qint32 baud, QSerialPort::Parity parity)
+{
+    const MBRtuRequest::TResult result = co_await track( //
+       RtuWriteUartParams,
+       m_modbus->writeRegister(deviceAddress(), 0x2000, value));
+    if (result.m_status != MBRtuRequest::StatusSuccess) {
+        qWarning() << id() << "UART parameters not accepted, line unchanged.";
+        co_return;
+    }
+
+    MBRtuClient::TConfig config = m_modbus->config();
+    config.m_baudRate = baud;
+    config.m_parity = parity;
+    m_modbus->retuneLine(config);
 }
 
 /* -------------------------------------------------------
@@ -476,24 +623,12 @@ void WSModbusRtu::onModbusOpened()
         qDebug() << id() << "Modbus opened";
     }
 
-    /* reset internals */
-    setFunction(RtuUnspecified);
-    resetFunctionQueue();
-
-    /* schedule inital queries */
-    scheduleFunction(RtuReadVersion);
-    scheduleFunction(RtuReadDeviceAddr);
-
     /* processing by derived classes */
     doModbusOpened();
 
-    m_timer = new QTimer(this);
-    connect(m_timer, &QTimer::destroyed, this, &WSModbusRtu::onTimerDestroyed);
-    connect(m_timer, &QTimer::timeout, this, &WSModbusRtu::onWorkerQueue);
-    m_timer->setTimerType(Qt::PreciseTimer);
-    m_timer->setSingleShot(false);
-    m_timer->setInterval(50);
-    m_timer->start();
+    /* replace a running task, starts at once */
+    stopDevice();
+    runDevice(m_session).start();
 
     /* notify consumer */
     emit opened(deviceAddress());
@@ -505,162 +640,10 @@ void WSModbusRtu::onModbusClosed()
         qDebug() << id() << "Modbus closed";
     }
 
-    if (m_timer && m_timer->isActive()) {
-        m_timer->stop();
-        m_timer->deleteLater();
-    }
+    stopDevice();
 
     /* processing by derived classes */
     doModbusClosed();
 
     emit closed(deviceAddress());
 }
-
-void WSModbusRtu::onModbusError(uint server, const int code, const QString& message)
-{
-    /* skip, if event context not mine */
-    if (server != deviceAddress() || function() == RtuUnspecified) {
-        return;
-    }
-
-    if (m_modbus->isTrace(MBRtuClient::TRACE_CONTROL)) {
-        qCritical() << id() << "Modbus error:" << code << message;
-    }
-
-    if (m_timer && m_timer->isActive()) {
-        m_timer->stop();
-        m_timer->deleteLater();
-    }
-
-    emit errorOccured(server, code, message);
-
-    /* processing by derived classes */
-    doModbusError(server, code, message);
-}
-
-void WSModbusRtu::onModbusReceived(uint server, const QModbusResponse& resp, const QModbusDataUnit& unit, bool isDataUnit)
-{
-    /* skip, if event context not mine */
-    if (server != deviceAddress() || function() == RtuUnspecified) {
-        return;
-    }
-
-    if (m_modbus->isTrace(MBRtuClient::TRACE_CONTROL)) {
-        qDebug() << id() << "FUNC>" << function()           //
-                 << "RSP>" << resp                          //
-                 << "UNIT>" << isDataUnit                   //
-                 << "RT:" << Qt::dec << unit.registerType() //
-                 << "VC:" << Qt::dec << unit.valueCount()   //
-                 << "VD:" << Qt::hex << unit.values();
-    }
-
-    if (isDataUnit) {
-        switch (unit.registerType()) {
-            case QModbusDataUnit::Coils: {
-                doMduCoils(unit);
-                break;
-            }
-            case QModbusDataUnit::DiscreteInputs: {
-                doMduDiscreteInputs(unit);
-                break;
-            }
-            case QModbusDataUnit::InputRegisters: {
-                doMduInputRegisters(unit);
-                break;
-            }
-            case QModbusDataUnit::HoldingRegisters: {
-                doMduHoldingRegisters(unit);
-                break;
-            }
-            default: {
-                qWarning() << id() << "Unhandled modbus data unit:" //
-                           << unit.registerType();
-                break;
-            }
-        }
-    }
-}
-
-void WSModbusRtu::onModbusComplete(uint server)
-{
-    /* skip, if event context not mine */
-    if (server != deviceAddress() || function() == RtuUnspecified) {
-        return;
-    }
-
-    if (m_modbus->isTrace(MBRtuClient::TRACE_CONTROL)) {
-        qDebug() << id() << "Modbus complete";
-    }
-
-    emit complete(deviceAddress(), function());
-
-    doComplete(function());
-
-    /* reset current progress */
-    setFunction(RtuUnspecified);
-}
-
-void WSModbusRtu::onWorkerQueue()
-{
-    /* nothing to do or just in work */
-    if (isFunctionQueueEmpty() || function() != RtuUnspecified) {
-        return;
-    }
-
-    QTimer* timer;
-    if (!(timer = dynamic_cast<QTimer*>(sender()))) {
-        qDebug() << id() << "OOPS! Sender object not timer!";
-        resetFunctionQueue();
-        return;
-    }
-
-    /* kill timer if modbus closed */
-    if (!isValidModbus()) {
-        timer->stop();
-        timer->deleteLater();
-        resetFunctionQueue();
-        return;
-    }
-
-    uint function;
-    switch ((function = takeFirstFunction())) {
-        case RtuReadVersion: {
-            readVersion();
-            break;
-        }
-        case RtuReadDeviceAddr: {
-            readDeviceAddress();
-            break;
-        }
-        default: {
-            doFunction(function);
-            break;
-        }
-    }
-
-#if defined(QUERY_STATUS_WITH_WORKER)
-    /* restart query cycle */
-    if (isFunctionQueueEmpty()) {
-        /* derived class schedule queries */
-        startStatusWorker();
-        /* remove timer if nothing to do */
-        if (isFunctionQueueEmpty()) {
-            timer->stop();
-            timer->deleteLater();
-            return;
-        }
-        /* update timer to query interval */
-        if (timer->interval() != ((int) queryInterval())) {
-            timer->setInterval(queryInterval());
-        }
-    }
-#endif
-}
-
-void WSModbusRtu::onTimerDestroyed()
-{
-    if (m_modbus->isTrace(MBRtuClient::TRACE_CONTROL)) {
-        qDebug() << id() << "Timer destroyed";
-    }
-    m_timer = nullptr;
-}
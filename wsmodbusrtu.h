@@ -7,15 +7,17 @@
 #pragma once
 #include <QObject>
 #include <QSerialPort>
-#include <QTimer>
 #include <QWidget>
+#include <mbhistorian.h>
+#include <mbprocessimage.h>
 #include <mbrtuclient.h>
+#include <mbtask.h>
 
 /**
  * @brief The base class for Waveshare Modbus RTU devices
- * This class can be used in a multi threaded app. All
- * commands scheduled in a background queue and is fully
- * event driven.
+ * This class can be used in a multi threaded app. Device
+ * init and status polling run as MBTask coroutines, each
+ * step continues directly on completion of its request.
  */
 class WSModbusRtu: public QObject
 {
@@ -32,6 +34,9 @@ public:
     };
     Q_ENUM(TRtuFunction)
 
+    /* value of the UART config register 0x2000 */
+    static bool uartRegister(const qint32 baud, const QSerialPort::Parity parity, quint16* value);
+
     explicit WSModbusRtu(MBRtuClient* modbus, QObject* parent = nullptr);
 
     ~WSModbusRtu();
@@ -41,8 +46,8 @@ public:
     virtual quint8 maxOutputs() const = 0;
     virtual QWidget* settingsWidget(QWidget* parent) = 0;
 
-    void open();
-    void close();
+    QFuture<bool> open();
+    QFuture<bool> close();
 
     const quint16& firmwareVersion() const;
 
@@ -52,19 +57,18 @@ public:
     const uint& queryInterval() const;
     void setQueryInterval(uint interval);
 
-    const uint& function() const;
-
-    void scheduleFunction(const uint function);
-
     const QString& portName() const;
     void setPortName(const QString& name);
 
-    const QSerialPort::BaudRate& baudRate() const;
-    void setBaudRate(const QSerialPort::BaudRate rate, const bool updateDevice = false);
+    const qint32& baudRate() const;
+    void setBaudRate(const qint32 rate, const bool updateDevice = false);
 
     const QSerialPort::Parity& parity() const;
     void setParity(const QSerialPort::Parity parity, const bool updateDevice = false);
 
+    /* reprogram the device, the line follows after its reply */
+    void setUartParams(const qint32 baud, const QSerialPort::Parity parity);
+
     const QSerialPort::DataBits& dataBits() const;
     void setDataBits(const QSerialPort::DataBits bits);
 
@@ -83,34 +87,32 @@ signals:
 
 protected:
     bool isTrace(uint mask) const;
-    void send(uint function, quint8 device, const QModbusRequest& mr);
-    void read(uint function, quint8 device, const QModbusDataUnit& du);
-    void write(uint function, quint8 device, const QModbusDataUnit& du);
+    MBRtuClient* bus() const;
+    MBRtuRequest track(uint function, const MBRtuRequest& request);
+    MBRtuRequest send(uint function, quint8 device, const QModbusRequest& mr, const MBRtuClient::TPriority priority = MBRtuClient::PriorityNormal);
+    MBRtuRequest read(uint function, quint8 device, const QModbusDataUnit& du);
+    MBRtuRequest write(uint function, quint8 device, const QModbusDataUnit& du);
+    uint pendingRequests() const;
     bool checkValueCount(const uint count, const QModbusDataUnit& unit);
-    bool isFunctionQueueEmpty() const;
-    void resetFunctionQueue();
-    uint takeFirstFunction();
-    virtual void readVersion();
-    virtual void readDeviceAddress();
-    virtual void startStatusWorker();
-    virtual bool doMduCoils(const QModbusDataUnit& unit);
-    virtual bool doMduDiscreteInputs(const QModbusDataUnit& unit);
-    virtual bool doMduInputRegisters(const QModbusDataUnit& unit);
-    virtual bool doMduHoldingRegisters(const QModbusDataUnit& unit);
+    void publish(MBProcessImage::TTable table, quint16 index, const QVector<quint16>& values);
+    void publishAnalog(quint16 index, const QVector<float>& values);
+    void record(const char* kind, quint16 index, const QVector<double>& values);
+    virtual MBRtuRequest readVersion();
+    virtual MBRtuRequest readDeviceAddress();
+    virtual MBTask<> doInitDevice();
+    virtual MBTask<> doPollDevice();
+    virtual bool doMduCoils(uint function, const QModbusDataUnit& unit);
+    virtual bool doMduDiscreteInputs(uint function, const QModbusDataUnit& unit);
+    virtual bool doMduInputRegisters(uint function, const QModbusDataUnit& unit);
+    virtual bool doMduHoldingRegisters(uint function, const QModbusDataUnit& unit);
     virtual void doModbusOpened();
     virtual void doModbusClosed();
     virtual void doModbusError(quint8 server, int code, const QString& message);
     virtual void doComplete(uint function = RtuUnspecified);
-    virtual void doFunction(uint function = RtuUnspecified);
 
 private slots:
     void onModbusOpened();
     void onModbusClosed();
-    void onModbusError(uint server, const int, const QString&);
-    void onModbusReceived(uint server, const QModbusResponse&, const QModbusDataUnit&, bool);
-    void onModbusComplete(uint server);
-    void onWorkerQueue();
-    void onTimerDestroyed();
 
 private:
     /* modbus RTU client */
@@ -121,16 +123,18 @@ private:
     quint8 m_address;
     /* status query interval */
     uint m_interval;
-    /* holds current command function */
-    uint m_function;
-    /* function queue */
-    QList<uint> m_funcQueue;
-    /* Query timer */
-    QTimer* m_timer;
+    /* requests in flight or queued on the bus */
+    uint m_pending;
+    /* device task generation, bumped to stop polling */
+    quint64 m_session;
 
 private:
-    inline void setDeviceUartParams(const QSerialPort::BaudRate baud, const QSerialPort::Parity parity);
-    inline void setFunction(const uint function);
+    inline void setDeviceUartParams(const qint32 baud, const QSerialPort::Parity parity);
+    inline void stopDevice();
+    MBTask<> runDevice(quint64 session);
+    MBTask<> applyUartParams(quint16 value, qint32 baud, QSerialPort::Parity parity);
+    inline void doRequestDone(uint function, const MBRtuRequest::TResult& result);
+    inline void dispatchDataUnit(uint function, const QModbusDataUnit& unit);
 };
 
 Q_DECLARE_METATYPE(WSModbusRtu::TRtuFunction)
@@ -0,0 +1,166 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#include <QDebug>
+#include <cmath>
+#include <limits>
+#include <wsprofilembrtu.h>
+
+WSProfileMbRtu::WSProfileMbRtu(const MBDeviceProfile& profile, MBRtuClient* modbus, QObject* parent)
+    : WSModbusRtu {modbus, parent}
+    , m_profile(profile)
+    , m_id()
+    , m_values(profile.points().count(), std::numeric_limits<double>::quiet_NaN())
+    , m_clock()
+    , m_polled(profile.pollClasses().count(), 0)
+{
+    m_id = QStringLiteral("PROFILE[%1]:").arg(m_profile.name()).toUtf8();
+
+    /* fastest class paces the poll loop by default */
+    uint base = std::numeric_limits<uint>::max();
+    foreach (const MBDeviceProfile::TPollClass& pc, m_profile.pollClasses()) {
+        base = qMin(base, pc.m_interval);
+    }
+
+    m_clock.start();
+
+    setDeviceAddress(m_profile.defaultAddress(), false);
+    if (!m_polled.isEmpty()) {
+        setQueryInterval(base);
+    }
+}
+
+WSProfileMbRtu::~WSProfileMbRtu()
+{
+}
+
+/* -------------------------------------------------------
+ * Api Methods
+ * ------------------------------------------------------- */
+
+const char* WSProfileMbRtu::id() const
+{
+    return m_id.constData();
+}
+
+quint8 WSProfileMbRtu::maxInputs() const
+{
+    return (quint8) qMin(m_values.count(), 0xff);
+}
+
+quint8 WSProfileMbRtu::maxOutputs() const
+{
+    return 0;
+}
+
+QWidget* WSProfileMbRtu::settingsWidget(QWidget*)
+{
+    return nullptr;
+}
+
+const MBDeviceProfile& WSProfileMbRtu::profile() const
+{
+    return m_profile;
+}
+
+double WSProfileMbRtu::value(int point) const
+{
+    return m_values.value(point, std::numeric_limits<double>::quiet_NaN());
+}
+
+/* -------------------------------------------------------
+ * Protected Methods
+ * ------------------------------------------------------- */
+
+/* no Waveshare command registers on profile devices */
+MBRtuRequest WSProfileMbRtu::readVersion()
+{
+    return skipped();
+}
+
+MBRtuRequest WSProfileMbRtu::readDeviceAddress()
+{
+    return skipped();
+}
+
+/* inital queries */
+MBTask<> WSProfileMbRtu::doInitDevice()
+{
+    co_await readBlocks(true);
+}
+
+/* status queries */
+MBTask<> WSProfileMbRtu::doPollDevice()
+{
+    co_await readBlocks(false);
+}
+
+/* -------------------------------------------------------
+ * Private Methods
+ * ------------------------------------------------------- */
+
+MBTask<> WSProfileMbRtu::readBlocks(bool all)
+{
+    const QList<MBDeviceProfile::TPollClass>& classes = m_profile.pollClasses();
+    const QVector<MBDeviceProfile::TBlock>& blocks = m_profile.blocks();
+
+    /* due by elapsed time, half a loop early is on time */
+    const qint64 now = m_clock.elapsed();
+    QVector<bool> isDue(classes.count(), all);
+    for (int c = 0; c < classes.count(); c++) {
+        if (all || now - m_polled[c] + queryInterval() / 2 >= classes[c].m_interval) {
+            isDue[c] = true;
+            m_polled[c] = now;
+        }
+    }
+
+    /* queue all due blocks at once, the bus pipelines them */
+    QVector<int> due;
+    QVector<MBRtuRequest> requests;
+    for (int i = 0; i < blocks.count(); i++) {
+        const MBDeviceProfile::TBlock& block = blocks[i];
+        if (!isDue[block.m_pollClass]) {
+            continue;
+        }
+        due.append(i);
+        requests.append(read(ReadProfileBlock, deviceAddress(), QModbusDataUnit(block.m_table, block.m_start, block.m_count)));
+    }
+
+    for (int i = 0; i < requests.count(); i++) {
+        const MBRtuRequest::TResult result = co_await requests[i];
+        if (result.m_status == MBRtuRequest::StatusSuccess && result.m_isDataUnit) {
+            decodeBlock(blocks[due[i]], result.m_unit);
+        }
+    }
+}
+
+inline void WSProfileMbRtu::decodeBlock(const MBDeviceProfile::TBlock& block, const QModbusDataUnit& unit)
+{
+    if (!checkValueCount(block.m_count, unit)) {
+        return;
+    }
+
+    const QVector<quint16> values = unit.values();
+    foreach (const MBDeviceProfile::TDecoder& decoder, block.m_decoders) {
+        const double value = MBDeviceProfile::decode(decoder, values);
+        if (value == m_values[decoder.m_point]) {
+            continue;
+        }
+        m_values[decoder.m_point] = value;
+        emit valueChanged(decoder.m_point, value);
+
+        publishAnalog(decoder.m_point, {(float) value});
+        record("point", decoder.m_point, {value});
+    }
+}
+
+/* completed request, runDevice continues at once */
+inline MBRtuRequest WSProfileMbRtu::skipped()
+{
+    MBRtuRequest request = MBRtuRequest::create(deviceAddress());
+    request.complete({MBRtuRequest::StatusSuccess, deviceAddress(), 0, {}, {}, {}, false});
+    return request;
+}
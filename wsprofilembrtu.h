@@ -0,0 +1,72 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QVector>
+#include <QWidget>
+#include <mbdeviceprofile.h>
+#include <mbrtuclient.h>
+#include <wsmodbusrtu.h>
+
+/**
+ * @brief The generic register map driver class
+ * Runs the polling plan of a compiled device profile. Each
+ * poll reads the blocks of the poll classes whose interval
+ * elapsed, all queued at once, and decodes the points by
+ * their descriptors. The query interval only sets the pace.
+ * Only changed values are emitted, published and recorded.
+ */
+class WSProfileMbRtu: public WSModbusRtu
+{
+    Q_OBJECT
+
+public:
+    enum TProfileFunction {
+        ReadProfileBlock = RtuCustomStart + 0x0301,
+    };
+    Q_ENUM(TProfileFunction)
+
+    explicit WSProfileMbRtu(const MBDeviceProfile& profile, MBRtuClient* modbus, QObject* parent = nullptr);
+
+    ~WSProfileMbRtu();
+
+    const char* id() const override;
+    quint8 maxInputs() const override;
+    quint8 maxOutputs() const override;
+    QWidget* settingsWidget(QWidget* parent) override;
+
+    const MBDeviceProfile& profile() const;
+
+    /* last decoded value, NaN until read */
+    double value(int point) const;
+
+signals:
+    void valueChanged(int point, double value);
+
+protected:
+    MBRtuRequest readVersion() override;
+    MBRtuRequest readDeviceAddress() override;
+    MBTask<> doInitDevice() override;
+    MBTask<> doPollDevice() override;
+
+private:
+    MBDeviceProfile m_profile;
+    QByteArray m_id;
+    QVector<double> m_values;
+    QElapsedTimer m_clock;
+    /* time in ms of the last poll per class */
+    QVector<qint64> m_polled;
+
+private:
+    MBTask<> readBlocks(bool all);
+    inline void decodeBlock(const MBDeviceProfile::TBlock& block, const QModbusDataUnit& unit);
+    inline MBRtuRequest skipped();
+};
+
+Q_DECLARE_METATYPE(WSProfileMbRtu::TProfileFunction)
@@ -5,19 +5,48 @@
  * SPDX-License-Identifier: GPL v3
  **********************************************************************/
 #include <QDebug>
+#include <QPointer>
 #include <QTimer>
 #include <dlgrelaylinkcontrol.h>
 #include <wsrelaydiginmbrtu.h>
 
-#define QUERY_STATUS_WITH_WORKER
-
 WSRelayDigInMbRtu::WSRelayDigInMbRtu(MBRtuClient* modbus, QObject* parent)
     : WSModbusRtu {modbus, parent}
     , m_relays()
     , m_dinputs()
+    , m_combineTimer(this)
+    , m_combineMask(0)
+    , m_combineState(0)
+    , m_combineBusy(false)
+    , m_combineRetries(0)
+    , m_pulses()
+    , m_wheel(5, this)
+    , m_sequences()
+    , m_nextSequence(0)
+    , m_captureTimer(this)
+    , m_capture(false)
+    , m_captureBusy(false)
+    , m_captureValid(false)
+    , m_captureShare(50)
+    , m_captureMask(0)
+    , m_captureStamp(0)
+    , m_edgeCounts()
+    , m_edgeOverruns(0)
+    , m_edges(1024)
 {
     setDeviceAddress(3, false);
     setQueryInterval(2000);
+
+    /* about one frame time at 9600 baud */
+    m_combineTimer.setSingleShot(true);
+    m_combineTimer.setTimerType(Qt::PreciseTimer);
+    m_combineTimer.setInterval(10);
+    connect(&m_combineTimer, &QTimer::timeout, this, &WSRelayDigInMbRtu::onCombineTimer);
+
+    /* idle gap between capture reads */
+    m_captureTimer.setSingleShot(true);
+    m_captureTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_captureTimer, &QTimer::timeout, this, &WSRelayDigInMbRtu::onCaptureTimer);
 }
 
 WSRelayDigInMbRtu::~WSRelayDigInMbRtu()
@@ -59,15 +88,25 @@ void WSRelayDigInMbRtu::setRelayStatus(const quint8 relay, const bool state)
         return;
     }
 
-    send(
-       (relay < 0xff ? UpdateRelay : WriteRelayStatus),
-       deviceAddress(),
-       QModbusRequest( //
-          QModbusRequest::WriteSingleCoil,
-          (quint16) (relay & 0x00ff),     // 16bit coil address
-          (quint8) (state ? 0xff : 0x00), // 16bit state - byte HI
-          (quint8) 0x00)                  // 16bit state - byte LO
-    );
+    /* cancels the end of armed pulses */
+    for (quint8 b = 0; b < maxOutputs(); b++) {
+        if (relay == 0xff || relay == b) {
+            m_pulses[b]++;
+        }
+    }
+
+    if (m_combineTimer.interval() == 0) {
+        writeRelay(relay, state);
+        return;
+    }
+
+    /* last writer wins per relay */
+    const quint8 bits = (relay == 0xff ? 0xff : (1 << relay));
+    m_combineMask |= bits;
+    m_combineState = (state ? (m_combineState | bits) : (m_combineState & ~bits));
+    if (!m_combineTimer.isActive() && !m_combineBusy) {
+        m_combineTimer.start();
+    }
 }
 
 void WSRelayDigInMbRtu::setAllRelays(const quint8 mask)
@@ -76,22 +115,208 @@ void WSRelayDigInMbRtu::setAllRelays(const quint8 mask)
         qDebug() << id() << "Set relay mask:" << Qt::hex << mask;
     }
 
-    /* Save relay mask for later processing in response
-     * event. This command does not reflect the 'mask'
-     * in the modbus response unit. */
-    setProperty("rmask", QVariant::fromValue(mask));
+    /* overrides pending changes and armed pulses */
+    m_combineMask = 0;
+    for (quint8 b = 0; b < maxOutputs(); b++) {
+        m_pulses[b]++;
+    }
+    writeRelayMask(mask);
+}
 
-    send(
-       WriteRelayMask,
-       deviceAddress(),
-       QModbusRequest( //
-          QModbusRequest::WriteMultipleCoils,
-          (quint16) 0x0000, // 16bit Relay Start Address
-          (quint8) 0x00,    // 16bit Number of relays (Fixed: 0x00) HI
-          (quint8) 0x08,    // 16bit Number of relays (Fixed: 0x08) LO
-          (quint8) 0x01,    // 16bit Number of bit masks (Fixed 0x01)
-          (quint8) mask)    // Relay bit mask
-    );
+void WSRelayDigInMbRtu::flashOn(const quint8 relay, const uint msecs)
+{
+    pulseRelay(relay, true, msecs);
+}
+
+void WSRelayDigInMbRtu::flashOff(const quint8 relay, const uint msecs)
+{
+    pulseRelay(relay, false, msecs);
+}
+
+void WSRelayDigInMbRtu::pulseRelay(const quint8 relay, const bool state, const uint msecs)
+{
+    if (isTrace(MBRtuClient::TRACE_CONTROL)) {
+        qDebug() << id() << "Pulse relay:" << relay << state << msecs << "ms";
+    }
+
+    if (relay >= maxOutputs()) {
+        qCritical() << id() << "Invalid relay number:" << relay;
+        return;
+    }
+
+    /* a combined write would undo the pulse */
+    if (m_combineMask & (1 << relay)) {
+        m_combineMask &= ~(1 << relay);
+    }
+
+    writeFlash(relay, state, msecs);
+}
+
+int WSRelayDigInMbRtu::runSequence(const QVector<TSequenceStep>& steps)
+{
+    if (steps.isEmpty()) {
+        return 0;
+    }
+    for (const TSequenceStep& step : steps) {
+        if (step.m_relay >= maxOutputs() && step.m_relay != 0xff) {
+            qCritical() << id() << "Invalid relay number:" << step.m_relay;
+            return 0;
+        }
+    }
+
+    const int sequence = ++m_nextSequence;
+    const qint64 planned = m_wheel.now() + steps[0].m_delay;
+    const quint64 action = m_wheel.schedule(planned, [this, sequence]() {
+        runStep(sequence);
+    });
+    m_sequences.insert(sequence, {steps, planned, 0, 0, action});
+
+    if (isTrace(MBRtuClient::TRACE_CONTROL)) {
+        qDebug() << id() << "Run sequence:" << sequence << "steps:" << steps.count();
+    }
+    return sequence;
+}
+
+void WSRelayDigInMbRtu::stopSequence(int sequence)
+{
+    auto it = m_sequences.find(sequence);
+    if (it == m_sequences.end()) {
+        return;
+    }
+
+    m_wheel.cancel(it->m_action);
+    m_sequences.erase(it);
+    emit sequenceDone(sequence, false);
+}
+
+void WSRelayDigInMbRtu::setInputCapture(bool enable, uint share)
+{
+    m_captureShare = qBound(1u, share, 100u);
+    if (m_capture == enable) {
+        return;
+    }
+
+    if (isTrace(MBRtuClient::TRACE_CONTROL)) {
+        qDebug() << id() << "Input capture:" << enable << "share:" << m_captureShare << "%";
+    }
+
+    m_capture = enable;
+    if (!enable) {
+        m_captureTimer.stop();
+        return;
+    }
+
+    m_captureValid = false;
+    for (quint8 ch = 0; ch < maxInputs(); ch++) {
+        m_edgeCounts[ch].store(0, std::memory_order_relaxed);
+    }
+    m_edgeOverruns.store(0, std::memory_order_relaxed);
+    captureInputs();
+}
+
+bool WSRelayDigInMbRtu::isInputCapture() const
+{
+    return m_capture;
+}
+
+quint64 WSRelayDigInMbRtu::edgeCount(const quint8 channel) const
+{
+    if (channel >= maxInputs()) {
+        return 0;
+    }
+    return m_edgeCounts[channel].load(std::memory_order_relaxed);
+}
+
+quint64 WSRelayDigInMbRtu::edgeOverruns() const
+{
+    return m_edgeOverruns.load(std::memory_order_relaxed);
+}
+
+bool WSRelayDigInMbRtu::takeEdge(TInputEdge* edge)
+{
+    return m_edges.pop(edge);
+}
+
+void WSRelayDigInMbRtu::broadcastRelays(const QList<WSRelayDigInMbRtu*>& boards, const quint8 mask, bool verify)
+{
+    if (boards.isEmpty()) {
+        return;
+    }
+
+    WSRelayDigInMbRtu* first = boards.first();
+    MBRtuClient* line = first->bus();
+    if (first->isTrace(MBRtuClient::TRACE_CONTROL)) {
+        qDebug() << first->id() << "Broadcast relay mask:" << Qt::hex << mask << "boards:" << boards.count();
+    }
+
+    QList<QPointer<WSRelayDigInMbRtu>> targets;
+    foreach (WSRelayDigInMbRtu* board, boards) {
+        if (board->bus() != line) {
+            qWarning() << board->id() << "Not on line" << line->portName() << "skipped broadcast";
+            continue;
+        }
+        /* overrides pending changes */
+        board->m_combineMask = 0;
+        targets.append(board);
+    }
+
+    /* boards switch at frame end, none of them replies */
+    auto done = [targets, mask, verify](const MBRtuRequest::TResult& result) {
+        if (result.m_status != MBRtuRequest::StatusSuccess) {
+            qWarning() << "WRELAY:" << "Broadcast failed:" << result.m_message;
+            return;
+        }
+        foreach (const QPointer<WSRelayDigInMbRtu>& board, targets) {
+            if (!board) {
+                continue;
+            }
+            if (!verify) {
+                board->syncRelays(mask);
+                continue;
+            }
+            /* read backs queue behind the turnaround delay */
+            WSRelayDigInMbRtu* target = board.data();
+            target->readRelayStatus().then(target, [target, mask](const MBRtuRequest::TResult& status) {
+                if (status.m_status != MBRtuRequest::StatusSuccess || !status.m_isDataUnit) {
+                    return;
+                }
+                quint8 actual = 0;
+                for (uint i = 0; i < status.m_unit.valueCount() && i < 8; i++) {
+                    actual |= (status.m_unit.value(i) ? (1 << i) : 0);
+                }
+                if (actual != mask) {
+                    qWarning() << target->id() << "Broadcast not applied by" << (uint) target->deviceAddress() //
+                               << "mask:" << Qt::hex << mask << "actual:" << actual;
+                }
+            });
+        }
+    };
+
+    line->send(
+           MBRtuClient::BROADCAST,
+           QModbusRequest( //
+              QModbusRequest::WriteMultipleCoils,
+              (quint16) 0x0000, // 16bit Relay Start Address
+              (quint8) 0x00,    // 16bit Number of relays (Fixed: 0x00) HI
+              (quint8) 0x08,    // 16bit Number of relays (Fixed: 0x08) LO
+              (quint8) 0x01,    // 16bit Number of bit masks (Fixed 0x01)
+              (quint8) mask),   // Relay bit mask
+           MBRtuClient::PriorityHigh)
+       .then(first, done);
+}
+
+void WSRelayDigInMbRtu::setCombineWindow(int msecs)
+{
+    m_combineTimer.setInterval(qMax(0, msecs));
+    if (msecs <= 0 && m_combineMask) {
+        m_combineTimer.stop();
+        flushRelays();
+    }
+}
+
+int WSRelayDigInMbRtu::combineWindow() const
+{
+    return m_combineTimer.interval();
 }
 
 void WSRelayDigInMbRtu::setControlModes(const QMap<quint8, TControlMode>& modes, bool updateDevice)
@@ -180,75 +405,76 @@ bool WSRelayDigInMbRtu::digitalInput(const quint8 channel) const
  * Protected Methods
  * ------------------------------------------------------- */
 
-/* schedule inital queries */
-void WSRelayDigInMbRtu::doModbusOpened()
-{
-    scheduleFunction(ReadControlMode);
-    scheduleFunction(ReadRelayStatus);
-    scheduleFunction(ReadDigitalInput);
-}
-
-/* schedule status queries */
-void WSRelayDigInMbRtu::startStatusWorker()
+/* inital queries */
+MBTask<> WSRelayDigInMbRtu::doInitDevice()
 {
-    scheduleFunction(ReadDigitalInput);
-    scheduleFunction(ReadRelayStatus);
+    MBRtuRequest modes = readControlModes();
+    MBRtuRequest relays = readRelayStatus();
+    MBRtuRequest inputs = readInputStatus();
+    co_await modes;
+    co_await relays;
+    co_await inputs;
 }
 
-/* handle status query */
-void WSRelayDigInMbRtu::doFunction(uint function)
+/* status queries */
+MBTask<> WSRelayDigInMbRtu::doPollDevice()
 {
-    switch (function) {
-        case ReadControlMode: {
-            readControlModes();
-            break;
-        }
-        case ReadRelayStatus: {
-            readRelayStatus();
-            break;
-        }
-        case ReadDigitalInput: {
-            readInputStatus();
-            break;
-        }
+    /* capture keeps the inputs current */
+    MBRtuRequest inputs = (m_capture ? MBRtuRequest() : readInputStatus());
+    MBRtuRequest relays = readRelayStatus();
+    if (!inputs.isNull()) {
+        co_await inputs;
     }
+    co_await relays;
 }
 
-bool WSRelayDigInMbRtu::doMduCoils(const QModbusDataUnit& unit)
+bool WSRelayDigInMbRtu::doMduCoils(uint function, const QModbusDataUnit& unit)
 {
-    switch (function()) {
+    switch (function) {
         case ReadRelayStatus: {
+            QVector<double> samples;
             for (uint i = 0; i < unit.valueCount(); i++) {
                 bool state = (unit.value(i) == 1 ? true : false);
                 m_relays[i] = state;
+                samples.append(state);
                 emit relayChanged(i, state);
             }
+            publish(MBProcessImage::Coils, 0, unit.values());
+            record("coil", 0, samples);
             return true;
         }
     }
 
-    return WSModbusRtu::doMduCoils(unit);
+    return WSModbusRtu::doMduCoils(function, unit);
 }
 
-bool WSRelayDigInMbRtu::doMduDiscreteInputs(const QModbusDataUnit& unit)
+bool WSRelayDigInMbRtu::doMduDiscreteInputs(uint function, const QModbusDataUnit& unit)
 {
-    switch (function()) {
+    switch (function) {
         case ReadDigitalInput: {
+            QVector<double> samples;
             for (uint i = 0; i < unit.valueCount(); i++) {
                 bool state = (unit.value(i) == 1 ? true : false);
                 m_dinputs[i] = state;
+                samples.append(state);
                 emit inputChanged(i, state);
             }
+            publish(MBProcessImage::DiscreteInputs, 0, unit.values());
+            record("din", 0, samples);
+            return true;
+        }
+        case CaptureDigitalInput: {
+            /* handled by request completion */
             return true;
         }
     }
 
-    return WSModbusRtu::doMduDiscreteInputs(unit);
+    return WSModbusRtu::doMduDiscreteInputs(function, unit);
 }
 
-bool WSRelayDigInMbRtu::doMduInputRegisters(const QModbusDataUnit& unit)
+bool WSRelayDigInMbRtu::doMduInputRegisters(uint function, const QModbusDataUnit& unit)
 {
-    switch (function()) {
+    switch (function) {
         case UpdateRelay: {
             if (checkValueCount(2, unit)) {
                 quint8 relay = unit.value(0);
@@ -256,6 +482,8 @@ bool WSRelayDigInMbRtu::doMduInputRegisters(const QModbusDataUnit& unit)
 
                 m_relays[relay] = state;
                 emit relayChanged(relay, state);
+                publish(MBProcessImage::Coils, relay, {(quint16) state});
+                record("coil", relay, {(double) state});
                 return true;
             }
 
@@ -273,40 +501,27 @@ bool WSRelayDigInMbRtu::doMduInputRegisters(const QModbusDataUnit& unit)
                     m_relays[i] = state;
                     emit relayChanged(i, state);
                 }
+                publish(MBProcessImage::Coils, 0, QVector<quint16>(maxOutputs(), state));
+                record("coil", 0, QVector<double>(maxOutputs(), state));
                 return true;
             }
 
             break;
         }
-        case WriteRelayMask: {
-            if (checkValueCount(2, unit)) {
-                QVariant rmask = property("rmask");
-                if (!rmask.isNull() && rmask.isValid()) {
-                    quint8 mask = rmask.value<quint8>();
-                    /* sync local state map before send!! */
-                    for (quint8 b = 0; b < maxOutputs(); b++) {
-                        if ((mask & (1 << b)) != 0) {
-                            m_relays[b] = true;
-                        }
-                        else {
-                            m_relays[b] = false;
-                        }
-                        emit relayChanged(b, m_relays[b]);
-                    }
-                    return true;
-                }
-            }
-
-            break;
+        case WriteRelayMask:
+        case SetFlashOnInterval:
+        case SetFlashOffInterval: {
+            /* handled by request completion */
+            return checkValueCount(2, unit);
         }
     }
 
-    return WSModbusRtu::doMduInputRegisters(unit);
+    return WSModbusRtu::doMduInputRegisters(function, unit);
 }
 
-bool WSRelayDigInMbRtu::doMduHoldingRegisters(const QModbusDataUnit& unit)
+bool WSRelayDigInMbRtu::doMduHoldingRegisters(uint function, const QModbusDataUnit& unit)
 {
-    switch (function()) {
+    switch (function) {
         case ReadControlMode: {
             if (checkValueCount(maxOutputs(), unit)) {
                 for (uint i = 0; i < unit.valueCount(); i++) {
@@ -316,6 +531,7 @@ bool WSRelayDigInMbRtu::doMduHoldingRegisters(const QModbusDataUnit& unit)
 
                     emit modeChanged(i, mode);
                 }
+                publish(MBProcessImage::HoldingRegisters, 0, unit.values());
                 return true;
             }
 
@@ -323,7 +539,7 @@ bool WSRelayDigInMbRtu::doMduHoldingRegisters(const QModbusDataUnit& unit)
         }
     }
 
-    return WSModbusRtu::doMduHoldingRegisters(unit);
+    return WSModbusRtu::doMduHoldingRegisters(function, unit);
 }
 
 /* -------------------------------------------------------
@@ -331,55 +547,337 @@ bool WSRelayDigInMbRtu::doMduHoldingRegisters(const QModbusDataUnit& unit)
  * ------------------------------------------------------- */
 
 /* Query Relay ON / OFF Status */
-inline void WSRelayDigInMbRtu::readRelayStatus()
+inline MBRtuRequest WSRelayDigInMbRtu::readRelayStatus()
 {
     if (isTrace(MBRtuClient::TRACE_CONTROL)) {
         qDebug() << id() << "Read Relay Status";
     }
 
-    send(
-       ReadRelayStatus,
-       deviceAddress(),
-       QModbusRequest(
-          QModbusRequest::ReadCoils,
-          (quint16) 0x0000, // 16bit Relay Start Address
-          (quint8) 0x00,    // 16bit Number of relays HI
-          (quint8) 0x08)    // 16bit Number of relays LO
-    );
+    /* Relay Start Address 0x0000, 8 relays */
+    return track(ReadRelayStatus, bus()->readCoils(deviceAddress(), 0x0000, maxOutputs()));
 }
 
 /* Query Relay Control Status */
-inline void WSRelayDigInMbRtu::readControlModes()
+inline MBRtuRequest WSRelayDigInMbRtu::readControlModes()
 {
     if (isTrace(MBRtuClient::TRACE_CONTROL)) {
         qDebug() << id() << "Read Relay Control Modes";
     }
 
-    send(
-       ReadControlMode,
+    /* Control Mode Start Address 0x1000, one per relay */
+    return track(ReadControlMode, bus()->readHolding(deviceAddress(), 0x1000, maxOutputs()));
+}
+
+inline MBRtuRequest WSRelayDigInMbRtu::writeRelay(const quint8 relay, const bool state, const MBRtuClient::TPriority priority)
+{
+    return send(
+       (relay < 0xff ? UpdateRelay : WriteRelayStatus),
+       deviceAddress(),
+       QModbusRequest( //
+          QModbusRequest::WriteSingleCoil,
+          (quint16) (relay & 0x00ff),     // 16bit coil address
+          (quint8) (state ? 0xff : 0x00), // 16bit state - byte HI
+          (quint8) 0x00),                 // 16bit state - byte LO
+       priority);
+}
+
+inline MBRtuRequest WSRelayDigInMbRtu::writeRelayMask(const quint8 mask)
+{
+    /* This command does not reflect the 'mask' in the
+     * modbus response unit, the request keeps it. */
+    auto done = [this, mask](const MBRtuRequest::TResult& result) {
+        if (result.m_status == MBRtuRequest::StatusSuccess) {
+            syncRelays(mask);
+        }
+    };
+
+    return send(
+       WriteRelayMask,
+       deviceAddress(),
+       QModbusRequest( //
+          QModbusRequest::WriteMultipleCoils,
+          (quint16) 0x0000, // 16bit Relay Start Address
+          (quint8) 0x00,    // 16bit Number of relays (Fixed: 0x00) HI
+          (quint8) 0x08,    // 16bit Number of relays (Fixed: 0x08) LO
+          (quint8) 0x01,    // 16bit Number of bit masks (Fixed 0x01)
+          (quint8) mask)    // Relay bit mask
+       )
+       .then(this, done);
+}
+
+/* Flash on 0x0200 + relay, flash off 0x0400 + relay, the
+ * coil value is the interval in 100 ms units. The module
+ * switches back itself, the local state follows by timer. */
+inline MBRtuRequest WSRelayDigInMbRtu::writeFlash(const quint8 relay, const bool state, const uint msecs)
+{
+    const quint16 ticks = (quint16) qBound<uint>(1, (msecs + 50) / 100, 0x7fff);
+    const uint pulse = ++m_pulses[relay];
+
+    auto done = [this, relay, state, ticks, pulse](const MBRtuRequest::TResult& result) {
+        if (result.m_status != MBRtuRequest::StatusSuccess) {
+            return;
+        }
+        updateRelay(relay, state);
+        QTimer::singleShot(ticks * 100, this, [this, relay, state, pulse]() {
+            if (m_pulses.value(relay) == pulse) {
+                updateRelay(relay, !state);
+            }
+        });
+    };
+
+    return send(
+       (state ? SetFlashOnInterval : SetFlashOffInterval),
        deviceAddress(),
-       QModbusRequest(
-          QModbusRequest::ReadHoldingRegisters,
-          (quint16) 0x1000, // 16bit Relay Start Address
-          (quint8) 0x00,    // 16bit Number of relays HI
-          (quint8) 0x08)    // 16bit Number of relays LO
-    );
+       QModbusRequest( //
+          QModbusRequest::WriteSingleCoil,
+          (quint16) ((state ? 0x0200 : 0x0400) + relay), // 16bit flash on / off address
+          (quint8) (ticks >> 8),                         // 16bit interval x 100ms - byte HI
+          (quint8) (ticks & 0xff))                       // 16bit interval x 100ms - byte LO
+       )
+       .then(this, done);
+}
+
+inline void WSRelayDigInMbRtu::updateRelay(const quint8 relay, const bool state)
+{
+    m_relays[relay] = state;
+    emit relayChanged(relay, state);
+    publish(MBProcessImage::Coils, relay, {(quint16) state});
+    record("coil", relay, {(double) state});
+}
+
+/* Sends the next step ahead of polls and arms the one
+ * after it. Plan times are absolute, bus latency of a
+ * step does not shift the following steps. */
+inline void WSRelayDigInMbRtu::runStep(int sequence)
+{
+    auto it = m_sequences.find(sequence);
+    if (it == m_sequences.end()) {
+        return;
+    }
+
+    const int step = it->m_next++;
+    const TSequenceStep s = it->m_steps[step];
+    const qint64 planned = it->m_planned;
+    const qint64 sent = m_wheel.now();
+
+    it->m_action = 0;
+    if (it->m_next < it->m_steps.count()) {
+        it->m_planned += it->m_steps[it->m_next].m_delay;
+        it->m_action = m_wheel.schedule(it->m_planned, [this, sequence]() {
+            runStep(sequence);
+        });
+    }
+    it->m_pending++;
+
+    /* the step wins over pulse ends and combined writes */
+    for (quint8 b = 0; b < maxOutputs(); b++) {
+        if (s.m_relay == 0xff || s.m_relay == b) {
+            m_pulses[b]++;
+            m_combineMask &= ~(1 << b);
+        }
+    }
+
+    auto done = [this, sequence, step, planned, sent](const MBRtuRequest::TResult& result) {
+        const qint64 latency = m_wheel.now() - sent;
+        auto it = m_sequences.find(sequence);
+        if (it == m_sequences.end()) {
+            return;
+        }
+
+        it->m_pending--;
+        if (result.m_status != MBRtuRequest::StatusSuccess) {
+            qWarning() << id() << "Sequence" << sequence << "step" << step << "failed:" << result.m_message;
+            m_wheel.cancel(it->m_action);
+            m_sequences.erase(it);
+            emit sequenceDone(sequence, false);
+            return;
+        }
+
+        if (isTrace(MBRtuClient::TRACE_CONTROL)) {
+            qDebug() << id() << "Sequence" << sequence << "step" << step //
+                     << "skew:" << (sent - planned) << "ms latency:" << latency << "ms";
+        }
+        emit sequenceStep(sequence, step, sent - planned, latency);
+
+        if (it->m_pending == 0 && it->m_next >= it->m_steps.count()) {
+            m_sequences.erase(it);
+            emit sequenceDone(sequence, true);
+        }
+    };
+
+    writeRelay(s.m_relay, s.m_state, MBRtuClient::PriorityHigh).then(this, done);
+}
+
+/* One FC02 read at a time ahead of normal requests. The
+ * idle gap after a read keeps capture within its share
+ * of bus time, the rest stays for polls of the line. */
+inline void WSRelayDigInMbRtu::captureInputs()
+{
+    if (!m_capture || m_captureBusy) {
+        return;
+    }
+    m_captureBusy = true;
+
+    auto done = [this](const MBRtuRequest::TResult& result) {
+        m_captureBusy = false;
+        if (!m_capture) {
+            return;
+        }
+
+        if (result.m_status != MBRtuRequest::StatusSuccess || !result.m_isDataUnit || !result.m_txStamp) {
+            /* no spinning on a dead line, the next window spans the gap */
+            m_captureTimer.start(250);
+            return;
+        }
+
+        const qint64 busy = result.m_rxStamp - result.m_txStamp;
+        captureEdges(result.m_unit, result.m_txStamp + busy / 2);
+        m_captureTimer.start((int) (busy * (100 - m_captureShare) / m_captureShare / 1000));
+    };
+
+    const QModbusDataUnit unit(QModbusDataUnit::DiscreteInputs, 0x0000, maxInputs());
+    track(CaptureDigitalInput, bus()->read(deviceAddress(), unit, MBRtuClient::PriorityHigh)).then(this, done);
+}
+
+/* XOR against the previous sample, one edge per changed bit */
+inline void WSRelayDigInMbRtu::captureEdges(const QModbusDataUnit& unit, qint64 stamp)
+{
+    quint8 mask = 0;
+    for (uint i = 0; i < unit.valueCount() && i < maxInputs(); i++) {
+        if (unit.value(i)) {
+            mask |= (1 << i);
+        }
+    }
+
+    /* the first sample has no reference */
+    const quint8 changed = (m_captureValid ? mask ^ m_captureMask : 0xff);
+    const qint64 window = stamp - m_captureStamp;
+
+    bool queued = false;
+    for (quint8 ch = 0; ch < maxInputs(); ch++) {
+        if (!(changed & (1 << ch))) {
+            continue;
+        }
+
+        const bool state = (mask & (1 << ch));
+        m_dinputs[ch] = state;
+        emit inputChanged(ch, state);
+        publish(MBProcessImage::DiscreteInputs, ch, {(quint16) state});
+        record("din", ch, {(double) state});
+
+        if (!m_captureValid) {
+            continue;
+        }
+
+        m_edgeCounts[ch].fetch_add(1, std::memory_order_relaxed);
+        if (!m_edges.push({stamp, window, ch, state})) {
+            m_edgeOverruns.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        queued = true;
+    }
+
+    m_captureMask = mask;
+    m_captureStamp = stamp;
+    m_captureValid = true;
+
+    if (queued) {
+        emit edgesCaptured();
+    }
+}
+
+/* sync local state map */
+inline void WSRelayDigInMbRtu::syncRelays(const quint8 mask)
+{
+    QVector<quint16> coils;
+    QVector<double> samples;
+    for (quint8 b = 0; b < maxOutputs(); b++) {
+        m_relays[b] = ((mask & (1 << b)) != 0);
+        coils.append(m_relays[b]);
+        samples.append(m_relays[b]);
+        emit relayChanged(b, m_relays[b]);
+    }
+    publish(MBProcessImage::Coils, 0, coils);
+    record("coil", 0, samples);
+}
+
+/* one mask write of known state and pending changes */
+inline void WSRelayDigInMbRtu::flushRelays()
+{
+    if (!m_combineMask || m_combineBusy) {
+        return;
+    }
+
+    const quint8 changed = m_combineMask;
+    const quint8 state = m_combineState;
+    m_combineMask = 0;
+
+    /* state unknown before the first read, no mask write */
+    quint8 known = 0;
+    for (quint8 b = 0; b < maxOutputs(); b++) {
+        if (!m_relays.contains(b) && !(changed & (1 << b))) {
+            for (quint8 r = 0; r < maxOutputs(); r++) {
+                if (changed & (1 << r)) {
+                    writeRelay(r, (state & (1 << r)) != 0);
+                }
+            }
+            return;
+        }
+        if (m_relays.value(b)) {
+            known |= (1 << b);
+        }
+    }
+
+    const quint8 mask = (known & ~changed) | (state & changed);
+    if (isTrace(MBRtuClient::TRACE_CONTROL)) {
+        qDebug() << id() << "Combined relay write:" << Qt::hex << changed << mask;
+    }
+
+    /* changes during the write go into the next one */
+    m_combineBusy = true;
+    writeRelayMask(mask).then(this, [this, changed, state](const MBRtuRequest::TResult& result) {
+        m_combineBusy = false;
+        if (result.m_status == MBRtuRequest::StatusSuccess) {
+            m_combineRetries = 0;
+        }
+        else if (m_combineRetries++ < 1) {
+            /* requeue once, newer changes of a relay win */
+            const quint8 lost = changed & ~m_combineMask;
+            m_combineMask |= lost;
+            m_combineState = (m_combineState & ~lost) | (state & lost);
+        }
+        else {
+            m_combineRetries = 0;
+            qCritical() << id() << "Combined relay write failed:" << result.m_message;
+            emit errorOccured(deviceAddress(), result.m_error, tr("Relay changes lost: %1").arg(result.m_message));
+            /* show the board state again */
+            readRelayStatus();
+        }
+        flushRelays();
+    });
 }
 
 /* Query Digital Input Status */
-inline void WSRelayDigInMbRtu::readInputStatus()
+inline MBRtuRequest WSRelayDigInMbRtu::readInputStatus()
 {
     if (isTrace(MBRtuClient::TRACE_CONTROL)) {
         qDebug() << id() << "Read Digital Input";
     }
 
-    send(
-       ReadDigitalInput,
-       deviceAddress(),
-       QModbusRequest(
-          QModbusRequest::ReadDiscreteInputs,
-          (quint16) 0x0000, // 16bit Digitial Input Start Address
-          (quint8) 0x00,    // 16bit Number of inputs HI
-          (quint8) 0x08)    // 16bit Number of inputs LO
-    );
+    /* Digitial Input Start Address 0x0000, 8 inputs */
+    return track(ReadDigitalInput, bus()->readDiscreteInputs(deviceAddress(), 0x0000, maxInputs()));
+}
+
+/* -------------------------------------------------------
+ * Event Methods
+ * ------------------------------------------------------- */
+
+void WSRelayDigInMbRtu::onCombineTimer()
+{
+    flushRelays();
+}
+
+void WSRelayDigInMbRtu::onCaptureTimer()
+{
+    captureInputs();
 }
@@ -5,12 +5,17 @@
  * SPDX-License-Identifier: GPL v3
  **********************************************************************/
 #pragma once
+#include <QList>
 #include <QMap>
 #include <QObject>
 #include <QSerialPort>
 #include <QTimer>
+#include <QVector>
 #include <QWidget>
+#include <atomic>
 #include <mbrtuclient.h>
+#include <mbspscqueue.h>
+#include <mbtimingwheel.h>
 #include <wsmodbusrtu.h>
 
 /**
@@ -32,6 +37,7 @@ public:
         WriteControlModes = RtuCustomStart + 0x0108,
         SetFlashOnInterval = RtuCustomStart + 0x0109,
         SetFlashOffInterval = RtuCustomStart + 0x0110,
+        CaptureDigitalInput = RtuCustomStart + 0x0111,
     };
     Q_ENUM(TRelayFunction)
 
@@ -42,6 +48,23 @@ public:
     };
     Q_ENUM(TControlMode)
 
+    typedef struct {
+        /* ms after the previous step */
+        uint m_delay;
+        /* relay number, 0xff = all relays */
+        quint8 m_relay;
+        bool m_state;
+    } TSequenceStep;
+
+    typedef struct {
+        /* monotonic us of the sample, TX/RX midpoint */
+        qint64 m_stamp;
+        /* us since the previous sample, the edge lies within */
+        qint64 m_window;
+        quint8 m_channel;
+        bool m_state;
+    } TInputEdge;
+
     explicit WSRelayDigInMbRtu(MBRtuClient* modbus, QObject* parent = nullptr);
 
     ~WSRelayDigInMbRtu();
@@ -53,6 +76,29 @@ public:
 
     void setRelayStatus(const quint8 relay, const bool state);
     void setAllRelays(const quint8 mask);
+    /* relay on, the module switches it off after msecs (100 ms steps, max 3276.7 s) */
+    void flashOn(const quint8 relay, const uint msecs);
+    /* relay off, the module switches it on after msecs */
+    void flashOff(const quint8 relay, const uint msecs);
+    /* timed pulse to state, one frame per pulse, the end costs no bus time */
+    void pulseRelay(const quint8 relay, const bool state, const uint msecs);
+    /* timed steps on the monotonic wheel, frames go ahead of polls, 0 = rejected */
+    int runSequence(const QVector<TSequenceStep>& steps);
+    void stopSequence(int sequence);
+    /* FC02 back to back ahead of polls, share = percent of bus time */
+    void setInputCapture(bool enable, uint share = 50);
+    bool isInputCapture() const;
+    /* edges per channel since capture start, any thread */
+    quint64 edgeCount(const quint8 channel) const;
+    /* edges lost to a full queue, any thread */
+    quint64 edgeOverruns() const;
+    /* single consumer in any thread */
+    bool takeEdge(TInputEdge* edge);
+    /* one broadcast frame switches all boards of a line, optional read back */
+    static void broadcastRelays(const QList<WSRelayDigInMbRtu*>& boards, const quint8 mask, bool verify = true);
+    /* merge relay changes within msecs into one mask write, 0 = off */
+    void setCombineWindow(int msecs);
+    int combineWindow() const;
     void setControlModes(const QMap<quint8, TControlMode>& modes, bool updateDevice = false);
     void setControlMode(quint8 channel, const TControlMode mode, bool updateDevice = false);
 
@@ -65,15 +111,23 @@ signals:
     void relayChanged(quint8 relay, bool state);
     void inputChanged(quint8 channel, bool state);
     void modeChanged(quint8 channel, WSRelayDigInMbRtu::TControlMode mode);
+    /* skew: dispatch minus plan, latency: dispatch to acknowledge, in ms */
+    void sequenceStep(int sequence, int step, qint64 skew, qint64 latency);
+    void sequenceDone(int sequence, bool success);
+    /* new edges queued, take them with takeEdge() */
+    void edgesCaptured();
 
 protected:
-    void startStatusWorker() override;
-    void doFunction(uint function) override;
-    void doModbusOpened() override;
-    bool doMduCoils(const QModbusDataUnit& unit) override;
-    bool doMduDiscreteInputs(const QModbusDataUnit& unit) override;
-    bool doMduInputRegisters(const QModbusDataUnit& unit) override;
-    bool doMduHoldingRegisters(const QModbusDataUnit& unit) override;
+    MBTask<> doInitDevice() override;
+    MBTask<> doPollDevice() override;
+    bool doMduCoils(uint function, const QModbusDataUnit& unit) override;
+    bool doMduDiscreteInputs(uint function, const QModbusDataUnit& unit) override;
+    bool doMduInputRegisters(uint function, const QModbusDataUnit& unit) override;
+    bool doMduHoldingRegisters(uint function, const QModbusDataUnit& unit) override;
+
+private slots:
+    void onCombineTimer();
+    void onCaptureTimer();
 
 private:
     /* holds current relay control mode */
@@ -82,11 +136,52 @@ private:
     QMap<quint8, bool> m_relays;
     /* holds current digital input state */
     QMap<quint8, bool> m_dinputs;
+    /* write combining, changed relays and their state */
+    QTimer m_combineTimer;
+    quint8 m_combineMask;
+    quint8 m_combineState;
+    bool m_combineBusy;
+    uint m_combineRetries;
+    /* armed pulse per relay, newer writes win */
+    QMap<quint8, uint> m_pulses;
+    /* relay sequences and their timer */
+    typedef struct {
+        QVector<TSequenceStep> m_steps;
+        /* planned monotonic time of the next step */
+        qint64 m_planned;
+        int m_next;
+        /* steps on the bus */
+        int m_pending;
+        quint64 m_action;
+    } TSequence;
+    MBTimingWheel m_wheel;
+    QMap<int, TSequence> m_sequences;
+    int m_nextSequence;
+    /* input capture, last sample and its stamp */
+    QTimer m_captureTimer;
+    bool m_capture;
+    bool m_captureBusy;
+    bool m_captureValid;
+    uint m_captureShare;
+    quint8 m_captureMask;
+    qint64 m_captureStamp;
+    std::atomic<quint64> m_edgeCounts[8];
+    std::atomic<quint64> m_edgeOverruns;
+    MBSpscQueue<TInputEdge> m_edges;
 
 private:
-    inline void readRelayStatus();
-    inline void readInputStatus();
-    inline void readControlModes();
+    inline MBRtuRequest readRelayStatus();
+    inline MBRtuRequest readInputStatus();
+    inline MBRtuRequest readControlModes();
+    inline MBRtuRequest writeRelay(const quint8 relay, const bool state, const MBRtuClient::TPriority priority = MBRtuClient::PriorityNormal);
+    inline MBRtuRequest writeRelayMask(const quint8 mask);
+    inline MBRtuRequest writeFlash(const quint8 relay, const bool state, const uint msecs);
+    inline void updateRelay(const quint8 relay, const bool state);
+    inline void syncRelays(const quint8 mask);
+    inline void flushRelays();
+    inline void runStep(int sequence);
+    inline void captureInputs();
+    inline void captureEdges(const QModbusDataUnit& unit, qint64 stamp);
 };
 
 Q_DECLARE_METATYPE(WSRelayDigInMbRtu::TRelayFunction)
@@ -0,0 +1,287 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#include <QDebug>
+#include <limits>
+#include <wsrenogympptmbrtu.h>
+
+/* dynamic data block, one FC03 read */
+#define DYN_START 0x0100
+#define DYN_COUNT 0x0023
+
+/* device info block, rated values to address register */
+#define INFO_START 0x000A
+#define INFO_COUNT 0x0011
+
+namespace {
+
+enum TEncoding {
+    /* whole register */
+    EncU16,
+    /* high / low byte of a register */
+    EncU8Hi,
+    EncU8Lo,
+    /* sign bit 7 and magnitude, temperatures */
+    EncS8Hi,
+    EncS8Lo,
+    /* bit 15, bits 8-14 of a register */
+    EncFlagHi,
+    EncU7Hi,
+    /* register pair, high word first */
+    EncU32,
+};
+
+typedef struct {
+    WSRenogyMpptMbRtu::TMetric m_metric;
+    /* register offset in the dynamic block */
+    quint16 m_offset;
+    TEncoding m_encoding;
+    double m_scale;
+} TDecoder;
+
+/* clang-format off */
+const TDecoder decoders[] = {
+   {WSRenogyMpptMbRtu::BatterySoc,             0x00, EncU16,  1.0},
+   {WSRenogyMpptMbRtu::BatteryVoltage,         0x01, EncU16,  0.1},
+   {WSRenogyMpptMbRtu::ChargeCurrent,          0x02, EncU16,  0.01},
+   {WSRenogyMpptMbRtu::ControllerTemp,         0x03, EncS8Hi, 1.0},
+   {WSRenogyMpptMbRtu::BatteryTemp,            0x03, EncS8Lo, 1.0},
+   {WSRenogyMpptMbRtu::LoadVoltage,            0x04, EncU16,  0.1},
+   {WSRenogyMpptMbRtu::LoadCurrent,            0x05, EncU16,  0.01},
+   {WSRenogyMpptMbRtu::LoadPower,              0x06, EncU16,  1.0},
+   {WSRenogyMpptMbRtu::PvVoltage,              0x07, EncU16,  0.1},
+   {WSRenogyMpptMbRtu::PvCurrent,              0x08, EncU16,  0.01},
+   {WSRenogyMpptMbRtu::ChargePower,            0x09, EncU16,  1.0},
+   {WSRenogyMpptMbRtu::DayBatteryMinVoltage,   0x0B, EncU16,  0.1},
+   {WSRenogyMpptMbRtu::DayBatteryMaxVoltage,   0x0C, EncU16,  0.1},
+   {WSRenogyMpptMbRtu::DayMaxChargeCurrent,    0x0D, EncU16,  0.01},
+   {WSRenogyMpptMbRtu::DayMaxDischargeCurrent, 0x0E, EncU16,  0.01},
+   {WSRenogyMpptMbRtu::DayMaxChargePower,      0x0F, EncU16,  1.0},
+   {WSRenogyMpptMbRtu::DayMaxDischargePower,   0x10, EncU16,  1.0},
+   {WSRenogyMpptMbRtu::DayChargeAh,            0x11, EncU16,  1.0},
+   {WSRenogyMpptMbRtu::DayDischargeAh,         0x12, EncU16,  1.0},
+   {WSRenogyMpptMbRtu::DayGeneration,          0x13, EncU16,  0.0001},
+   {WSRenogyMpptMbRtu::DayConsumption,         0x14, EncU16,  0.0001},
+   {WSRenogyMpptMbRtu::OperatingDays,          0x15, EncU16,  1.0},
+   {WSRenogyMpptMbRtu::OverDischarges,         0x16, EncU16,  1.0},
+   {WSRenogyMpptMbRtu::FullCharges,            0x17, EncU16,  1.0},
+   {WSRenogyMpptMbRtu::TotalChargeAh,          0x18, EncU32,  1.0},
+   {WSRenogyMpptMbRtu::TotalDischargeAh,       0x1A, EncU32,  1.0},
+   {WSRenogyMpptMbRtu::TotalGeneration,        0x1C, EncU32,  0.0001},
+   {WSRenogyMpptMbRtu::TotalConsumption,       0x1E, EncU32,  0.0001},
+   {WSRenogyMpptMbRtu::LoadState,              0x20, EncFlagHi, 1.0},
+   {WSRenogyMpptMbRtu::ChargingState,          0x20, EncU8Lo, 1.0},
+   {WSRenogyMpptMbRtu::FaultCodes,             0x21, EncU32,  1.0},
+   {WSRenogyMpptMbRtu::LoadBrightness,         0x20, EncU7Hi, 1.0},
+};
+/* clang-format on */
+
+inline double decode(const TDecoder& d, const QVector<quint16>& values)
+{
+    const quint16 value = values.value(d.m_offset);
+    switch (d.m_encoding) {
+        case EncU8Hi: {
+            return ((value >> 8) & 0xff) * d.m_scale;
+        }
+        case EncU8Lo: {
+            return (value & 0xff) * d.m_scale;
+        }
+        case EncFlagHi: {
+            return ((value >> 15) & 0x01) * d.m_scale;
+        }
+        case EncU7Hi: {
+            return ((value >> 8) & 0x7f) * d.m_scale;
+        }
+        case EncS8Hi:
+        case EncS8Lo: {
+            const quint8 b = (d.m_encoding == EncS8Hi ? (value >> 8) & 0xff : value & 0xff);
+            return ((b & 0x80) ? -(b & 0x7f) : (b & 0x7f)) * d.m_scale;
+        }
+        case EncU32: {
+            return (((quint32) value << 16) | values.value(d.m_offset + 1)) * d.m_scale;
+        }
+        default: {
+            return value * d.m_scale;
+        }
+    }
+}
+
+} // namespace
+
+WSRenogyMpptMbRtu::WSRenogyMpptMbRtu(MBRtuClient* modbus, QObject* parent)
+    : WSModbusRtu {modbus, parent}
+    , m_metrics(MetricCount, std::numeric_limits<double>::quiet_NaN())
+    , m_model()
+{
+    setDeviceAddress(1, false);
+    setQueryInterval(2000);
+}
+
+WSRenogyMpptMbRtu::~WSRenogyMpptMbRtu()
+{
+}
+
+/* -------------------------------------------------------
+ * Api Methods
+ * ------------------------------------------------------- */
+
+const char* WSRenogyMpptMbRtu::id() const
+{
+    return "RNMPPT:";
+}
+
+quint8 WSRenogyMpptMbRtu::maxInputs() const
+{
+    return MetricCount;
+}
+
+quint8 WSRenogyMpptMbRtu::maxOutputs() const
+{
+    return 1;
+}
+
+QWidget* WSRenogyMpptMbRtu::settingsWidget(QWidget*)
+{
+    return nullptr;
+}
+
+void WSRenogyMpptMbRtu::setLoadState(bool on)
+{
+    if (isTrace(MBRtuClient::TRACE_CONTROL)) {
+        qDebug() << id() << "Set load:" << on;
+    }
+
+    send(
+       WriteLoadState,
+       deviceAddress(),
+       QModbusRequest( //
+          QModbusRequest::WriteSingleRegister,
+          (quint16) 0x010A,       // 16bit Street light (load) on/off
+          (quint8) 0x00,          // 16bit state - byte HI
+          (quint8) (on ? 1 : 0))) // 16bit state - byte LO
+       .then(this, [this](const MBRtuRequest::TResult& result) {
+           /* state register is part of the dynamic block */
+           if (result.m_status == MBRtuRequest::StatusSuccess) {
+               readDynamicData();
+           }
+       });
+}
+
+double WSRenogyMpptMbRtu::metric(TMetric metric) const
+{
+    return m_metrics.value(metric, std::numeric_limits<double>::quiet_NaN());
+}
+
+const QString& WSRenogyMpptMbRtu::model() const
+{
+    return m_model;
+}
+
+/* -------------------------------------------------------
+ * Protected Methods
+ * ------------------------------------------------------- */
+
+/* software version 0x0014..0x0015 is 00 V1 V2 V3, minor part */
+MBRtuRequest WSRenogyMpptMbRtu::readVersion()
+{
+    if (isTrace(MBRtuClient::TRACE_CONTROL)) {
+        qDebug() << id() << "Read Version";
+    }
+
+    return track(RtuReadVersion, bus()->readHolding(deviceAddress(), 0x0015, 1));
+}
+
+MBRtuRequest WSRenogyMpptMbRtu::readDeviceAddress()
+{
+    if (isTrace(MBRtuClient::TRACE_CONTROL)) {
+        qDebug() << id() << "Read Device Address";
+    }
+
+    /* 16bit Device Address register */
+    return track(RtuReadDeviceAddr, bus()->readHolding(deviceAddress(), 0x001A, 1));
+}
+
+/* inital queries */
+MBTask<> WSRenogyMpptMbRtu::doInitDevice()
+{
+    MBRtuRequest info = readDeviceInfo();
+    MBRtuRequest data = readDynamicData();
+    co_await info;
+    co_await data;
+}
+
+/* status query */
+MBTask<> WSRenogyMpptMbRtu::doPollDevice()
+{
+    co_await readDynamicData();
+}
+
+bool WSRenogyMpptMbRtu::doMduHoldingRegisters(uint function, const QModbusDataUnit& unit)
+{
+    switch (function) {
+        case ReadDeviceInfo: {
+            if (checkValueCount(INFO_COUNT, unit)) {
+                /* model 0x000C..0x0013, 16 ASCII chars */
+                QByteArray model;
+                for (uint i = 0x0C - INFO_START; i <= 0x13 - INFO_START; i++) {
+                    model.append((char) ((unit.value(i) >> 8) & 0xff));
+                    model.append((char) (unit.value(i) & 0xff));
+                }
+                m_model = QString::fromLatin1(model).trimmed();
+                emit modelChanged(m_model);
+            }
+            return true;
+        }
+        case ReadDynamicData: {
+            if (checkValueCount(DYN_COUNT, unit)) {
+                decodeDynamicData(unit);
+            }
+            return true;
+        }
+    }
+
+    return WSModbusRtu::doMduHoldingRegisters(function, unit);
+}
+
+/* -------------------------------------------------------
+ * Private Methods
+ * ------------------------------------------------------- */
+
+inline MBRtuRequest WSRenogyMpptMbRtu::readDeviceInfo()
+{
+    if (isTrace(MBRtuClient::TRACE_CONTROL)) {
+        qDebug() << id() << "Read device info";
+    }
+
+    return track(ReadDeviceInfo, bus()->readHolding(deviceAddress(), INFO_START, INFO_COUNT));
+}
+
+inline MBRtuRequest WSRenogyMpptMbRtu::readDynamicData()
+{
+    if (isTrace(MBRtuClient::TRACE_CONTROL)) {
+        qDebug() << id() << "Read dynamic data";
+    }
+
+    return track(ReadDynamicData, bus()->readHolding(deviceAddress(), DYN_START, DYN_COUNT));
+}
+
+inline void WSRenogyMpptMbRtu::decodeDynamicData(const QModbusDataUnit& unit)
+{
+    const QVector<quint16> values = unit.values();
+    publish(MBProcessImage::HoldingRegisters, 0, values);
+
+    for (const TDecoder& d : decoders) {
+        const double value = decode(d, values);
+        if (value == m_metrics[d.m_metric]) {
+            continue;
+        }
+        m_metrics[d.m_metric] = value;
+        emit metricChanged(d.m_metric, value);
+
+        publishAnalog(d.m_metric, {(float) value});
+        record("solar", d.m_metric, {value});
+    }
+}
@@ -0,0 +1,109 @@
+/*********************************************************************
+ * Copyright EoF Software Labs. All Rights Reserved.
+ * Copyright EoF Software Labs Authors.
+ * Written by B. Eschrich (bjoern.eschrich@gmail.com)
+ * SPDX-License-Identifier: GPL v3
+ **********************************************************************/
+#pragma once
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QWidget>
+#include <mbrtuclient.h>
+#include <wsmodbusrtu.h>
+
+/**
+ * @brief The Renogy MPPT solar charge controller driver class
+ * Rover / Wanderer register map. The whole dynamic range
+ * 0x0100..0x0122 (battery, PV, load, daily and total stats,
+ * state and faults) is one FC03 read per poll, device info
+ * 0x000A..0x001A one read at init. Values are decoded by a
+ * static descriptor table, only changed metrics are emitted.
+ */
+class WSRenogyMpptMbRtu: public WSModbusRtu
+{
+    Q_OBJECT
+
+public:
+    enum TChargerFunction {
+        ReadDeviceInfo = RtuCustomStart + 0x0401,
+        ReadDynamicData = RtuCustomStart + 0x0402,
+        WriteLoadState = RtuCustomStart + 0x0403,
+    };
+    Q_ENUM(TChargerFunction)
+
+    enum TMetric {
+        BatterySoc,
+        BatteryVoltage,
+        ChargeCurrent,
+        ControllerTemp,
+        BatteryTemp,
+        LoadVoltage,
+        LoadCurrent,
+        LoadPower,
+        PvVoltage,
+        PvCurrent,
+        ChargePower,
+        DayBatteryMinVoltage,
+        DayBatteryMaxVoltage,
+        DayMaxChargeCurrent,
+        DayMaxDischargeCurrent,
+        DayMaxChargePower,
+        DayMaxDischargePower,
+        DayChargeAh,
+        DayDischargeAh,
+        DayGeneration,
+        DayConsumption,
+        OperatingDays,
+        OverDischarges,
+        FullCharges,
+        TotalChargeAh,
+        TotalDischargeAh,
+        TotalGeneration,
+        TotalConsumption,
+        LoadState,
+        ChargingState,
+        FaultCodes,
+        LoadBrightness,
+        MetricCount,
+    };
+    Q_ENUM(TMetric)
+
+    explicit WSRenogyMpptMbRtu(MBRtuClient* modbus, QObject* parent = nullptr);
+
+    ~WSRenogyMpptMbRtu();
+
+    const char* id() const override;
+    quint8 maxInputs() const override;
+    quint8 maxOutputs() const override;
+    QWidget* settingsWidget(QWidget* parent) override;
+
+    /* switch the load output, manual load mode only */
+    void setLoadState(bool on);
+
+    double metric(TMetric metric) const;
+    const QString& model() const;
+
+signals:
+    void metricChanged(WSRenogyMpptMbRtu::TMetric metric, double value);
+    void modelChanged(const QString& model);
+
+protected:
+    MBRtuRequest readVersion() override;
+    MBRtuRequest readDeviceAddress() override;
+    MBTask<> doInitDevice() override;
+    MBTask<> doPollDevice() override;
+    bool doMduHoldingRegisters(uint function, const QModbusDataUnit& unit) override;
+
+private:
+    QVector<double> m_metrics;
+    QString m_model;
+
+private:
+    inline MBRtuRequest readDeviceInfo();
+    inline MBRtuRequest readDynamicData();
+    inline void decodeDynamicData(const QModbusDataUnit& unit);
+};
+
+Q_DECLARE_METATYPE(WSRenogyMpptMbRtu::TChargerFunction)
+Q_DECLARE_METATYPE(WSRenogyMpptMbRtu::TMetric)